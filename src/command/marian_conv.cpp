@@ -5,6 +5,7 @@
 #include <sstream>
 
 #include "data/shortlist.h"
+#include "layers/lsh.h"
 #include "tensors/cpu/expression_graph_packable.h"
 #include "onnx/expression_graph_onnx_exporter.h"
 
@@ -26,10 +27,14 @@ int main(int argc, char** argv) {
     cli->add<std::string>("--from,-f", "Input model", "model.npz");
     cli->add<std::string>("--to,-t", "Output model", "model.bin");
     cli->add<std::string>("--export-as", "Kind of conversion: marian-bin or onnx-{encode,decoder-step,decoder-init,decoder-stop}", "marian-bin");
-    cli->add<std::string>("--gemm-type,-g", "GEMM Type to be used: float32, packed16, packed8avx2, packed8avx512, intgemm8, intgemm16", "float32");
+    cli->add<std::string>("--gemm-type,-g", "GEMM Type to be used: float32, packed16, packed8avx2, packed8avx512, intgemm8, intgemm16, "
+                          "int4grouped (4-bit weights with a scale per 32 values, matrices with other sizes stay float32)", "float32");
     cli->add<std::vector<std::string>>("--vocabs,-V", "Vocabulary file, required for ONNX export and shortlist conversion");
     cli->add<std::vector<std::string>>("--shortlist,-s", "Shortlist conversion: filePath firstNum bestNum threshold");
     cli->add<std::string>("--dump,-d", "Binary shortlist dump path","lex.bin");
+    cli->add<int>("--add-lsh", "Precompute the LSH index for --output-approx-knn with this number of bits and store it in the model (0 = none)", 0);
+    cli->add<std::string>("--lsh-output", "Prefix of the output layer to index with --add-lsh", "decoder_ff_logit_out");
+    cli->add<bool>("--quantize-per-column", "With --gemm-type intgemm8, quantize each output column of the weight matrices with its own multiplier");
     cli->parse(argc, argv);
     options->merge(config);
   }
@@ -72,6 +77,8 @@ int main(int argc, char** argv) {
     saveGemmType = Type::intgemm8;
   } else if(saveGemmTypeStr == "intgemm16") { // intgemm 16 bit format
     saveGemmType = Type::intgemm16;
+  } else if(saveGemmTypeStr == "int4grouped") { // 4 bit weights, see tensors/cpu/int4_gemm.h
+    saveGemmType = Type::int4grouped;
   } else {
     ABORT("Unknown gemm-type: {}", saveGemmTypeStr);
   }
@@ -96,8 +103,25 @@ int main(int argc, char** argv) {
   if (exportAs == "marian-bin") {
     auto graph = New<ExpressionGraphPackable>();
     load(graph);
+    graph->quantizePerColumn = options->get<bool>("quantize-per-column");
+    ABORT_IF(graph->quantizePerColumn && saveGemmType != Type::intgemm8, "--quantize-per-column requires --gemm-type intgemm8");
+
+    // LSH codes and rotation of the output matrix, so that decoding does not need to build the index
+    std::vector<io::Item> lshItems;
+    auto lshBits = options->get<int>("add-lsh");
+    if(lshBits > 0) {
+      auto lshOutput = options->get<std::string>("lsh-output");
+      auto tied = [&](const std::string& key) { return config[key] && config[key].as<bool>(); };
+      // same choice of the output matrix as the transformer decoder
+      auto W = graph->get(lshOutput + "_Wt");
+      if(!W)
+        W = graph->get(tied("tied-embeddings-all") || tied("tied-embeddings-src") ? "Wemb" : "decoder_Wemb");
+      ABORT_IF(!W, "No output matrix found for output layer {}", lshOutput);
+      lshItems = LSH::createIndexItems(lshOutput, W->val(), lshBits);
+    }
+
     // added a flag if the weights needs to be packed or not
-    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, Type::float32);
+    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, Type::float32, lshItems);
   }
   else if (exportAs == "onnx-encode") {
 #ifdef USE_ONNX
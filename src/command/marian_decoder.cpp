@@ -1,7 +1,9 @@
 #include "marian.h"
 #include "translator/beam_search.h"
+#include "translator/greedy_search.h"
 #include "translator/translator.h"
 #include "common/timer.h"
+#include "tensors/cpu/integer_common.h"
 #ifdef _WIN32
 #include <Windows.h>
 #endif
@@ -9,11 +11,24 @@
 int main(int argc, char** argv) {
   using namespace marian;
   auto options = parseOptions(argc, argv, cli::mode::translation);
-  auto task = New<Translate<BeamSearch>>(options);
+  Ptr<ModelTask> task;
+  if(options->get<size_t>("beam-size") == 1) {
+    if(GreedySearch::canSkipNormalization(options))
+      options->set("skip-cost", true);
+    task = New<Translate<GreedySearch>>(options);
+  } else {
+    task = New<Translate<BeamSearch>>(options);
+  }
 
   timer::Timer timer;
   task->run();
   LOG(info, "Total time: {:.5f}s wall", timer.elapsed());
 
+  auto calibratedModel = options->get<std::string>("calibrate-alphas", "");
+  if(!calibratedModel.empty())
+    cpu::integer::AlphaCalibration::instance().save(options->get<std::vector<std::string>>("models")[0],
+                                                   calibratedModel,
+                                                   options->get<float>("calibrate-alphas-percentile"));
+
   return 0;
 }
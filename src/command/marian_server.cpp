@@ -1,5 +1,6 @@
 #include "marian.h"
 #include "translator/beam_search.h"
+#include "translator/greedy_search.h"
 #include "translator/translator.h"
 #include "common/timer.h"
 #include "common/utils.h"
@@ -13,7 +14,14 @@ int main(int argc, char **argv) {
 
   // Initialize translation task
   auto options = parseOptions(argc, argv, cli::mode::server, true);
-  auto task = New<TranslateService<BeamSearch>>(options);
+  Ptr<ModelServiceTask> task;
+  if(options->get<size_t>("beam-size") == 1) {
+    if(GreedySearch::canSkipNormalization(options))
+      options->set("skip-cost", true);
+    task = New<TranslateService<GreedySearch>>(options);
+  } else {
+    task = New<TranslateService<BeamSearch>>(options);
+  }
   auto quiet = options->get<bool>("quiet-translation");
 
   // Initialize web server
@@ -3,6 +3,7 @@
 #include "common/file_stream.h"
 #include "common/io_item.h"
 #include "common/types.h"
+#include "common/utils.h"
 #include "tensors/cpu/integer_common.h"
 
 #include <string>
@@ -27,12 +28,14 @@ const T* get(const void*& current, uint64_t num = 1) {
   return ptr;
 }
 
-void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
+void loadItems(const void* current, std::vector<io::Item>& items, bool mapped, bool prepareIntgemm) {
   uint64_t binaryFileVersion = *get<uint64_t>(current);
-  ABORT_IF(binaryFileVersion != BINARY_FILE_VERSION,
-           "Binary file versions do not match: {} (file) != {} (expected)",
+  ABORT_IF(binaryFileVersion != BINARY_FILE_VERSION
+           && binaryFileVersion != BINARY_FILE_VERSION_QUANT_COLUMNS,
+           "Binary file versions do not match: {} (file) != {} or {} (expected)",
            binaryFileVersion,
-           BINARY_FILE_VERSION);
+           BINARY_FILE_VERSION,
+           BINARY_FILE_VERSION_QUANT_COLUMNS);
 
   uint64_t numHeaders = *get<uint64_t>(current); // number of item headers that follow
   const Header* headers = get<Header>(current, numHeaders); // read that many headers
@@ -58,17 +61,20 @@ void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
   get<char>(current, offset);
 
   for(int i = 0; i < numHeaders; ++i) {
-    //if(items[i].mapped && !isIntgemm(items[i].type)) { // memory-mapped, hence only set pointer. At the moment it intgemm matrices can't be used without processing
-    //  items[i].ptr = get<char>(current, headers[i].dataLength);
-    //} else { // reading into item data
-    items[i].mapped = false;  // Completely disable MMAP support for any models. We do not use it in bergamot and we hijack this codepath for binary model loading.
-                              // If this is not set, we trigger node_initializers.cpp:186. This one just assigns the memory ptr to the tensor if set to true, but at the moment
-                              // We are preparing some things on demand (the bottom portion of this code). Once we stop doing that, we can use the full mmap codepath
-                              // Also when using the full mmap codepath, we need to uncomment expression_graph.h:582
+    // Memory-mapped items only point into the buffer. Intgemm matrices are stored in an architecture-agnostic
+    // layout and still have to be prepared for the CPU at hand, and the tensor memory has to be 256-byte
+    // aligned, which only holds if the buffer itself is. Such items are read into item data instead.
+    if(items[i].mapped && !isIntgemm(items[i].type) && (uintptr_t)current % 256 == 0) {
+      items[i].ptr = get<char>(current, headers[i].dataLength);
+      continue;
+    }
+    items[i].mapped = false;
     uint64_t len = headers[i].dataLength;
     items[i].bytes.resize(len);
     const char* ptr = get<char>(current, len);
-    if (matchType<intgemm8>(items[i].type)) {
+    if (!prepareIntgemm) {
+      std::copy(ptr, ptr + len, items[i].bytes.begin());
+    } else if (matchType<intgemm8>(items[i].type)) {
       if (items[i].name.find("Wemb") != std::string::npos) { // Since Wemb need to be dequantised, we have a special case for them
         items[i].type = Type::float32;
         items[i].bytes.resize(items[i].shape.elements()*sizeof(float)); // We should have an extra float at the back but that requires a different format, due to allocator work
@@ -90,7 +96,7 @@ void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
   }
 }
 
-void loadItems(const std::string& fileName, std::vector<io::Item>& items) {
+void loadItems(const std::string& fileName, std::vector<io::Item>& items, bool prepareIntgemm) {
   // Read file into buffer
   uint64_t fileSize = filesystem::fileSize(fileName);
   std::vector<char> buf(fileSize);
@@ -107,7 +113,7 @@ void loadItems(const std::string& fileName, std::vector<io::Item>& items) {
 #endif
 
   // Load items from buffer without mapping
-  loadItems(buf.data(), items, false);
+  loadItems(buf.data(), items, false, prepareIntgemm);
 }
 
 io::Item getItem(const void* current, const std::string& varName) {
@@ -138,6 +144,9 @@ void saveItems(const std::string& fileName,
   uint64_t pos = 0;
 
   uint64_t binaryFileVersion = BINARY_FILE_VERSION;
+  for(const auto& item : items)
+    if(utils::endsWith(item.name, "_QuantMultBCols"))
+      binaryFileVersion = BINARY_FILE_VERSION_QUANT_COLUMNS;
   pos += out.write(&binaryFileVersion);
 
   std::vector<Header> headers;
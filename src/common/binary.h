@@ -8,14 +8,20 @@
 namespace marian {
 
 const static int BINARY_FILE_VERSION = 1;
+// Written instead for models with per-column int8 quantization multipliers (<W>_QuantMultBCols), which
+// readers of version 1 would ignore and then decode the weights with a wrong multiplier
+const static int BINARY_FILE_VERSION_QUANT_COLUMNS = 2;
 
 namespace io {
 namespace binary {
 
+// Intgemm matrices are prepared for the CPU at hand unless prepareIntgemm is false, then they are
+// returned as stored, e.g. to write them to another model file unchanged.
 void loadItems(const void* current,
                std::vector<io::Item>& items,
-               bool mapped = false);
-void loadItems(const std::string& fileName, std::vector<io::Item>& items);
+               bool mapped = false,
+               bool prepareIntgemm = true);
+void loadItems(const std::string& fileName, std::vector<io::Item>& items, bool prepareIntgemm = true);
 
 io::Item getItem(const void* current, const std::string& vName);
 io::Item getItem(const std::string& fileName, const std::string& vName);
@@ -153,6 +153,16 @@ void ConfigParser::addOptionsServer(cli::CLIWrapper& cli) {
   cli.add<size_t>("--port,-p",
       "Port number for web socket server",
       8080);
+  cli.add<size_t>("--max-batch-delay",
+      "Merge sentences of concurrent requests into shared batches of up to --mini-batch sentences. "
+      "A batch is translated once it is full or its oldest sentence waited arg milliseconds. "
+      "0 translates each request separately",
+      0);
+  cli.add<std::vector<size_t>>("--worker-cores",
+      "Pin translation worker i (one per device or --cpu-threads) to CPU core arg[i % size]. "
+      "Workspace and model parameters are then allocated on the worker's NUMA node. "
+      "With --cpu-intra-op-threads N each worker takes the next N cores of arg (wrapping around), "
+      "one for itself and one for each of its intra-op threads");
   cli.switchGroup(previous_group);
   // clang-format on
 }
@@ -669,6 +679,11 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   addSuboptionsBatching(cli);
   addSuboptionsIntgemm(cli);
 
+  cli.add<bool>("--transformer-kv-cache",
+      "Keep the keys and values of earlier steps of the transformer decoder self-attention in per-batch buffers on CPU "
+      "and attend over them in place instead of re-projecting the target history every step. "
+      "The cached self-attention computes in float even with --int8-attention. Set to false for the previous behaviour",
+      true);
   cli.add<bool>("--use-legacy-batching",
       "Use legacy codepath with a for loop of cblas_sgemm, instead of cblas_sgemm_batched.");
   cli.add<bool>("--skip-cost",
@@ -681,6 +696,14 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
 
   cli.add<std::vector<std::string>>("--shortlist",
      "Use softmax shortlist: path first best prune");
+  cli.add<size_t>("--shortlist-group-size",
+     "Generate a separate shortlist for each group of arg sentences of a batch instead of one for the whole batch. "
+     "0 uses one shortlist per batch",
+     0);
+  cli.add<size_t>("--shortlist-weights-cache",
+     "Cache the shortlisted columns of quantized output weights across batches, using at most arg MB per device. "
+     "0 disables the cache",
+     0);
   cli.add<std::vector<float>>("--weights",
       "Scorer weights");
   cli.add<bool>("--output-sampling",
@@ -689,6 +712,13 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   cli.add<std::vector<int>>("--output-approx-knn",
      "Use approximate knn search in output layer (currently only in transformer)")
      ->implicit_val("100 1024");
+  cli.add<size_t>("--translation-cache",
+     "Cache translations of repeated source sentences, using at most arg MB. 0 disables the cache",
+     0);
+  cli.add<bool>("--continuous-batching",
+     "Decode up to --mini-batch sentences at a time per device and refill the slots of finished sentences "
+     "with new input instead of waiting for the whole batch (marian-decoder, transformers on the CPU; "
+     "other models decode the batches one after another)");
 
 #if 0 // @TODO: Ask Hany if there are any decoding-time options
   // add ULR settings
@@ -806,6 +836,11 @@ void ConfigParser::addSuboptionsDevices(cli::CLIWrapper& cli) {
       "Use CPU-based computation with this many independent threads, 0 means GPU-based computation",
       1);
 #endif
+  cli.add<size_t>("--cpu-intra-op-threads",
+      "Threads per CPU thread of --cpu-threads that split single operators (GEMMs, softmax, layer normalization, "
+      "row copies) to reduce the latency of single requests. Uses cpu-threads * arg threads in total. "
+      "With --worker-cores the intra-op threads of a worker are pinned to distinct cores after the worker's own",
+      1);
   // clang-format on
 }
 
@@ -842,6 +877,12 @@ void ConfigParser::addSuboptionsBatching(cli::CLIWrapper& cli) {
   cli.add<std::string>("--maxi-batch-sort",
       "Sorting strategy for maxi-batch: none, src, trg (not available for decoder)",
       defaultMaxiBatchSort);
+  if(mode_ == cli::mode::translation)
+    cli.add<size_t>("--data-threads",
+        "Number of threads encoding input sentences into (sub)word ids while the next lines are read. "
+        "Values above 1 read ahead, but not beyond the lines that are available on stdin, so that "
+        "line-by-line streaming is not held back",
+        1);
 
   if(mode_ == cli::mode::training) {
     cli.add<bool>("--shuffle-in-ram",
@@ -933,9 +974,25 @@ void ConfigParser::addSuboptionsIntgemm(cli::CLIWrapper& cli) {
   cli.add<bool>("--int8shiftAlphaAll",
       "Use a faster, shifted integer 8bit GEMM implementation even for matrices that don't have a bias, with precomputed alphas. Should be the fastest option. Corresponds to --gemm-precision int8shiftAlphaAll");
   cli.add<std::string>("--gemm-precision",
-      "Use lower precision for the GEMM operations only. Supported values: float32, int16, int8, int8Alpha, int8shift, int8shiftAlpha, int8shiftAll, int8shiftAlphaAll", "float32");
+      "Use lower precision for the GEMM operations only. Supported values: float32, int16, int8, int8Alpha, int8shift, int8shiftAlpha, int8shiftAll, int8shiftAlphaAll, "
+      "auto (fastest of --gemm-autotune-kernels per matrix size)", "float32");
+  cli.add<std::vector<std::string>>("--gemm-autotune-kernels",
+      "GEMM kernels that --gemm-precision auto chooses from: float32, int16, int8, packed16. "
+      "Integer kernels are only used for matrix sizes they support, packed16 requires fbgemm",
+      {"float32", "int16", "int8", "packed16"});
+  cli.add<std::string>("--gemm-autotune-file",
+      "Store the choices of --gemm-precision auto in this file and reuse them in later runs");
+  cli.add<bool>("--int8-attention",
+      "Compute the query-key and attention-value products of transformer attention in 8-bit integers on CPU, "
+      "quantized per head on the fly. The decoder self-attention reads its cached float keys and values in place instead");
   cli.add<bool>("--dump-quantmult",
       "Dump the quantization multipliers of activation matrices during an avarage run. To be used to precompute alphas for ---gemm-precision int8shiftAlpha or int8shiftAlphaAll.");
+  cli.add<std::string>("--calibrate-alphas",
+      "Quantize activations on the fly while decoding and save the model with alphas for --gemm-precision int8shiftAlpha "
+      "or int8shiftAlphaAll computed from them to this file (.npz or .bin). Decode a representative calibration corpus with it");
+  cli.add<float>("--calibrate-alphas-percentile",
+      "Percentile of the per-batch maxima of each activation matrix that --calibrate-alphas maps to 127",
+      99.99f);
   // clang-format on
 }
 void ConfigParser::addSuboptionsQuantization(cli::CLIWrapper& cli) {
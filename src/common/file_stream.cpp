@@ -1,9 +1,14 @@
 #include "common/file_stream.h"
 #include "common/utils.h"
 
+#ifndef WASM_COMPATIBLE_SOURCE
+#include "3rd_party/mio/mio.hpp"
+#endif
+
 #include <streambuf>
 #include <string>
 #include <vector>
+#include <cerrno>
 #include <cstdio>
 #ifdef _MSC_VER
 #include <io.h>
@@ -11,6 +16,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #else
+#include <poll.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif
@@ -78,6 +84,99 @@ std::string InputFileStream::getFileName() const {
   return file_.string();
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////
+namespace {
+
+#ifndef WASM_COMPATIBLE_SOURCE
+// exposes the mapped file as the get area
+class MappedStreamBuf : public std::streambuf {
+public:
+  explicit MappedStreamBuf(const std::string& file) : mmap_(file) {
+    char* begin = const_cast<char*>(mmap_.data());
+    setg(begin, begin, begin + mmap_.size());
+  }
+
+private:
+  mio::mmap_source mmap_;
+};
+#endif
+
+// refills the get area with read() on file descriptor 0
+class StdinStreamBuf : public std::streambuf {
+public:
+  explicit StdinStreamBuf(size_t bufferSize) : buffer_(bufferSize) {
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+  }
+
+protected:
+  int_type underflow() override {
+    if(gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+    decltype(readStdin()) bytes;
+    do { // retry reads interrupted by a signal, e.g. SIGCHLD from a supervising process
+      bytes = readStdin();
+    } while(bytes < 0 && errno == EINTR);
+    ABORT_IF(bytes < 0, "Error reading from stdin ({})", errno);
+    if(bytes == 0)
+      return traits_type::eof();
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + bytes);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  // 1 if the next underflow() returns without waiting for input, 0 if unknown or it would wait
+  std::streamsize showmanyc() override {
+#ifdef _MSC_VER
+    return 0;
+#else
+    pollfd fd = {0, POLLIN, 0};
+    return ::poll(&fd, 1, /*timeout=*/0) > 0 ? 1 : 0; // readable, at the end of the input or failed
+#endif
+  }
+
+private:
+  std::vector<char> buffer_;
+
+#ifdef _MSC_VER
+  int readStdin() { return _read(0, buffer_.data(), (unsigned int)buffer_.size()); }
+#else
+  ssize_t readStdin() { return ::read(0, buffer_.data(), buffer_.size()); }
+#endif
+};
+
+}  // namespace
+
+MappedInputFileStream::MappedInputFileStream(const std::string& file) : std::istream(NULL) {
+#ifndef WASM_COMPATIBLE_SOURCE
+  ABORT_IF(!canMap(file), "File '{}' cannot be memory-mapped", file);
+  streamBuf_.reset(new MappedStreamBuf(file));
+  this->init(streamBuf_.get());
+#else
+  ABORT("Memory-mapping files is not supported in WASM builds of Marian: {}", file);
+#endif
+}
+
+MappedInputFileStream::~MappedInputFileStream() {}
+
+bool MappedInputFileStream::canMap(const std::string& file) {
+#ifdef WASM_COMPATIBLE_SOURCE
+  return false; // mio is not available
+#endif
+  if(marian::utils::endsWith(file, "|") || marian::utils::endsWith(file, ".gz"))
+    return false;
+  marian::filesystem::Path path(file);
+  return marian::filesystem::exists(path)
+         && !marian::filesystem::is_fifo(file)
+         && !marian::filesystem::isDirectory(path)
+         && marian::filesystem::fileSize(path) > 0;
+}
+
+InputStdinStream::InputStdinStream(size_t bufferSize) : std::istream(NULL) {
+  streamBuf_.reset(new StdinStreamBuf(bufferSize));
+  this->init(streamBuf_.get());
+}
+
+InputStdinStream::~InputStdinStream() {}
+
 // wrapper around std::getline() that handles Windows input files with extra CR
 // chars at the line end
 std::istream &getline(std::istream &in, std::string &line) {
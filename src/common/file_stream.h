@@ -57,6 +57,34 @@ protected:
   std::vector<char> readBuf_;
 };
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Input stream over a memory-mapped file. The whole mapping serves as the stream buffer, hence
+// reading lines neither issues read() calls nor copies through an intermediate buffer.
+// Only for regular, uncompressed, non-empty files, see canMap().
+class MappedInputFileStream : public std::istream {
+public:
+  explicit MappedInputFileStream(const std::string& file);
+  virtual ~MappedInputFileStream();
+
+  static bool canMap(const std::string& file);
+
+protected:
+  std::unique_ptr<std::streambuf> streamBuf_;
+};
+
+// Input stream over standard input that reads large chunks directly from the file descriptor
+// instead of character-wise through the stdio-synchronized buffer of std::cin. Unlike fread()
+// a read returns whatever is available, so line-by-line interactive use does not block. rdbuf()->in_avail()
+// is positive if the next read would not wait for more input.
+class InputStdinStream : public std::istream {
+public:
+  explicit InputStdinStream(size_t bufferSize = 1 << 20);
+  virtual ~InputStdinStream();
+
+protected:
+  std::unique_ptr<std::streambuf> streamBuf_;
+};
+
 std::istream& getline(std::istream& in, std::string& line);
 
 //////////////////////////////////////////////////////////////////////////////////////////////
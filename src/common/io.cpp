@@ -109,12 +109,12 @@ void loadItemsFromNpz(const std::string& fileName, std::vector<Item>& items) {
   }
 }
 
-std::vector<Item> loadItems(const std::string& fileName) {
+std::vector<Item> loadItems(const std::string& fileName, bool prepareIntgemm) {
   std::vector<Item> items;
   if(isNpz(fileName)) {
     loadItemsFromNpz(fileName, items);
   } else if(isBin(fileName)) {
-    binary::loadItems(fileName, items);
+    binary::loadItems(fileName, items, prepareIntgemm);
   } else {
     ABORT("Unknown model file format for file {}", fileName);
   }
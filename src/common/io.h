@@ -27,7 +27,8 @@ void addMetaToItems(const std::string& meta,
                     const std::string& varName,
                     std::vector<io::Item>& items);
 
-std::vector<Item> loadItems(const std::string& fileName);
+// see binary::loadItems() for prepareIntgemm
+std::vector<Item> loadItems(const std::string& fileName, bool prepareIntgemm = true);
 std::vector<Item> loadItems(const void* ptr);
 
 std::vector<Item> mmapItems(const void* ptr);
@@ -1,5 +1,6 @@
 #include "common/types.h"
 #include "tensors/cpu/fbgemm/packed_gemm.h"
+#include "tensors/cpu/int4_gemm.h"
 
 namespace marian {
 
@@ -8,6 +9,10 @@ namespace marian {
 // But for instance, for intransparent types like packed tensors, it cannot easily be inferred by
 // multiplying. All cases are handed here and can later be passed to allocators etc. 
 size_t requiredBytes(const Shape& shape, Type type) {
+  if (isGroupQuantized(type)) {
+    /* 4 bits per value and the scales of the groups */
+    return cpu::int4::packedBytes(shape.elements() / shape[-1], shape[-1]);
+  }
 #if USE_FBGEMM
   if (isPacked(type)) {
     if (sizeOf(type) == 1) {
@@ -168,6 +168,11 @@ struct intgemm8 {
   int8_t x;
 };
 
+// memory holder for 4-bit weights with group scales, see tensors/cpu/int4_gemm.h
+struct int4grouped {
+  uint8_t x;
+};
+
 
 #ifndef __CUDACC__ // vectorized types not available from .cu files
 
@@ -282,6 +287,7 @@ enum class TypeClass : size_t {
   avx512_type   = 0x2000, // processor-specific layout for avx512, currently used for FBGEMM only
 
   intgemm_type = 0x4000, // intgemm quantized architecture agnostic models
+  grouped_type = 0x8000, // 4-bit weights with a scale per group of values, unpacked on the fly
 
 
   size_mask     = 0x00FF,
@@ -317,7 +323,9 @@ enum class Type : size_t {
   packed8avx512 = TypeClass::packed_type + 1u + TypeClass::avx512_type, // special type for FBGEMM with AVX512, not meant to be used anywhere else, not meant to be accessed invidually. Internal actual type (uint8) is meaningless.
 
   intgemm8      = TypeClass::signed_type + 1u + TypeClass::intgemm_type, // Int8 quantized (not packed) matrices for intgemm
-  intgemm16     = TypeClass::signed_type + 2u + TypeClass::intgemm_type // Int16 quantized (not packed) matrices for intgemm
+  intgemm16     = TypeClass::signed_type + 2u + TypeClass::intgemm_type, // Int16 quantized (not packed) matrices for intgemm
+
+  int4grouped   = TypeClass::signed_type + 1u + TypeClass::grouped_type // 4-bit weights with group scales, size is not elements * sizeOf(), see requiredBytes()
 };
 
 static inline size_t operator&(TypeClass typeClass, Type type) {
@@ -364,6 +372,10 @@ static inline bool isIntgemm(Type type) {
   return (TypeClass::intgemm_type & type) != 0;
 }
 
+static inline bool isGroupQuantized(Type type) {
+  return (TypeClass::grouped_type & type) != 0;
+}
+
 size_t requiredBytes(const Shape& shape, Type type); // towards Frank's vision of joint Shape/Type
 
 template <typename T>
@@ -391,6 +403,8 @@ template <> inline bool matchType<packed8avx512>(Type type)  { return type == Ty
 
 template <> inline bool matchType<intgemm8>(Type type)    { return type == Type::intgemm8;    }
 template <> inline bool matchType<intgemm16>(Type type)   { return type == Type::intgemm16;  }
+
+template <> inline bool matchType<int4grouped>(Type type) { return type == Type::int4grouped; }
 // clang-format on
 
 static inline std::ostream& operator<<(std::ostream& out, Type type) {
@@ -415,6 +429,8 @@ static inline std::ostream& operator<<(std::ostream& out, Type type) {
 
     case Type::intgemm8   : out << "intgemm8"; break;
     case Type::intgemm16  : out << "intgemm16"; break;
+
+    case Type::int4grouped : out << "int4grouped"; break;
   }
   return out;
 }
@@ -443,6 +459,8 @@ template <> inline std::string request<packed8avx512>()  { return "packed8avx512
 
 template <> inline std::string request<intgemm8>()  { return "intgemm8"; }
 template <> inline std::string request<intgemm16>()  { return "intgemm16"; }
+
+template <> inline std::string request<int4grouped>()  { return "int4grouped"; }
 // clang-format on
 
 static Type inline typeFromString(const std::string& str) {
@@ -483,6 +501,9 @@ static Type inline typeFromString(const std::string& str) {
   if(str == "intgemm16")
     return Type::intgemm16;
 
+  if(str == "int4grouped")
+    return Type::int4grouped;
+
   ABORT("Unknown type {}", str);
 }
 
@@ -510,6 +531,8 @@ template <> inline Type typeId<packed8avx512>() { return Type::packed8avx512; }
 template <> inline Type typeId<intgemm8>()   { return Type::intgemm8; }
 template <> inline Type typeId<intgemm16>()  { return Type::intgemm16; }
 
+template <> inline Type typeId<int4grouped>()  { return Type::int4grouped; }
+
 // Abort if given C++ does not correspond to runtime type
 template <typename T>
 void matchOrAbort(Type type) {
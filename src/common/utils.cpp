@@ -13,6 +13,15 @@
 #endif
 #include <codecvt>
 #include <cwctype>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
 
 // MACOS lacks HOST_NAME_MAX
 #ifndef HOST_NAME_MAX
@@ -430,5 +439,29 @@ double parseNumber(std::string param) {
   return factor * parseDouble(param);
 }
 
+void pinCurrentThread(size_t core) {
+#if defined(__linux__)
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  CPU_SET(core, &cpuSet);
+  int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+  if(rc != 0)
+    LOG(warn, "Could not pin thread to CPU core {} (error {})", core, rc);
+#elif defined(_WIN32)
+  if(SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) == 0)
+    LOG(warn, "Could not pin thread to CPU core {}", core);
+#else
+  LOG(warn, "Pinning threads to CPU cores is not supported on this platform, ignoring core {}", core);
+#endif
+}
+
+std::vector<size_t> workerCores(const std::vector<size_t>& cores, size_t workerIdx, size_t coresPerWorker) {
+  std::vector<size_t> result;
+  if(!cores.empty())
+    for(size_t i = 0; i < coresPerWorker; ++i)
+      result.push_back(cores[(workerIdx * coresPerWorker + i) % cores.size()]);
+  return result;
+}
+
 }  // namespace utils
 }  // namespace marian
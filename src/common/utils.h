@@ -62,5 +62,10 @@ std::string findReplace(const std::string& in, const std::string& what, const st
 double parseDouble(std::string s);
 double parseNumber(std::string s);
 
+// Pins the calling thread to a CPU core, warns if that is not possible
+void pinCurrentThread(size_t core);
+// The cores of worker workerIdx if each worker takes the next coresPerWorker entries of cores, wrapping around
+std::vector<size_t> workerCores(const std::vector<size_t>& cores, size_t workerIdx, size_t coresPerWorker);
+
 }  // namespace utils
 }  // namespace marian
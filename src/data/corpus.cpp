@@ -1,5 +1,6 @@
 #include "data/corpus.h"
 
+#include <iterator>
 #include <numeric>
 #include <random>
 
@@ -15,7 +16,13 @@ Corpus::Corpus(Ptr<Options> options, bool translate /*= false*/)
     : CorpusBase(options, translate),
         shuffleInRAM_(options_->get<bool>("shuffle-in-ram", false)),
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
-        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
+        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {
+  // sub-word encoding in parallel to the reading thread, only when translating since vocabularies
+  // may sample segmentations during training
+  encodingThreads_ = translate ? options_->get<size_t>("data-threads", 1) : 1;
+  if(encodingThreads_ > 1)
+    encodingPool_.reset(new ThreadPool(encodingThreads_));
+}
 
 Corpus::Corpus(std::vector<std::string> paths,
                std::vector<Ptr<Vocab>> vocabs,
@@ -25,15 +32,15 @@ Corpus::Corpus(std::vector<std::string> paths,
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
         titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
 
-void Corpus::preprocessLine(std::string& line, size_t streamId) {
-  if (allCapsEvery_ != 0 && pos_ % allCapsEvery_ == 0 && !inference_) {
+void Corpus::preprocessLine(std::string& line, size_t streamId, size_t pos) const {
+  if (allCapsEvery_ != 0 && pos % allCapsEvery_ == 0 && !inference_) {
     line = vocabs_[streamId]->toUpper(line);
     if (streamId == 0)
       LOG_ONCE(info, "[data] Source all-caps'ed line to: {}", line);
     else
       LOG_ONCE(info, "[data] Target all-caps'ed line to: {}", line);
   }
-  else if (titleCaseEvery_ != 0 && pos_ % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
+  else if (titleCaseEvery_ != 0 && pos % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
     // Only applied to stream 0 (source) since this feature is aimed at robustness against
     // title case in the source (and not at translating into title case).
     // Note: It is user's responsibility to not enable this if the source language is not English.
@@ -45,7 +52,41 @@ void Corpus::preprocessLine(std::string& line, size_t streamId) {
   }
 }
 
-SentenceTuple Corpus::next() {
+bool Corpus::readLines(RawTuple& raw) {
+  // get index of the current sentence
+  raw.id = pos_; // note: at end, pos_  == total size
+  // if corpus has been shuffled, ids_ contains sentence indexes
+  if(pos_ < ids_.size())
+    raw.id = ids_[pos_];
+  pos_++;
+  raw.pos = pos_;
+
+  // fetch lines from all input files
+  size_t eofsHit = 0;
+  size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
+  raw.lines.resize(numStreams);
+  for(size_t i = 0; i < numStreams; ++i) {
+    // fetch line, from cached copy in RAM or actual file
+    if (!corpusInRAM_.empty()) {
+      if (raw.id < corpusInRAM_[i].size())
+        raw.lines[i] = corpusInRAM_[i][raw.id];
+      else
+        eofsHit++;
+    }
+    else {
+      bool gotLine = io::getline(*files_[i], raw.lines[i]).good();
+      if(!gotLine)
+        eofsHit++;
+    }
+  }
+
+  if (eofsHit == numStreams)
+    return false;
+  ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
+  return true;
+}
+
+SentenceTuple Corpus::encodeLines(RawTuple& raw) const {
   // Used for handling TSV inputs
   // Determine the total number of fields including alignments or weights
   auto tsvNumAllFields = tsvNumInputFields_;
@@ -55,87 +96,141 @@ SentenceTuple Corpus::next() {
     ++tsvNumAllFields;
   std::vector<std::string> fields(tsvNumAllFields);
 
-  for(;;) { // (this is a retry loop for skipping invalid sentences)
-    // get index of the current sentence
-    size_t curId = pos_; // note: at end, pos_  == total size
-    // if corpus has been shuffled, ids_ contains sentence indexes
-    if(pos_ < ids_.size())
-      curId = ids_[pos_];
-    pos_++;
-
-    // fill up the sentence tuple with sentences from all input files
-    SentenceTuple tup(curId);
-    size_t eofsHit = 0;
-    size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
-    for(size_t i = 0; i < numStreams; ++i) {
-      std::string line;
-
-      // fetch line, from cached copy in RAM or actual file
-      if (!corpusInRAM_.empty()) {
-        if (curId < corpusInRAM_[i].size())
-          line = corpusInRAM_[i][curId];
-        else {
-          eofsHit++;
-          continue;
-        }
-      }
-      else {
-        bool gotLine = io::getline(*files_[i], line).good();
-        if(!gotLine) {
-          eofsHit++;
-          continue;
-        }
-      }
-
-      if(i > 0 && i == alignFileIdx_) {
-        addAlignmentToSentenceTuple(line, tup);
-      } else if(i > 0 && i == weightFileIdx_) {
-        addWeightsToSentenceTuple(line, tup);
-      } else {
-        if(tsv_) {  // split TSV input and add each field into the sentence tuple
-          utils::splitTsv(line, fields, tsvNumAllFields);
-          size_t shift = 0;
-          for(size_t j = 0; j < tsvNumAllFields; ++j) {
-            // index j needs to be shifted to get the proper vocab index if guided-alignment or
-            // data-weighting are preceding source or target sequences in TSV input
-            if(j == alignFileIdx_ || j == weightFileIdx_) {
-              ++shift;
-            } else {
-              size_t vocabId = j - shift;
-              preprocessLine(fields[j], vocabId);
-              addWordsToSentenceTuple(fields[j], vocabId, tup);
-            }
+  // fill up the sentence tuple with sentences from all input files
+  SentenceTuple tup(raw.id);
+  for(size_t i = 0; i < raw.lines.size(); ++i) {
+    auto& line = raw.lines[i];
+    if(i > 0 && i == alignFileIdx_) {
+      addAlignmentToSentenceTuple(line, tup);
+    } else if(i > 0 && i == weightFileIdx_) {
+      addWeightsToSentenceTuple(line, tup);
+    } else {
+      if(tsv_) {  // split TSV input and add each field into the sentence tuple
+        utils::splitTsv(line, fields, tsvNumAllFields);
+        size_t shift = 0;
+        for(size_t j = 0; j < tsvNumAllFields; ++j) {
+          // index j needs to be shifted to get the proper vocab index if guided-alignment or
+          // data-weighting are preceding source or target sequences in TSV input
+          if(j == alignFileIdx_ || j == weightFileIdx_) {
+            ++shift;
+          } else {
+            size_t vocabId = j - shift;
+            preprocessLine(fields[j], vocabId, raw.pos);
+            addWordsToSentenceTuple(fields[j], vocabId, tup);
           }
+        }
 
-          // weights are added last to the sentence tuple, because this runs a validation that needs
-          // length of the target sequence
-          if(alignFileIdx_ > -1)
-            addAlignmentToSentenceTuple(fields[alignFileIdx_], tup);
-          if(weightFileIdx_ > -1)
-            addWeightsToSentenceTuple(fields[weightFileIdx_], tup);
+        // weights are added last to the sentence tuple, because this runs a validation that needs
+        // length of the target sequence
+        if(alignFileIdx_ > -1)
+          addAlignmentToSentenceTuple(fields[alignFileIdx_], tup);
+        if(weightFileIdx_ > -1)
+          addWeightsToSentenceTuple(fields[weightFileIdx_], tup);
 
-        } else {
-          preprocessLine(line, i);
-          addWordsToSentenceTuple(line, i, tup);
-        }
+      } else {
+        preprocessLine(line, i, raw.pos);
+        addWordsToSentenceTuple(line, i, tup);
       }
     }
+  }
+  return tup;
+}
 
-    if (eofsHit == numStreams)
+// check if all streams are valid, that is, non-empty and no longer than maximum allowed length
+bool Corpus::isValid(const SentenceTuple& tup) const {
+  return std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
+    return words.size() > 0 && words.size() <= maxLength_;
+  });
+}
+
+SentenceTuple Corpus::next() {
+  if(encodingPool_)
+    return nextEncoded();
+
+  RawTuple raw;
+  for(;;) { // (this is a retry loop for skipping invalid sentences)
+    if(!readLines(raw))
       return SentenceTuple(0);
-    ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
 
-    // check if all streams are valid, that is, non-empty and no longer than maximum allowed length
-    if(std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
-         return words.size() > 0 && words.size() <= maxLength_;
-       }))
+    auto tup = encodeLines(raw);
+    if(isValid(tup))
       return tup;
 
     // otherwise skip this sentence and try the next one
-    // @TODO: tail recursion?
   }
 }
 
+// true if reading the next line from stdin would wait for input, e.g. when used interactively behind a pipe
+bool Corpus::inputWouldBlock() const {
+  if(!corpusInRAM_.empty())
+    return false;
+  for(size_t i = 0; i < files_.size(); ++i)
+    if((paths_[i] == "stdin" || paths_[i] == "-") && files_[i]->rdbuf()->in_avail() <= 0)
+      return true;
+  return false;
+}
+
+// Pipelined variant of next(): lines are read here in chunks, each chunk is encoded by one of the
+// encoding threads. At most a fixed number of chunks is in flight, which bounds memory when the
+// consumer is slower than the reader. Tuples are handed out in reading order. Reading ahead stops
+// where stdin would wait for more input, so that the lines read so far are translated right away.
+SentenceTuple Corpus::nextEncoded() {
+  const size_t chunkSize = 64;
+  const size_t maxChunksInFlight = 4 * encodingThreads_;
+
+  for(;;) {
+    while(!readerDone_ && encodingChunks_.size() < maxChunksInFlight) {
+      bool pending = !encoded_.empty() || !encodingChunks_.empty();
+      if(pending && inputWouldBlock())
+        break;
+
+      auto chunk = New<std::vector<RawTuple>>();
+      RawTuple raw;
+      while(chunk->size() < chunkSize && !(chunk->size() > 0 && inputWouldBlock())) {
+        if(!readLines(raw)) {
+          readerDone_ = true;
+          break;
+        }
+        chunk->push_back(std::move(raw));
+      }
+      if(chunk->empty())
+        break;
+
+      auto encode = [this, chunk]() {
+        std::vector<SentenceTuple> tuples;
+        for(auto& r : *chunk) {
+          auto tup = encodeLines(r);
+          if(isValid(tup)) // invalid sentences are skipped
+            tuples.push_back(std::move(tup));
+        }
+        return tuples;
+      };
+      encodingChunks_.push_back(encodingPool_->enqueue(encode));
+    }
+
+    if(!encoded_.empty()) {
+      auto tup = std::move(encoded_.front());
+      encoded_.pop_front();
+      return tup;
+    }
+    if(encodingChunks_.empty())
+      return SentenceTuple(0);
+
+    auto tuples = encodingChunks_.front().get();
+    encodingChunks_.pop_front();
+    encoded_.assign(std::make_move_iterator(tuples.begin()), std::make_move_iterator(tuples.end()));
+  }
+}
+
+// waits for chunks that are still being encoded and drops everything that was read ahead
+void Corpus::resetEncoding() {
+  for(auto& chunk : encodingChunks_)
+    chunk.wait();
+  encodingChunks_.clear();
+  encoded_.clear();
+  readerDone_ = false;
+}
+
 // reset and initialize shuffled reading
 // Call either reset() or shuffle().
 // @TODO: merge with reset() below to clarify mutual exclusiveness with reset()
@@ -148,6 +243,7 @@ void Corpus::shuffle() {
 // @TODO: make shuffle() private, instad pass a shuffle() flag to reset(), to clarify mutual
 // exclusiveness with shuffle()
 void Corpus::reset() {
+  resetEncoding();
   corpusInRAM_.clear();
   ids_.clear();
   if (pos_ == 0) // no data read yet
@@ -176,6 +272,7 @@ void Corpus::restore(Ptr<TrainingState> ts) {
 
 void Corpus::shuffleData(const std::vector<std::string>& paths) {
   LOG(info, "[data] Shuffling data");
+  resetEncoding();
 
   ABORT_IF(tsv_ && (paths[0] == "stdin" || paths[0] == "-"),
            "Shuffling training data from STDIN is not supported. Add --no-shuffle or provide "
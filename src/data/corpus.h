@@ -12,6 +12,10 @@
 #include "data/corpus_base.h"
 #include "data/dataset.h"
 #include "data/vocab.h"
+#include "3rd_party/threadpool.h"
+
+#include <deque>
+#include <future>
 
 namespace marian {
 namespace data {
@@ -30,7 +34,29 @@ private:
   // for pre-processing
   size_t allCapsEvery_{0};   // if set, convert every N-th input sentence (after randomization) to all-caps (source and target)
   size_t titleCaseEvery_{0}; // ditto for title case (source only)
-  void preprocessLine(std::string& line, size_t streamId);
+  void preprocessLine(std::string& line, size_t streamId, size_t pos) const;
+
+  // lines of all streams for one sentence tuple, before sub-word encoding
+  struct RawTuple {
+    size_t id{0};             // sentence id
+    size_t pos{0};            // reading position, for pre-processing
+    std::vector<std::string> lines; // [stream]
+  };
+
+  bool readLines(RawTuple& raw); // false at the end of the data
+  SentenceTuple encodeLines(RawTuple& raw) const; // thread-safe
+  bool isValid(const SentenceTuple& tup) const;
+
+  // for encoding with --data-threads
+  size_t encodingThreads_{1};
+  UPtr<ThreadPool> encodingPool_;
+  std::deque<std::future<std::vector<SentenceTuple>>> encodingChunks_; // in reading order
+  std::deque<SentenceTuple> encoded_; // rest of the chunk that is currently handed out
+  bool readerDone_{false};
+
+  bool inputWouldBlock() const;
+  SentenceTuple nextEncoded();
+  void resetEncoding();
 
 public:
   // @TODO: check if translate can be replaced by an option in options
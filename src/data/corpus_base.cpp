@@ -340,9 +340,13 @@ CorpusBase::CorpusBase(Ptr<Options> options, bool translate)
     options_->set("dim-vocabs", vocabDims);
   }
 
+  // when translating, the input is read sequentially exactly once, so plain files are memory-mapped
+  // and stdin is read in large chunks
   for(auto path : paths_) {
     if(path == "stdin" || path == "-")
-      files_.emplace_back(new std::istream(std::cin.rdbuf()));
+      files_.emplace_back(translate ? new io::InputStdinStream() : new std::istream(std::cin.rdbuf()));
+    else if(translate && io::MappedInputFileStream::canMap(path))
+      files_.emplace_back(new io::MappedInputFileStream(path));
     else {
       io::InputFileStream *strm = new io::InputFileStream(path);
       ABORT_IF(strm->empty(), "File '{}' is empty", path);
@@ -1,4 +1,6 @@
 #include "shortlist.h"
+
+#include <numeric>
 #include <queue>
 
 namespace marian {
@@ -11,6 +13,101 @@ bool isBinaryShortlist(const std::string& fileName){
   return in && (magic == BINARY_SHORTLIST_MAGIC);
 }
 
+namespace {
+
+// Adds the most frequent target words from firstNum on that are not selected yet to the sorted indices
+// until there are size of them.
+void padIndices(std::vector<WordIndex>& indices, size_t size, size_t firstNum, size_t trgVocabSize) {
+  std::vector<WordIndex> extra;
+  for(size_t i = firstNum; i < trgVocabSize && indices.size() + extra.size() < size; ++i)
+    if(!std::binary_search(indices.begin(), indices.end(), (WordIndex)i))
+      extra.push_back((WordIndex)i);
+
+  std::vector<WordIndex> padded(indices.size() + extra.size());
+  std::merge(indices.begin(), indices.end(), extra.begin(), extra.end(), padded.begin());
+  indices.swap(padded);
+}
+
+}  // namespace
+
+Shortlist::Shortlist(std::vector<std::vector<WordIndex>>&& groupIndices, size_t groupSize, size_t batchSize)
+    : groupIndices_(std::move(groupIndices)), groupSize_(groupSize), activeBatchIdx_(batchSize) {
+  ABORT_IF(groupSize_ == 0, "Shortlist group size must be positive");
+  ABORT_IF(groupIndices_.size() != (batchSize + groupSize_ - 1) / groupSize_,
+           "Expected one shortlist per group of {} sentences, got {} for {} sentences",
+           groupSize_, groupIndices_.size(), batchSize);
+  for(const auto& indices : groupIndices_)
+    ABORT_IF(indices.size() != groupIndices_.front().size(), "Grouped shortlists must have the same length");
+  std::iota(activeBatchIdx_.begin(), activeBatchIdx_.end(), 0);
+}
+
+int Shortlist::tryForwardMap(WordIndex wIdx) const {
+  if(!isGrouped()) {
+    auto first = std::lower_bound(indices_.begin(), indices_.end(), wIdx);
+    if(first != indices_.end() && *first == wIdx)         // check if element not less than wIdx has been found and if equal to wIdx
+      return (int)std::distance(indices_.begin(), first); // return coordinate if found
+    else
+      return -1;                                          // return -1 if not found
+  }
+
+  int idx = -1;
+  for(const auto& indices : groupIndices_) {
+    auto first = std::lower_bound(indices.begin(), indices.end(), wIdx);
+    if(first == indices.end() || *first != wIdx)
+      return -1;
+    int groupIdx = (int)std::distance(indices.begin(), first);
+    if(idx != -1 && groupIdx != idx)
+      return -1;
+    idx = groupIdx;
+  }
+  return idx;
+}
+
+std::vector<std::pair<size_t, size_t>> Shortlist::activeGroupRanges() const {
+  std::vector<std::pair<size_t, size_t>> ranges(groupIndices_.size(), std::make_pair(0, 0));
+  // active sentences are sorted by original batch index, so the ones of a group are consecutive
+  size_t begin = 0;
+  for(size_t g = 0; g < ranges.size(); ++g) {
+    size_t end = begin;
+    while(end < activeBatchIdx_.size() && activeBatchIdx_[end] / groupSize_ == g)
+      end++;
+    ranges[g] = std::make_pair(begin, end);
+    begin = end;
+  }
+  ABORT_IF(begin != activeBatchIdx_.size(), "Active batch indices are not sorted or out of range");
+  return ranges;
+}
+
+Ptr<Shortlist> ShortlistGenerator::createShortlist(Ptr<SubBatch> srcBatch,
+                                                   size_t groupSize,
+                                                   size_t firstNum,
+                                                   size_t trgVocabSize,
+                                                   const SelectFn& select) {
+  size_t batchSize = srcBatch->batchSize();
+  if(groupSize == 0 || groupSize >= batchSize)
+    return New<Shortlist>(select(srcBatch->data()));
+
+  std::vector<std::vector<WordIndex>> groupIndices;
+  size_t size = 0;
+  for(size_t begin = 0; begin < batchSize; begin += groupSize) {
+    Words srcWords;
+    for(size_t b = begin; b < std::min(begin + groupSize, batchSize); ++b) {
+      for(size_t s = 0; s < srcBatch->batchWidth(); ++s) {
+        size_t pos = srcBatch->locate(b, s);
+        if(srcBatch->mask()[pos] != 0)
+          srcWords.push_back(srcBatch->data()[pos]);
+      }
+    }
+    groupIndices.push_back(select(srcWords));
+    size = std::max(size, groupIndices.back().size());
+  }
+
+  // all groups are multiplied with the same number of columns, so that their logits can be concatenated
+  for(auto& indices : groupIndices)
+    padIndices(indices, size, firstNum, trgVocabSize);
+  return New<Shortlist>(std::move(groupIndices), groupSize, batchSize);
+}
+
 void LexicalShortlistGenerator::load(const std::string& fname) {
   io::InputFileStream in(fname);
 
@@ -70,6 +167,7 @@ LexicalShortlistGenerator::LexicalShortlistGenerator(Ptr<Options> options,
   bestNum_ = vals.size() > 2 ? std::stoi(vals[2]) : 100;
   float threshold = vals.size() > 3 ? std::stof(vals[3]) : 0;
   std::string dumpPath = vals.size() > 4 ? vals[4] : "";
+  groupSize_ = options_->get<size_t>("shortlist-group-size", 0);
   LOG(info,
       "[data] Loading lexical shortlist as {} {} {} {}",
       fname,
@@ -102,9 +200,7 @@ void LexicalShortlistGenerator::dump(const std::string& prefix) const {
   }
 }
 
-Ptr<Shortlist> LexicalShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
-  auto srcBatch = (*batch)[srcIdx_];
-
+std::vector<WordIndex> LexicalShortlistGenerator::select(const Words& srcWords) const {
   // add firstNum most frequent words
   std::unordered_set<WordIndex> indexSet;
   for(WordIndex i = 0; i < firstNum_ && i < trgVocab_->size(); ++i)
@@ -116,7 +212,7 @@ Ptr<Shortlist> LexicalShortlistGenerator::generate(Ptr<data::CorpusBatch> batch)
 
   // collect unique words form source
   std::unordered_set<WordIndex> srcSet;
-  for(auto i : srcBatch->data())
+  for(auto i : srcWords)
     srcSet.insert(i.toWordIndex());
 
   // add aligned target words
@@ -126,20 +222,16 @@ Ptr<Shortlist> LexicalShortlistGenerator::generate(Ptr<data::CorpusBatch> batch)
     for(auto& it : data_[i])
       indexSet.insert(it.first);
   }
-  // Ensure that the generated vocabulary items from a shortlist are a multiple-of-eight
-  // This is necessary until intgemm supports non-multiple-of-eight matrices.
-  // TODO better solution here? This could potentially be slow.
-  WordIndex i = static_cast<WordIndex>(firstNum_);
-  while (indexSet.size() % 8 != 0) {
-    indexSet.insert(i);
-    i++;
-  }
 
   // turn into vector and sort (selected indices)
   std::vector<WordIndex> indices(indexSet.begin(), indexSet.end());
   std::sort(indices.begin(), indices.end());
+  return indices;
+}
 
-  return New<Shortlist>(indices);
+Ptr<Shortlist> LexicalShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
+  return createShortlist((*batch)[srcIdx_], groupSize_, firstNum_, trgVocab_->size(),
+                         [this](const Words& srcWords) { return select(srcWords); });
 }
 
 void BinaryShortlistGenerator::contentCheck() {
@@ -221,6 +313,7 @@ BinaryShortlistGenerator::BinaryShortlistGenerator(Ptr<Options> options,
   std::vector<std::string> vals = options_->get<std::vector<std::string>>("shortlist");
   ABORT_IF(vals.empty(), "No path to shortlist file given");
   std::string fname = vals[0];
+  groupSize_ = options_->get<size_t>("shortlist-group-size", 0);
 
   if(isBinaryShortlist(fname)){
     bool check = vals.size() > 1 ? std::stoi(vals[1]) : 1;
@@ -254,8 +347,7 @@ BinaryShortlistGenerator::BinaryShortlistGenerator(const void *ptr_void,
   load(ptr_void, blobSize, check);
 }
 
-Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
-  auto srcBatch = (*batch)[srcIdx_];
+std::vector<WordIndex> BinaryShortlistGenerator::select(const Words& srcWords) const {
   size_t srcVocabSize = srcVocab_->size();
   size_t trgVocabSize = trgVocab_->size();
 
@@ -270,7 +362,7 @@ Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch)
 
   // collect unique words from source
   // add aligned target words: mark trgTruthTable[word] to 1
-  for(auto word : srcBatch->data()) {
+  for(auto word : srcWords) {
     WordIndex srcIndex = word.toWordIndex();
     if(shared_)
       trgTruthTable[srcIndex] = 1;
@@ -282,30 +374,18 @@ Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch)
     }
   }
 
-  // Due to the 'multiple-of-eight' issue, the following O(N) patch is inserted
-  size_t trgTruthTableOnes = 0;   // counter for no. of selected target words
-  for (size_t i = 0; i < trgVocabSize; i++) {
-    if(trgTruthTable[i])
-      trgTruthTableOnes++;
-  }
-
-  // Ensure that the generated vocabulary items from a shortlist are a multiple-of-eight
-  // This is necessary until intgemm supports non-multiple-of-eight matrices.
-  for (size_t i = firstNum_; i < trgVocabSize && trgTruthTableOnes%8!=0; i++){
-    if (!trgTruthTable[i]){
-      trgTruthTable[i] = 1;
-      trgTruthTableOnes++;
-    }
-  }
-
   // turn selected indices into vector and sort (Bucket sort: O(V))
   std::vector<WordIndex> indices;
   for (WordIndex i = 0; i < trgVocabSize; i++) {
     if(trgTruthTable[i])
       indices.push_back(i);
   }
+  return indices;
+}
 
-  return New<Shortlist>(indices);
+Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
+  return createShortlist((*batch)[srcIdx_], groupSize_, firstNum_, trgVocab_->size(),
+                         [this](const Words& srcWords) { return select(srcWords); });
 }
 
 void BinaryShortlistGenerator::dump(const std::string& fileName) const {
@@ -7,6 +7,7 @@
 #include "data/types.h"
 #include "3rd_party/mio/mio.hpp"
 
+#include <functional>
 #include <random>
 #include <unordered_map>
 #include <unordered_set>
@@ -26,20 +27,42 @@ class Shortlist {
 private:
   std::vector<WordIndex> indices_;    // // [packed shortlist index] -> word index, used to select columns from output embeddings
 
+  // Grouped shortlist: one list per group of groupSize_ consecutive sentences of the batch, all of the same length
+  std::vector<std::vector<WordIndex>> groupIndices_; // [group][packed shortlist index] -> word index
+  size_t groupSize_{0};
+  std::vector<size_t> activeBatchIdx_; // [current batch index] -> original batch index of the sentences still decoded
+
 public:
   Shortlist(const std::vector<WordIndex>& indices)
     : indices_(indices) {}
 
-  const std::vector<WordIndex>& indices() const { return indices_; }
-  WordIndex reverseMap(int idx) { return indices_[idx]; }
+  Shortlist(std::vector<std::vector<WordIndex>>&& groupIndices, size_t groupSize, size_t batchSize);
+
+  bool isGrouped() const { return !groupIndices_.empty(); }
 
-  int tryForwardMap(WordIndex wIdx) {
-    auto first = std::lower_bound(indices_.begin(), indices_.end(), wIdx);
-    if(first != indices_.end() && *first == wIdx)         // check if element not less than wIdx has been found and if equal to wIdx
-      return (int)std::distance(indices_.begin(), first); // return coordinate if found
-    else
-      return -1;                                          // return -1 if not found
+  const std::vector<WordIndex>& indices() const {
+    ABORT_IF(isGrouped(), "A grouped shortlist has no common indices");
+    return indices_;
   }
+  WordIndex reverseMap(int idx) { return indices()[idx]; }
+
+  // map index into the shortlist of the sentence at original batch index batchIdx to word index
+  WordIndex reverseMap(size_t batchIdx, int idx) {
+    return isGrouped() ? groupIndices_[batchIdx / groupSize_][idx] : indices_[idx];
+  }
+
+  // Returns -1 if the word is not part of the shortlist. For a grouped shortlist the word needs to be at the
+  // same position in every group, which holds for the firstNum most frequent words.
+  int tryForwardMap(WordIndex wIdx) const;
+
+  const std::vector<std::vector<WordIndex>>& groupIndices() const { return groupIndices_; }
+
+  // Called by the search before each step with the original batch indices of the sentences that are still
+  // decoded, in ascending order. Determines which rows of the output belong to which group.
+  void setActiveBatchIndices(const std::vector<size_t>& batchIndices) { activeBatchIdx_ = batchIndices; }
+
+  // [group] -> range [begin, end) of current batch indices that use the group's shortlist, may be empty
+  std::vector<std::pair<size_t, size_t>> activeGroupRanges() const;
 };
 
 class ShortlistGenerator {
@@ -53,6 +76,19 @@ public:
   virtual void dump(const std::string& /*prefix*/) const {
     ABORT("Not implemented");
   }
+
+protected:
+  // returns the sorted target words selected for the given source words
+  typedef std::function<std::vector<WordIndex>(const Words& /*srcWords*/)> SelectFn;
+
+  // Creates a shortlist for the whole batch or, if groupSize > 0, one for each group of groupSize consecutive
+  // sentences (see --shortlist-group-size). Grouped lists are padded to the same length with the most frequent
+  // target words not selected yet.
+  static Ptr<Shortlist> createShortlist(Ptr<SubBatch> srcBatch,
+                                        size_t groupSize,
+                                        size_t firstNum,
+                                        size_t trgVocabSize,
+                                        const SelectFn& select);
 };
 
 
@@ -143,11 +179,13 @@ private:
 
   size_t firstNum_{100};
   size_t bestNum_{100};
+  size_t groupSize_{0};
 
   std::vector<std::unordered_map<WordIndex, float>> data_; // [WordIndex src] -> [WordIndex tgt] -> P_trans(tgt|src) --@TODO: rename data_ accordingly
 
   void load(const std::string& fname);
   void prune(float threshold = 0.f);
+  std::vector<WordIndex> select(const Words& srcWords) const;
 
 public:
   LexicalShortlistGenerator(Ptr<Options> options,
@@ -172,6 +210,7 @@ private:
 
   uint64_t firstNum_{100};  // baked into binary header
   uint64_t bestNum_{100};   // baked into binary header
+  size_t groupSize_{0};
 
   // shortlist is stored in a skip list
   // [&shortLists_[wordToOffset_[word]], &shortLists_[wordToOffset_[word+1]])
@@ -201,6 +240,7 @@ private:
   void import(const std::string& filename, double threshold);
   // save blob to file (called by dump)
   void saveBlobToFile(const std::string& filename) const;
+  std::vector<WordIndex> select(const Words& srcWords) const;
 
 public:
   BinaryShortlistGenerator(Ptr<Options> options,
@@ -53,6 +53,11 @@ public:
   // TODO: There are half dozen functions called toBatch(), which are very
   // similar. Factor them.
   batch_ptr toBatch(const std::vector<Sample>& batchVector) override {
+    return toBatch(batchVector, vocabs_);
+  }
+
+  // also used by the server to batch sentences that were encoded by different TextInput objects
+  static batch_ptr toBatch(const std::vector<Sample>& batchVector, const std::vector<Ptr<Vocab>>& vocabs) {
     size_t batchSize = batchVector.size();
 
     std::vector<size_t> sentenceIds;
@@ -70,7 +75,7 @@ public:
 
     std::vector<Ptr<SubBatch>> subBatches;
     for(size_t j = 0; j < maxDims.size(); ++j) {
-      subBatches.emplace_back(New<SubBatch>(batchSize, maxDims[j], vocabs_[j]));
+      subBatches.emplace_back(New<SubBatch>(batchSize, maxDims[j], vocabs[j]));
     }
 
     std::vector<size_t> words(maxDims.size(), 0);
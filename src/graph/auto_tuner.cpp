@@ -0,0 +1,48 @@
+#include "graph/auto_tuner.h"
+#include "common/logging.h"
+
+#include <fstream>
+#include <map>
+
+namespace marian {
+
+AutoTunerCache::AutoTunerCache(const std::string& path) : path_(path) {
+  std::ifstream in(path_);
+  size_t hash, best;
+  while(in >> hash >> best) // later lines override earlier ones
+    best_[hash] = best;
+  LOG(info, "[autotuner] Loaded {} decisions from {}", best_.size(), path_);
+}
+
+Ptr<AutoTunerCache> AutoTunerCache::open(const std::string& path) {
+  static std::mutex mutex;
+  static std::map<std::string, Ptr<AutoTunerCache>> caches;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& cache = caches[path];
+  if(!cache)
+    cache = New<AutoTunerCache>(path);
+  return cache;
+}
+
+bool AutoTunerCache::find(size_t hash, size_t& best) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = best_.find(hash);
+  if(it == best_.end())
+    return false;
+  best = it->second;
+  return true;
+}
+
+void AutoTunerCache::insert(const std::vector<size_t>& hashes, size_t best) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ofstream out(path_, std::ios::app);
+  for(auto hash : hashes) {
+    best_[hash] = best;
+    out << hash << " " << best << "\n";
+  }
+  if(!out)
+    LOG(warn, "[autotuner] Could not write decisions to {}", path_);
+}
+
+}  // namespace marian
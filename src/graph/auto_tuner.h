@@ -1,14 +1,39 @@
 #pragma once
 
+#include "common/definitions.h"
 #include "common/timer.h"
 
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace marian {
 
+// Decisions of autotuners kept in a file, so that later runs on the same machine skip collecting
+// statistics. Maps the hash of each algorithm variant to the hash of the fastest variant for the same
+// operation. Thread-safe, all tuners of a process using the same file share one cache.
+class AutoTunerCache {
+public:
+  AutoTunerCache(const std::string& path); // loads the decisions stored in path, if any
+
+  static Ptr<AutoTunerCache> open(const std::string& path);
+
+  // sets best to the hash of the fastest variant if a decision for the variant with this hash is known
+  bool find(size_t hash, size_t& best);
+
+  // records the fastest of the variants with the given hashes and appends it to the file
+  void insert(const std::vector<size_t>& hashes, size_t best);
+
+private:
+  std::string path_;
+  std::unordered_map<size_t, size_t> best_;
+  std::mutex mutex_;
+};
+
 class AutoTunerRecorder {
 public:
   virtual void start(size_t hash) = 0;
@@ -49,7 +74,22 @@ private:
 
   std::vector<HashedAlgorithm> algorithms_;
 
+  Ptr<AutoTunerCache> cache_;
+
   size_t choose() {
+    if(cache_ && done_.count(algorithms_[0].hash) == 0) {
+      size_t bestHash;
+      if(cache_->find(algorithms_[0].hash, bestHash)) {
+        for(size_t i = 0; i < algorithms_.size(); ++i) {
+          if(algorithms_[i].hash == bestHash) {
+            for(auto& a : algorithms_)
+              done_[a.hash] = i;
+            return i;
+          }
+        }
+      } // decided for a different set of algorithms, collect statistics again
+    }
+
     size_t best = 0;
     double bestTime = std::numeric_limits<double>::max();
 
@@ -79,16 +119,39 @@ private:
     for(auto& a : algorithms_)
       done_[a.hash] = best;
 
+    if(cache_) {
+      std::vector<size_t> hashes;
+      for(auto& a : algorithms_)
+        hashes.push_back(a.hash);
+      cache_->insert(hashes, algorithms_[best].hash);
+    }
+
     return best;
   }
 
 public:
   void insert(const HashedAlgorithm& ha) { algorithms_.push_back(ha); }
 
+  // persist decisions in and reuse decisions from the cache, nullptr for none
+  void setCache(Ptr<AutoTunerCache> cache) { cache_ = cache; }
+
   void clear() { algorithms_.clear(); }
 
+  bool empty() const { return algorithms_.empty(); }
+
   Return run(Args... args) { return algorithms_[choose()].algorithm(args...); }
 
+  // true if the fastest of the current algorithms is known, which is then returned in bestHash
+  bool decided(size_t& bestHash) const {
+    if(algorithms_.empty())
+      return false;
+    auto it = done_.find(algorithms_[0].hash);
+    if(it == done_.end())
+      return false;
+    bestHash = algorithms_[it->second].hash;
+    return true;
+  }
+
   void start(size_t hash) override {
     if(!timer_ && done_.count(hash) == 0)
       timer_.reset(new timer::CPUTimer());
@@ -140,7 +140,9 @@ void ExpressionGraph::forward(std::list<Expr>& forwardTape, bool finalPass) {
       }
     }
 
-    if(inferenceOnly_)
+    if(recording_ && !v->memoize())
+      recorded_.push_back(v);
+    else if(inferenceOnly_)
       v->children().clear();
 
     if(checkpointing_ && !finalPass) {
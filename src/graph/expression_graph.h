@@ -11,6 +11,7 @@
 #include "graph/node_operators.h"
 #include "graph/parameters.h"
 
+#include <algorithm>
 #include <map>
 #include <unordered_set>
 
@@ -123,6 +124,22 @@ public:
   void clearShorttermMemory() { shortterm_->clear(); }
 
   void clearLongtermMemory() { longterm_->clear(); }
+
+  // Removes a memoized node from the long-term memory and releases its value, for nodes that will not
+  // be used again, e.g. weight preparations of GEMM kernels the autotuner decided against.
+  void forget(Expr node) {
+    auto it = longterm_->find(node->hash());
+    if(it != longterm_->end()) {
+      auto& nodes = it->second;
+      nodes.erase(std::remove(nodes.begin(), nodes.end(), node), nodes.end());
+      if(nodes.empty())
+        longterm_->erase(it);
+    }
+    if(node->val()) {
+      cache_->free(node->val());
+      node->val() = nullptr;
+    }
+  }
 };
 
 typedef std::map<Type, Ptr<Parameters>> ElementTypeParamsMap; // keep it sorted, hence map not unordered map
@@ -153,6 +170,9 @@ private:
 
   bool throwNaN_{false};
 
+  bool recording_{false};
+  std::list<Expr> recorded_; // nodes computed while recording, see startRecording()
+
 protected:
   // Delete, copy and move constructors
   ExpressionGraph(const ExpressionGraph&) = delete;
@@ -249,6 +269,31 @@ public:
   void forwardNext();
   void forward(std::list<Expr>& forwardTape, bool finalPass);
 
+  // Records the nodes computed by the following forward passes, so that the same computation can be
+  // replayed after new values have been written into its constants with rewrite(). During inference,
+  // recorded nodes keep their children and memory until the next recording or clear(). Memoized nodes
+  // keep their values anyway and are not recorded.
+  void startRecording() {
+    recorded_.clear();
+    recording_ = true;
+  }
+  void stopRecording() { recording_ = false; }
+  bool isRecording() { return recording_; }
+  void clearRecording() { recorded_.clear(); }
+
+  // Writes new values into a constant that was computed while recording
+  void rewrite(Expr constant, Ptr<inits::NodeInitializer> init) {
+    ABORT_IF(!constant->val(), "Constant {} to rewrite has not been computed", constant->getId());
+    init->setAllocator(allocator());
+    init->apply(constant->val());
+  }
+
+  // Computes the recorded nodes again, without building or allocating anything
+  void replay() {
+    for(auto& v : recorded_)
+      v->forward();
+  }
+
   void backward(bool reset = true, float clipValue = 0.f);
 
   std::string graphviz() {
@@ -480,6 +525,12 @@ public:
       tensors_->free(tensor);
   }
 
+  // Drops a memoized node that will not be used again, see Tensors::forget()
+  void forgetMemoized(Expr node) {
+    if(tensors_)
+      tensors_->forget(node);
+  }
+
   // Returns the memory allocator of the graph workspace, allocates row unstructured memory (but 256-byte aligned)
   Ptr<Allocator> allocator() { return tensors_->getAllocator(); } // @TODO: rename this to getAllocator();
 
@@ -489,6 +540,8 @@ public:
   void clear() {
     // clear everything apart from parameters and memoized nodes
     count_ = 0;
+    recording_ = false;
+    recorded_.clear(); // before their memory goes away
     nodesForward_.clear();
     nodesBackward_.clear();
 
@@ -534,6 +587,13 @@ public:
     load(items, markReloaded);
   }
 
+  // turns a memory-mapped item into one owning a copy of its data
+  static void unmapItem(io::Item& item) {
+    item.bytes.assign(item.ptr, item.ptr + item.size());
+    item.ptr = nullptr;
+    item.mapped = false;
+  }
+
   void mmap(const void* ptr, bool markReloaded = true) {
     ABORT_IF(backend_->getDeviceId().type != DeviceType::cpu || !inferenceOnly_,
              "Memory mapping only supported for CPU inference mode");
@@ -541,36 +601,49 @@ public:
     LOG(info, "Memory mapping model at {}", ptr);
     auto items = io::mmapItems(ptr);
 
-    // Deal with default parameter set object that might not be a mapped object.
-    // This gets assigned during ExpressionGraph::setDevice(...) and by default
-    // would contain allocated tensors. Here we replace it with a mmapped version.
-    /* This codepath makes MMAP loading work. However, We  are hijacking this codepath to load binary models
-     * Without mmap'ing them. AS a result we break the hidden mmap support.
-     *auto it = paramsByElementType_.find(defaultElementType_);
-     *if(it != paramsByElementType_.end()) {
-     * // there is parameter object for that type
-     * auto defaultParams = std::dynamic_pointer_cast<MappedParameters>(it->second);
-     * if(!defaultParams) {
-     *   // but it's not mapped, so delete it and replace it with a mapped version
-     *   defaultParams = New<MappedParameters>(defaultElementType_);
-     *   defaultParams->init(backend_);
-     *   paramsByElementType_[defaultElementType_] = defaultParams;
-     * }
-     * }
-     *
-     *
-     * // pre-populate parameters by type
-     *for(auto& item : items) {
-     * auto it1 = paramsByElementType_.find(item.type);
-     * if(it1 == paramsByElementType_.end()) {
-     *   auto params = New<MappedParameters>(item.type);
-     *   params->init(backend_);
-     *   paramsByElementType_.insert({item.type, params});
-     * }
-     *}
-     */
+    // Items that had to be prepared during loading (e.g. intgemm matrices) own their memory. Types with mapped
+    // items get a MappedParameters object, which gives the copied items of the type their own memory. Types that
+    // already have regular parameters, e.g. loaded by another model of an ensemble, keep them and their items
+    // are copied.
+    std::map<Type, Ptr<MappedParameters>> mappedParams;
+    for(auto& item : items) {
+      if(item.name.substr(0, 8) == "special:" || !item.mapped)
+        continue;
+      // mapped items are used as they are, conversion to the default element type requires a copy
+      if(isSameTypeClass(item.type, defaultElementType_) && item.type != defaultElementType_) {
+        unmapItem(item);
+        continue;
+      }
+      if(mappedParams.count(item.type))
+        continue;
+      auto it = paramsByElementType_.find(item.type);
+      if(it == paramsByElementType_.end() || it->second->size() == 0) {
+        // The default parameter object gets created during ExpressionGraph::setDevice(...) and would
+        // contain allocated tensors, replace it with a mapped version while it is still empty.
+        auto params = New<MappedParameters>(item.type);
+        params->init(backend_);
+        paramsByElementType_[item.type] = params;
+        mappedParams[item.type] = params;
+      } else {
+        mappedParams[item.type] = std::dynamic_pointer_cast<MappedParameters>(it->second); // nullptr if regular
+      }
+    }
+
+    size_t mappedBytes = 0, copiedBytes = 0;
+    for(auto& item : items) {
+      if(item.name.substr(0, 8) == "special:")
+        continue;
+      if(item.mapped && !mappedParams[item.type])
+        unmapItem(item);
+      (item.mapped ? mappedBytes : copiedBytes) += item.size();
+    }
+    LOG(info, "Memory-mapped {} bytes of parameters, copied {} bytes", mappedBytes, copiedBytes);
 
     load(items, markReloaded);
+
+    for(const auto& item : items)
+      if(item.mapped && item.name.substr(0, 8) != "special:")
+        mappedParams[item.type]->setMapped(get(item.name, item.type));
   }
 
 public:
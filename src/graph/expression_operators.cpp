@@ -7,11 +7,13 @@
 #include "graph/node_operators_tuple.h"
 
 #include "graph/auto_tuner.h"
+#include "tensors/cpu/backend.h"
 #ifdef ARM
 #include "tensors/cpu/ruy_interface.h"
 #else
 #include "tensors/cpu/intgemm_interface.h"
 #endif
+#include "tensors/cpu/int4_interface.h"
 #include "tensors/cpu/fbgemm/expanded_gemm.h"
 
 #if USE_FBGEMM
@@ -506,6 +508,8 @@ Expr dot(Expr a, Expr b, bool transA, bool transB, float scale) {
         return Expression<DotNodeOp>(
           clip(a, clipValue), clip(b, clipValue), transA, transB, scale);
       }
+    } else if(isFloat(aElementType) && isGroupQuantized(bElementType)) {
+      return cpu::int4::affine(a, b, nullptr, transA, transB, scale);
     } else if(isFloat(aElementType) && isPacked(bElementType)) {
 #if USE_FBGEMM
       // 07/10/2019 - Use packed GEMM only if the cpu architecture supports AVX2
@@ -556,11 +560,154 @@ static Expr affineDefault(Expr a, Expr b, Expr bias, bool transA, bool transB, f
   return Expression<AffineNodeOp>(nodes, transA, transB, scale);
 }
 
-// This operation used to implement auto-tuning. We have removed it for now due to complexity, but plan to revisit it in the future. 
-// The last branch with auto-tuner is: 
-// youki/packed-model-pr-backup1031
-// https://machinetranslation.visualstudio.com/Marian/_git/marian-dev?version=GByouki%2Fpacked-model-pr-backup1031
-// SHA: 3456a7ed1d1608cfad74cd2c414e7e8fe141aa52
+// Attaches the tuner to all nodes computed on top of the inputs of an algorithm, so that the measured
+// time also covers e.g. quantizing the activations and not only the final GEMM. Memoized nodes that are
+// computed from the inputs, such as prepared weights, are added to memoized.
+static Expr recordAlgorithm(Expr result,
+                            const std::vector<Expr>& inputs,
+                            Ptr<AutoTunerRecorder> tuner,
+                            size_t hash,
+                            std::vector<Expr>& memoized) {
+  std::unordered_set<Chainable<Tensor>*> visited;
+  for(auto& input : inputs)
+    if(input)
+      visited.insert(input.get());
+
+  std::vector<Expr> stack = {result};
+  while(!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    if(!visited.insert(node.get()).second || node->type() == "param")
+      continue;
+    node->record(tuner, hash, /*stop=*/node == result);
+    if(node->memoize() && !node->children().empty()
+       && std::find(memoized.begin(), memoized.end(), node) == memoized.end())
+      memoized.push_back(node);
+    for(auto& child : node->children())
+      stack.push_back(child);
+  }
+  return result;
+}
+
+// --gemm-precision auto: runs each kernel of --gemm-autotune-kernels a number of times per matrix size
+// and CPU, then keeps using the fastest one. The kernel is chosen when the graph is built and timed when
+// it is run, graphs are built and run by the same thread, hence one tuner per thread.
+//
+// While exploring, each kernel memoizes its own preparation of the weights (quantized or packed). Once
+// the tuner has decided, the preparations of the other kernels are retired and dropped from the
+// graph's long-term memory as soon as no node of a graph uses them any more.
+static Expr affineAutoTuned(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  auto backend = std::static_pointer_cast<cpu::Backend>(a->graph()->getBackend());
+  float clipValue = backend->getClip();
+
+  thread_local Ptr<AutoTuner<Expr>> tuner = New<AutoTuner<Expr>>();
+  thread_local std::unordered_map<size_t, std::vector<Expr>> preparations; // per kernel hash, until decided
+  thread_local std::vector<Expr> retired; // preparations of kernels that lost, still in long-term memory
+  tuner->clear();
+  tuner->setCache(backend->getAutoTunerCache());
+
+  // referenced only by the long-term memory of their graph and by retired, or by retired alone if the
+  // graph is gone
+  retired.erase(std::remove_if(retired.begin(), retired.end(), [](Expr& node) {
+    if(node.useCount() > 2)
+      return false;
+    if(auto graph = node->graph())
+      graph->forgetMemoized(node);
+    return true;
+  }), retired.end());
+
+  int dimK = a->shape()[transA ? -2 : -1];
+  int dimM = a->shape().elements() / dimK;
+  int dimN = b->shape()[transB ? -2 : -1];
+
+  // numbers of rows change with batch and beam size, statistics are collected per power of two
+  size_t rows = 1;
+  while(rows < (size_t)dimM)
+    rows *= 2;
+
+  size_t hash = rows;
+  util::hash_combine(hash, dimK);
+  util::hash_combine(hash, dimN);
+  util::hash_combine(hash, transA);
+  util::hash_combine(hash, transB);
+  util::hash_combine(hash, (bool)bias);
+  util::hash_combine(hash, (size_t)b->value_type());
+#if defined(USE_INTGEMM) && !defined(ARM)
+  util::hash_combine(hash, (size_t)intgemm::kCPU); // decisions do not carry over to other instruction sets
+#endif
+
+  std::vector<size_t> kernelHashes;
+  for(const auto& kernel : backend->getGemmAutoTuneKernels()) {
+    size_t kernelHash = hash;
+    util::hash_combine(kernelHash, kernel);
+    kernelHashes.push_back(kernelHash);
+    auto rec = [=](Expr e) {
+      std::vector<Expr> memoized;
+      recordAlgorithm(e, {a, b, bias}, tuner, kernelHash, memoized);
+      size_t bestHash;
+      if(!tuner->decided(bestHash)) {
+        auto& known = preparations[kernelHash];
+        for(auto& node : memoized)
+          if(std::find(known.begin(), known.end(), node) == known.end())
+            known.push_back(node);
+      }
+      return e;
+    };
+
+    if(kernel == "float32") {
+      tuner->insert({kernelHash, [=]() { return rec(affineDefault(a, b, bias, transA, transB, scale)); }});
+    } else if(kernel == "int8" || kernel == "int16") {
+#if !defined(ARM) && !defined(WASM)
+      if(dimK % 64 != 0 || dimN % 8 != 0) // sizes supported by intgemm
+        continue;
+      if(kernel == "int8")
+        tuner->insert({kernelHash, [=]() {
+          return rec(cpu::integer::affine<Type::int8>(a, b, bias, transA, transB, scale, clipValue));
+        }});
+      else
+        tuner->insert({kernelHash, [=]() {
+          return rec(cpu::integer::affine<Type::int16>(a, b, bias, transA, transB, scale, clipValue));
+        }});
+#endif
+    } else if(kernel == "packed16") {
+#if USE_FBGEMM
+      // packing pays off only for constant weights, packed once and cached
+      if(!fbgemm::fbgemmHasAvx2Support() || !b->memoize() || !bias)
+        continue;
+      tuner->insert({kernelHash, [=]() {
+        auto packed = cpu::variant::pack(Type::packed16, b, cpu::variant::PackMatrix::B, transB, clipValue);
+        return rec(cpu::variant::affine(clip(a, clipValue), packed, b->shape(), bias, transA, transB, scale));
+      }});
+#endif
+    } else {
+      ABORT("Unknown GEMM kernel for --gemm-autotune-kernels: {}", kernel);
+    }
+  }
+
+  if(tuner->empty())
+    return affineDefault(a, b, bias, transA, transB, scale);
+
+  auto result = tuner->run();
+
+  size_t bestHash;
+  if(tuner->decided(bestHash)) {
+    const auto& kept = preparations[bestHash];
+    for(auto kernelHash : kernelHashes) {
+      auto it = preparations.find(kernelHash);
+      if(it == preparations.end())
+        continue;
+      if(kernelHash != bestHash)
+        for(auto& node : it->second)
+          if(std::find(kept.begin(), kept.end(), node) == kept.end()
+             && std::find(retired.begin(), retired.end(), node) == retired.end())
+            retired.push_back(node);
+    }
+    for(auto kernelHash : kernelHashes)
+      preparations.erase(kernelHash);
+  }
+  return result;
+}
+
 Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
   auto device = a->graph()->getDeviceId().type;
 
@@ -596,9 +743,14 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
           clipValue);
       }
 #endif
+      else if(std::static_pointer_cast<cpu::Backend>(a->graph()->getBackend())->isGemmAutoTuned()) {
+        return affineAutoTuned(a, b, bias, transA, transB, scale);
+      }
       else {
         return affineDefault(a, b, bias, transA, transB, scale);
       }
+    } else if(isFloat(aElementType) && isGroupQuantized(bElementType)) {
+      return cpu::int4::affine(a, b, bias, transA, transB, scale);
     } else if(isFloat(aElementType) && isPacked(bElementType)) {
 #if USE_FBGEMM
       // 07/10/2019 - Use packed GEMM only if the cpu architecture supports AVX2
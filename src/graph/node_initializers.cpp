@@ -211,23 +211,40 @@ Ptr<NodeInitializer> fromTensor(Tensor externalTensor) {
   return fromLambda([externalTensor](Tensor t) { t->copyFrom(externalTensor); }, externalTensor->type());
 }
 
+// Writes Google's sinusoidal embedding of position p to the dimEmb floats at out
+static void sinusoidalPositionEmbedding(size_t p, int dimEmb, float* out) {
+  float numTimescales = (float)dimEmb / 2;
+  float logTimescaleIncrement = std::log(10000.f) / (numTimescales - 1.f);
+  for(int i = 0; i < numTimescales; ++i) {
+    float v = p * std::exp(i * -logTimescaleIncrement);
+    out[i                     ] = std::sin(v);
+    out[(int)numTimescales + i] = std::cos(v); // @TODO: is int vs. float correct for num_timescales?
+  }
+}
+
 // Computes Google's sinusoidal position embeddings
 Ptr<NodeInitializer> sinusoidalPositionEmbeddings(int start) {
   return fromLambda([start](Tensor t) {
     int dimEmb   = t->shape()[-1];
     int dimWords = (int)t->size() / dimEmb;
 
-    float numTimescales = (float)dimEmb / 2;
-    float logTimescaleIncrement = std::log(10000.f) / (numTimescales - 1.f);
-
     std::vector<float> vPos(dimEmb * dimWords, 0);
-    for(int p = start; p < dimWords + start; ++p) {
-      for(int i = 0; i < numTimescales; ++i) {
-        float v = p * std::exp(i * -logTimescaleIncrement);
-        vPos[(p - start) * dimEmb + i                     ] = std::sin(v);
-        vPos[(p - start) * dimEmb + (int)numTimescales + i] = std::cos(v); // @TODO: is int vs. float correct for num_timescales?
-      }
-    }
+    for(int p = start; p < dimWords + start; ++p)
+      sinusoidalPositionEmbedding(p, dimEmb, vPos.data() + (p - start) * dimEmb);
+
+    t->set(vPos);
+  }, Type::float32);
+}
+
+Ptr<NodeInitializer> sinusoidalPositionEmbeddings(const std::vector<size_t>& positions) {
+  return fromLambda([positions](Tensor t) {
+    int dimEmb = t->shape()[-1];
+    ABORT_IF(t->size() != positions.size() * dimEmb,
+             "Tensor of shape {} does not hold the embeddings of {} positions", t->shape(), positions.size());
+
+    std::vector<float> vPos(dimEmb * positions.size(), 0);
+    for(size_t i = 0; i < positions.size(); ++i)
+      sinusoidalPositionEmbedding(positions[i], dimEmb, vPos.data() + i * dimEmb);
 
     t->set(vPos);
   }, Type::float32);
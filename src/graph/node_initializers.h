@@ -176,6 +176,13 @@ Ptr<NodeInitializer> fromWord2vec(const std::string& file,
  */
 Ptr<NodeInitializer> sinusoidalPositionEmbeddings(int start);
 
+/**
+ * Same as above, but row i of the tensor {-2: rows, -1: model} is the
+ * embedding of position positions[i], e.g. one row per batch entry
+ * when the entries of a batch are at different time steps.
+ */
+Ptr<NodeInitializer> sinusoidalPositionEmbeddings(const std::vector<size_t>& positions);
+
 /**
  * Computes a random rotation matrix for LSH hashing. This is part  
  * of a hash function. The values are orthonormal and computed via
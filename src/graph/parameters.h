@@ -125,9 +125,13 @@ public:
   }
 };
 
+// Parameters pointing into a memory-mapped model. Parameters that are not marked as mapped, e.g. items
+// of the same type that had to be copied, or those of another model of an ensemble, get their own memory.
 class MappedParameters : public Parameters {
 private:
   Ptr<Backend> backend_;
+  std::unordered_set<std::string> mapped_;        // names of parameters initialized with a pointer into the mapping
+  std::vector<Ptr<TensorAllocator>> ownedVals_;   // memory of the other parameters, one allocator per allocateForward()
 
 public:
   MappedParameters(Type acceptedElementType) : Parameters(acceptedElementType) {
@@ -137,13 +141,29 @@ public:
   virtual void init(Ptr<Backend> backend) override { backend_ = backend; }
   virtual void init(Ptr<Backend> backend, Ptr<Device>) override { init(backend); }
 
+  // marks p as initialized from the mapping, before its first allocateForward()
+  void setMapped(Expr p) { mapped_.insert(p->name()); }
+
   virtual void allocateForward() override {
-    if(!params_.empty()) {
-      for(auto p : params_) {
-        if(!p->val()) {
-          p->val() = TensorBase::New(nullptr, p->shape(), p->value_type(), backend_);
-        }
-      }
+    std::vector<Expr> owned;
+    for(auto p : params_) {
+      if(p->val())
+        continue;
+      if(mapped_.count(p->name()))
+        p->val() = TensorBase::New(nullptr, p->shape(), p->value_type(), backend_);
+      else
+        owned.push_back(p);
+    }
+
+    if(!owned.empty()) {
+      auto vals = New<TensorAllocator>(backend_);
+      size_t bytes = 0;
+      for(auto p : owned)
+        bytes += vals->capacity(p->shape(), p->value_type());
+      vals->reserveExact(bytes);
+      for(auto p : owned)
+        vals->allocate(p->val(), p->shape(), p->value_type());
+      ownedVals_.push_back(vals);
     }
   }
 
@@ -166,6 +186,8 @@ public:
   virtual void clear() override {
     params_.clear();
     named_.clear();
+    mapped_.clear();
+    ownedVals_.clear();
   }
 };
 
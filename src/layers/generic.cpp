@@ -230,6 +230,10 @@ namespace marian {
         auto k     = opt<std::vector<int>>("output-approx-knn")[0];
         auto nbits = opt<std::vector<int>>("output-approx-knn")[1];
         lsh_ = New<LSH>(k, nbits);
+
+        // index precomputed by marian-conv --add-lsh, if any, mmapped or loaded with the model
+        auto prefix = options_->get<std::string>("prefix");
+        lsh_->setIndex(graph_->get(prefix + "_lsh_codes"), graph_->get(prefix + "_lsh_rotation"));
 #endif
       }
 
@@ -294,16 +298,30 @@ namespace marian {
         }
       };
 
-      if (shortlist_ && !cachedShortWt_) { // shortlisted versions of parameters are cached within one batch, then clear()ed
+      bool isCpu = graph_->getDeviceId().type == DeviceType::cpu;
+      bool isInt8 = (graph_->getBackend()->isInt8() || matchType<intgemm8>(Wt_->value_type())) && isCpu;
+      bool isInt16 = (graph_->getBackend()->isInt16() || matchType<intgemm16>(Wt_->value_type())) && isCpu;
+
+      // selects the columns of the shortlisted words from the output parameters
+      auto selectShortlisted = [&](const std::vector<WordIndex>& shortlisted, Expr& shortWt, Expr& shortb) {
+        // Integer GEMMs work on blocks of 8 columns. Ragged shortlists are padded by repeating the last word.
+        // The intgemm products leave out the logits of the repeated columns, elsewhere removePadding() below
+        // cuts them off.
+        ABORT_IF(shortlisted.empty(), "Shortlist of the output layer is empty");
+        auto indices = shortlisted;
+        if (isInt8 || isInt16)
+          while (indices.size() % 8 != 0)
+            indices.push_back(shortlisted.back());
+
         Expr preparedBias = nullptr;
-        if ((graph_->getBackend()->isInt8() || matchType<intgemm8>(Wt_->value_type()) )&& graph_->getDeviceId().type == DeviceType::cpu) {
+        if (isInt8) {
 #ifdef ARM
             if (matchType<intgemm8>(Wt_->value_type())) {
-              cachedShortWt_ = Expression<marian::cpu::integer::SelectColumnsBRuyNodeOp>(Wt_, shortlist_->indices());
+              shortWt = Expression<marian::cpu::integer::SelectColumnsBRuyNodeOp>(Wt_, indices);
             } else {
               Expr bQuantMult = Expression<marian::cpu::integer::QuantMultRuyNodeOp>(Wt_, true, Wt_->name());
               Expr bPrep = Expression<marian::cpu::integer::PrepareNode>(Wt_, bQuantMult, !isLegacyUntransposedW, true);
-              cachedShortWt_ = Expression<marian::cpu::integer::SelectColumnsBRuyNodeOp>(bPrep, shortlist_->indices());
+              shortWt = Expression<marian::cpu::integer::SelectColumnsBRuyNodeOp>(bPrep, indices);
             }
 #else
           bool transposed = !isLegacyUntransposedW;
@@ -318,37 +336,56 @@ namespace marian {
                 preparedBias = Expression<marian::cpu::integer::PrepareFakeBiasForBNodeOp>(Wt_, aQuantMult, bQuantMult);
               }
             }
-            cachedShortWt_ = marian::cpu::integer::selectColumnsB<Type::int8>(Wt_, shortlist_->indices(), -1000.0 /*clip_value currently unused */);
+            shortWt = marian::cpu::integer::selectColumnsB<Type::int8>(Wt_, indices, -1000.0 /*clip_value currently unused */, shortlisted.size());
           } else {
-            cachedShortWt_ = marian::cpu::integer::prepareB<Type::int8>(Wt_, marian::cpu::integer::quantMult<Type::int8>(Wt_), -1000.0 /*clip_value currently unused */, transposed /*Use different routine as Wt is transposed*/);
+            shortWt = marian::cpu::integer::prepareB<Type::int8>(Wt_, marian::cpu::integer::quantMult<Type::int8>(Wt_), -1000.0 /*clip_value currently unused */, transposed /*Use different routine as Wt is transposed*/);
             if (graph_->getBackend()->isPrecomputedAlpha()) {
-              aQuantMult = Expression<marian::cpu::integer::fetchAlphaFromModelNodeOp>(cachedShortWt_);
+              aQuantMult = Expression<marian::cpu::integer::fetchAlphaFromModelNodeOp>(shortWt);
               if (hasBias_ && graph_->getBackend()->isShifted()) {
-                preparedBias = Expression<marian::cpu::integer::PrepareBiasForBNodeOp>(b_, cachedShortWt_, aQuantMult, bQuantMult);
+                preparedBias = Expression<marian::cpu::integer::PrepareBiasForBNodeOp>(b_, shortWt, aQuantMult, bQuantMult);
               } else if (graph_->getBackend()->isShiftedAll()) {
-                preparedBias = Expression<marian::cpu::integer::PrepareFakeBiasForBNodeOp>(cachedShortWt_, aQuantMult, bQuantMult);
+                preparedBias = Expression<marian::cpu::integer::PrepareFakeBiasForBNodeOp>(shortWt, aQuantMult, bQuantMult);
               }
             }
-            cachedShortWt_ = marian::cpu::integer::selectColumnsB<Type::int8>(cachedShortWt_, shortlist_->indices(), -1000.0 /*clip_value currently unused */);
+            shortWt = marian::cpu::integer::selectColumnsB<Type::int8>(shortWt, indices, -1000.0 /*clip_value currently unused */, shortlisted.size());
           }
 
-        } else if ((graph_->getBackend()->isInt16() || matchType<intgemm16>(Wt_->value_type()) )&& graph_->getDeviceId().type == DeviceType::cpu) {
+        } else if (isInt16) {
           bool transposed = !isLegacyUntransposedW;
           if (isIntgemm(Wt_->value_type())) {
-            cachedShortWt_ = marian::cpu::integer::selectColumnsB<Type::int16>(Wt_, shortlist_->indices(), -1000.0 /*clip_value currently unused */);
+            shortWt = marian::cpu::integer::selectColumnsB<Type::int16>(Wt_, indices, -1000.0 /*clip_value currently unused */, shortlisted.size());
           } else {
-            cachedShortWt_ = marian::cpu::integer::prepareB<Type::int16>(Wt_, marian::cpu::integer::quantMult<Type::int16>(Wt_), -1000.0 /*clip_value currently unused */, transposed /*Use different routine as Wt is transposed*/);
-            cachedShortWt_ = marian::cpu::integer::selectColumnsB<Type::int16>(cachedShortWt_, shortlist_->indices(), -1000.0 /*clip_value currently unused */);
+            shortWt = marian::cpu::integer::prepareB<Type::int16>(Wt_, marian::cpu::integer::quantMult<Type::int16>(Wt_), -1000.0 /*clip_value currently unused */, transposed /*Use different routine as Wt is transposed*/);
+            shortWt = marian::cpu::integer::selectColumnsB<Type::int16>(shortWt, indices, -1000.0 /*clip_value currently unused */, shortlisted.size());
           }
 #endif
         } else {
-          cachedShortWt_ = index_select(Wt_, isLegacyUntransposedW ? -1 : 0, shortlist_->indices());
+          shortWt = index_select(Wt_, isLegacyUntransposedW ? -1 : 0, indices);
         }
         if (preparedBias) {
-          cachedShortb_  = index_select(preparedBias ,                             -1, shortlist_->indices());
+          shortb  = index_select(preparedBias ,                             -1, indices);
         } else if (hasBias_) {
-          cachedShortb_  = index_select(b_ ,                             -1, shortlist_->indices());
+          shortb  = index_select(b_ ,                             -1, indices);
+        }
+      };
+
+      auto removePadding = [](Expr logits, size_t numShortlisted) {
+        return logits->shape()[-1] == (int)numShortlisted ? logits : slice(logits, -1, Slice(0, (int)numShortlisted));
+      };
+
+      // shortlisted versions of parameters are cached within one batch, then clear()ed
+      if (shortlist_ && shortlist_->isGrouped()) {
+        ABORT_IF(factoredVocab_, "Grouped shortlists are not supported with factored vocabularies");
+        if (cachedGroupWt_.empty()) {
+          for (const auto& indices : shortlist_->groupIndices()) {
+            Expr shortWt, shortb;
+            selectShortlisted(indices, shortWt, shortb);
+            cachedGroupWt_.push_back(shortWt);
+            cachedGroupb_.push_back(shortb);
+          }
         }
+      } else if (shortlist_ && !cachedShortWt_) {
+        selectShortlisted(shortlist_->indices(), cachedShortWt_, cachedShortb_);
       }
 
       if (factoredVocab_) {
@@ -424,8 +461,11 @@ namespace marian {
           }
           // @TODO: b_ should be a vector, not a matrix; but shotlists use cols() in, which requires a matrix
           Expr factorLogits;
-          if(g == 0)
+          if(g == 0) {
             factorLogits = affineOrLSH(input1, factorWt, factorB, false, /*transB=*/isLegacyUntransposedW ? false : true); // [B... x U] factor logits
+            if(shortlist_)
+              factorLogits = removePadding(factorLogits, shortlist_->indices().size());
+          }
           else
             factorLogits = affineOrDot(input1, factorWt, factorB, false, /*transB=*/isLegacyUntransposedW ? false : true); // [B... x U] factor logits
           
@@ -491,8 +531,24 @@ namespace marian {
           }
         }
         return Logits(std::move(allLogits), factoredVocab_);
+      } else if (shortlist_ && shortlist_->isGrouped()) {
+        // each group of sentences is multiplied with the columns of its own shortlist, all of the same length,
+        // and the logits are concatenated along the batch axis again
+        auto ranges = shortlist_->activeGroupRanges();
+        ABORT_IF(ranges.back().second != (size_t)input->shape()[-2],
+                 "Grouped shortlist covers {} sentences, but output has {}", ranges.back().second, input->shape()[-2]);
+        std::vector<Expr> groupLogits;
+        for (size_t g = 0; g < ranges.size(); ++g) {
+          if (ranges[g].first == ranges[g].second) // all sentences of the group are finished
+            continue;
+          auto groupInput = slice(input, -2, Slice((int)ranges[g].first, (int)ranges[g].second));
+          groupLogits.push_back(affineOrLSH(groupInput, cachedGroupWt_[g], cachedGroupb_[g], false, /*transB=*/isLegacyUntransposedW ? false : true));
+        }
+        auto logits = groupLogits.size() == 1 ? groupLogits.front() : concatenate(groupLogits, -2);
+        return Logits(removePadding(logits, shortlist_->groupIndices().front().size()));
       } else if (shortlist_) {
-        return Logits(affineOrLSH(input, cachedShortWt_, cachedShortb_, false, /*transB=*/isLegacyUntransposedW ? false : true));
+        auto logits = affineOrLSH(input, cachedShortWt_, cachedShortb_, false, /*transB=*/isLegacyUntransposedW ? false : true);
+        return Logits(removePadding(logits, shortlist_->indices().size()));
       } else {
         return Logits(affineOrLSH(input, Wt_, b_, false, /*transB=*/isLegacyUntransposedW ? false : true));
       }
@@ -610,7 +666,12 @@ namespace marian {
     ABORT_IF(factoredVocab_, "Embedding: applyIndices must not be used with a factored vocabulary");
     auto embIdxExpr = E_->graph()->indices(embIdx);
     embIdxExpr->set_name("data_" + std::to_string(/*batchIndex_=*/0));  // @TODO: how to know the batch index?
-    auto selectedEmbs = rows(E_, embIdxExpr);     // [(B*W) x E]
+    return applyIndices(embIdxExpr, shape);
+  }
+
+  Expr Embedding::applyIndices(Expr embIdx, const Shape& shape) const {
+    ABORT_IF(factoredVocab_, "Embedding: applyIndices must not be used with a factored vocabulary");
+    auto selectedEmbs = rows(E_, embIdx);         // [(B*W) x E]
     selectedEmbs = reshape(selectedEmbs, shape);  // [W, B, E]
     // @BUGBUG: We should not broadcast along dimBatch=[-2]. Then we can also dropout before reshape() (test that separately)
     selectedEmbs = dropout(selectedEmbs, options_->get<float>("dropout", 0.0f), { selectedEmbs->shape()[-3], 1, 1 });
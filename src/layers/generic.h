@@ -249,6 +249,8 @@ private:
   Expr cachedShortWt_;  // short-listed version, cached (cleared by clear())
   Expr cachedShortb_;   // these match the current value of shortlist_
   Expr cachedShortLemmaEt_;
+  std::vector<Expr> cachedGroupWt_; // [group] short-listed versions for grouped shortlists
+  std::vector<Expr> cachedGroupb_;
   Ptr<FactoredVocab> factoredVocab_;
   
   // optional parameters set/updated after construction
@@ -275,7 +277,7 @@ public:
     if (shortlist_)
       ABORT_IF(shortlist.get() != shortlist_.get(), "Output shortlist cannot be changed except after clear()");
     else {
-      ABORT_IF(cachedShortWt_ || cachedShortb_ || cachedShortLemmaEt_, "No shortlist but cached parameters??");
+      ABORT_IF(cachedShortWt_ || cachedShortb_ || cachedShortLemmaEt_ || !cachedGroupWt_.empty(), "No shortlist but cached parameters??");
       shortlist_ = shortlist;
     }
     // cachedShortWt_ and cachedShortb_ will be created lazily inside apply()
@@ -288,6 +290,8 @@ public:
     cachedShortWt_ = nullptr;
     cachedShortb_  = nullptr;
     cachedShortLemmaEt_ = nullptr;
+    cachedGroupWt_.clear();
+    cachedGroupb_.clear();
   }
 
   Logits applyAsLogits(Expr input) override final;
@@ -313,6 +317,9 @@ public:
   Expr apply(const Words& words, const Shape& shape) const override final;
 
   Expr applyIndices(const std::vector<WordIndex>& embIdx, const Shape& shape) const override final;
+
+  // same with the indices in a constant, e.g. one that is rewritten for replaying a recorded graph
+  Expr applyIndices(Expr embIdx, const Shape& shape) const;
 };
 
 class ULREmbedding : public LayerBase, public IEmbeddingLayer {
@@ -4,15 +4,268 @@
 
 #if BLAS_FOUND
 #include "faiss/IndexLSH.h"
+#include "faiss/VectorTransform.h"
 #endif
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__AVX2__) && !defined(ARM)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 namespace marian {
 
+namespace {
+
+// bytes per binary code, padded to whole 64-bit words for the popcount kernel
+int codeBytes(int nbits) {
+  return (nbits + 63) / 64 * 8;
+}
+
+inline int popcount(uint64_t x) {
+#ifdef _MSC_VER
+  return (int)__popcnt64(x);
+#else
+  return __builtin_popcountll(x);
+#endif
+}
+
+#if defined(__AVX2__) && !defined(ARM)
+// popcount of each byte by nibble lookup (Mula et al.), summed into the four 64-bit lanes by sad
+inline __m256i popcount256(__m256i x) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low));
+  __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low));
+  return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+#endif
+
+// Hamming distance of two codes of 'words' 64-bit words
+inline int hamming(const uint64_t* a, const uint64_t* b, int words) {
+  int w = 0, d = 0;
+#if defined(__AVX512VPOPCNTDQ__) && !defined(ARM)
+  __m512i acc = _mm512_setzero_si512();
+  for(; w + 8 <= words; w += 8)
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_xor_si512(_mm512_loadu_si512(a + w), _mm512_loadu_si512(b + w))));
+  d = (int)_mm512_reduce_add_epi64(acc);
+#elif defined(__AVX2__) && !defined(ARM)
+  __m256i acc = _mm256_setzero_si256();
+  for(; w + 4 <= words; w += 4) {
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + w)), _mm256_loadu_si256((const __m256i*)(b + w)));
+    acc = _mm256_add_epi64(acc, popcount256(x));
+  }
+  __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  d = (int)(_mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1));
+#endif
+  for(; w < words; ++w)
+    d += popcount(a[w] ^ b[w]);
+  return d;
+}
+
+// Running selection of the k codes closest to one query, seen in order of ids. Distances are bounded by
+// nbits, so a histogram of the distances seen so far gives the threshold a code must not exceed to be
+// among the k closest; codes beyond it are never stored and the candidates stay below 2k.
+class HammingTopK {
+  int k_;
+  std::vector<int> histogram_;
+  int threshold_;   // smallest distance with at least k codes at or below it, nbits until k codes are seen
+  int atOrBelow_{0}; // number of codes seen with distance <= threshold_
+  std::vector<std::pair<IndexType, uint16_t>> candidates_; // ids and distances <= threshold_ at the time, by id
+
+  // drops candidates beyond the threshold and ties at it that are not needed, keeping the lowest ids
+  void prune() {
+    int ties = k_ - (atOrBelow_ - histogram_[threshold_]);
+    size_t kept = 0;
+    for(auto& c : candidates_) {
+      if(c.second < threshold_ || (c.second == threshold_ && ties-- > 0))
+        candidates_[kept++] = c;
+    }
+    candidates_.resize(kept);
+  }
+
+public:
+  HammingTopK(int k, int nbits) : k_(k), histogram_(nbits + 1, 0), threshold_(nbits) {
+    candidates_.reserve(2 * k);
+  }
+
+  void add(IndexType id, int d) {
+    if(d > threshold_)
+      return;
+    histogram_[d]++;
+    atOrBelow_++;
+    while(threshold_ > 0 && atOrBelow_ - histogram_[threshold_] >= k_)
+      atOrBelow_ -= histogram_[threshold_--];
+    if(d > threshold_)
+      return;
+    candidates_.emplace_back(id, (uint16_t)d);
+    if(candidates_.size() >= 2 * (size_t)k_)
+      prune();
+  }
+
+  // everything closer than the threshold, ties at it by lowest id
+  void get(IndexType* ids) {
+    prune();
+    for(auto& c : candidates_)
+      *ids++ = c.first;
+  }
+};
+
+}  // namespace
+
+void LSH::encode(const float* x, int rows, int dim, const float* rotation, int nbits, uint8_t* codes) {
+  const int blockRows = 1024; // bounds the memory for rotated vectors when encoding a whole vocabulary
+  int bytes = codeBytes(nbits);
+  std::fill(codes, codes + (size_t)rows * bytes, (uint8_t)0);
+
+  std::vector<float> rotated;
+  for(int r0 = 0; r0 < rows; r0 += blockRows) {
+    int blockSize = std::min(blockRows, rows - r0);
+    const float* block = x + (size_t)r0 * dim;
+    if(rotation) {
+      rotated.resize((size_t)blockSize * nbits);
+      sgemm(false, true, blockSize, nbits, dim,
+            1.f, const_cast<float*>(block), dim, const_cast<float*>(rotation), dim,
+            0.f, rotated.data(), nbits);
+      block = rotated.data();
+    }
+    for(int r = 0; r < blockSize; ++r) {
+      uint8_t* code = codes + (size_t)(r0 + r) * bytes;
+      for(int j = 0; j < nbits; ++j)
+        if(block[(size_t)r * nbits + j] >= 0)
+          code[j / 8] |= (uint8_t)(1 << (j % 8));
+    }
+  }
+}
+
+void LSH::hammingKnn(const uint64_t* queries, int qRows,
+                     const uint64_t* codes, int vRows,
+                     int words, int nbits, int k, IndexType* ids) {
+  const int queryBlockRows = 16;
+  const int codeBlockRows  = 256;
+  for(int q0 = 0; q0 < qRows; q0 += queryBlockRows) {
+    int q1 = std::min(q0 + queryBlockRows, qRows);
+    std::vector<HammingTopK> topk;
+    for(int q = q0; q < q1; ++q)
+      topk.emplace_back(k, nbits);
+    for(int v0 = 0; v0 < vRows; v0 += codeBlockRows) {
+      int v1 = std::min(v0 + codeBlockRows, vRows);
+      for(int q = q0; q < q1; ++q) {
+        const uint64_t* query = queries + (size_t)q * words;
+        for(int v = v0; v < v1; ++v)
+          topk[q - q0].add((IndexType)v, hamming(query, codes + (size_t)v * words, words));
+      }
+    }
+    for(int q = q0; q < q1; ++q)
+      topk[q - q0].get(ids + (size_t)q * k);
+  }
+}
+
 Expr LSH::apply(Expr input, Expr W, Expr b) {
-  auto idx = search(input, W);
+  int dim   = W->shape()[-1];
+  int vRows = W->shape().elements() / dim;
+
+  // a precomputed index covers the full output matrix, shortlisted matrices are indexed on the fly
+  bool precomputed = codes_ && codes_->shape().elements() / codes_->shape()[-1] == vRows
+                     && (rotation_ ? rotation_->shape()[-1] == dim : dim == nbits_);
+
+  auto idx = precomputed ? searchCodes(input) : search(input, W);
   return affine(idx, input, W, b);
 }
 
+void LSH::setIndex(Expr codes, Expr rotation) {
+  if(!codes)
+    return;
+  if(codes->shape()[-1] != codeBytes(nbits_) || (rotation && rotation->shape()[-2] != nbits_)) {
+    LOG(warn, "LSH index in model does not match --output-approx-knn with {} bits, building it on first use", nbits_);
+    return;
+  }
+  codes_ = codes;
+  rotation_ = rotation;
+}
+
+std::vector<io::Item> LSH::createIndexItems(const std::string& prefix, Tensor values, int nbits) {
+#if BLAS_FOUND
+  ABORT_IF(nbits <= 0, "Number of LSH bits must be positive");
+  ABORT_IF(nbits > std::numeric_limits<uint16_t>::max(), "Number of LSH bits {} too large", nbits);
+
+  int dim  = values->shape()[-1];
+  int rows = values->shape().elements() / dim;
+
+  std::vector<io::Item> items;
+  std::vector<float> rotation;
+  if(dim != nbits) { // same rotation as the index built at runtime, faiss::IndexLSH seeds it with 5
+    faiss::RandomRotationMatrix rrot(dim, nbits);
+    rrot.init(/*seed=*/5);
+    rotation = rrot.A;
+
+    io::Item item;
+    item.name  = prefix + "_lsh_rotation";
+    item.shape = {nbits, dim};
+    item.type  = Type::float32;
+    item.bytes.resize(rotation.size() * sizeof(float));
+    std::memcpy(item.bytes.data(), rotation.data(), item.bytes.size());
+    items.emplace_back(std::move(item));
+  }
+
+  io::Item item;
+  item.name  = prefix + "_lsh_codes";
+  item.shape = {rows, codeBytes(nbits)};
+  item.type  = Type::uint8;
+  item.bytes.resize(item.shape.elements());
+  encode(values->data<float>(), rows, dim, rotation.empty() ? nullptr : rotation.data(), nbits, (uint8_t*)item.bytes.data());
+  items.emplace_back(std::move(item));
+
+  LOG(info, "Created LSH index with {} bits for {} vectors of dim {}", nbits, rows, dim);
+  return items;
+#else
+  prefix; values; nbits;
+  ABORT("LSH index requires a CPU BLAS library");
+#endif
+}
+
+Expr LSH::searchCodes(Expr query) {
+  ABORT_IF(query->graph()->getDeviceId().type == DeviceType::gpu,
+           "LSH index (--output-approx-knn) currently not implemented for GPU");
+
+  auto kShape = query->shape();
+  kShape.set(-1, k_);
+
+  auto forward = [this](Expr out, const std::vector<Expr>& inputs) {
+    auto query = inputs[0];
+    auto codes = inputs[1];
+    const float* rotation = inputs.size() > 2 ? inputs[2]->val()->data<float>() : nullptr;
+
+    int dim   = query->shape()[-1];
+    int qRows = query->shape().elements() / dim;
+    int bytes = codes->shape()[-1];
+    int vRows = codes->shape().elements() / bytes;
+    ABORT_IF(k_ > vRows, "LSH search for {} nearest neighbours among {} vectors", k_, vRows);
+
+    std::vector<uint64_t> queryCodes((size_t)qRows * bytes / sizeof(uint64_t));
+    encode(query->val()->data<float>(), qRows, dim, rotation, nbits_, (uint8_t*)queryCodes.data());
+
+    std::vector<IndexType> vOut((size_t)qRows * k_);
+    hammingKnn(queryCodes.data(), qRows,
+               reinterpret_cast<const uint64_t*>(codes->val()->data<uint8_t>()), vRows,
+               bytes / (int)sizeof(uint64_t), nbits_, k_, vOut.data());
+
+    out->val()->set(vOut);
+  };
+
+  std::vector<Expr> nodes = {query, codes_};
+  if(rotation_)
+    nodes.push_back(rotation_);
+
+  return lambda(nodes, kShape, Type::uint32, forward);
+}
+
 Expr LSH::search(Expr query, Expr values) {
 #if BLAS_FOUND
   ABORT_IF(query->graph()->getDeviceId().type == DeviceType::gpu,
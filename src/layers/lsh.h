@@ -7,7 +7,7 @@ namespace faiss {
 
 namespace marian {
 
-class LSH {  
+class LSH {
 public:
   LSH(int k, int nbits) : k_{k}, nbits_{nbits} {
 #if !BLAS_FOUND
@@ -17,17 +17,42 @@ public:
 
   Expr apply(Expr query, Expr values, Expr bias);
 
+  // Use the index precomputed by marian-conv --add-lsh instead of building one on first use. codes is
+  // [rows x bytes], rotation [nbits x dim] is nullptr if the vectors are binarized without rotation.
+  // The index is only used if it matches nbits and the number of rows of the indexed values.
+  void setIndex(Expr codes, Expr rotation);
+
+  // Items with the precomputed index of values ([rows x dim]) as stored in a model by marian-conv,
+  // named <prefix>_lsh_codes and <prefix>_lsh_rotation.
+  static std::vector<io::Item> createIndexItems(const std::string& prefix, Tensor values, int nbits);
+
+  // Rotates rows of vectors (unless rotation is nullptr, then dim == nbits) and sets bit j of a code if
+  // component j is non-negative, the bit order of faiss::fvecs2bitvecs. Codes are padded with zero bits
+  // to whole 64-bit words.
+  static void encode(const float* x, int rows, int dim, const float* rotation, int nbits, uint8_t* codes);
+
+  // Ids of the k codes closest to each query code in Hamming distance, in no particular order, ties at the
+  // k-th distance by lowest id. Codes have 'words' 64-bit words. Queries are processed in blocks that share
+  // each block of codes while it is in cache, with a running top-k per query.
+  static void hammingKnn(const uint64_t* queries, int qRows,
+                         const uint64_t* codes, int vRows,
+                         int words, int nbits, int k, IndexType* ids);
+
 private:
 #ifndef WASM_COMPATIBLE_SOURCE
   Ptr<faiss::IndexLSH> index_;
 #endif
   size_t indexHash_{0};
 
+  Expr codes_;
+  Expr rotation_;
+
   int k_{100};
   int nbits_{1024};
 
   Expr search(Expr query, Expr values);
+  Expr searchCodes(Expr query);
   Expr affine(Expr idx, Expr query, Expr values, Expr bias);
 };
 
-}
\ No newline at end of file
+}
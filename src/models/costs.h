@@ -367,6 +367,18 @@ public:
     return cost_->apply(nextState);
   }
 
+  virtual bool canReplayStep() override { return encdec_->canReplayStep(); }
+
+  // the logits of the recorded step already include the cost, e.g. the log softmax
+  virtual Ptr<DecoderState> replayStep(Ptr<ExpressionGraph> graph,
+                                       Ptr<DecoderState> state,
+                                       const std::vector<IndexType>& hypIndices,
+                                       const Words& words,
+                                       const std::vector<IndexType>& batchIndices,
+                                       int beamSize) override {
+    return encdec_->replayStep(graph, state, hypIndices, words, batchIndices, beamSize);
+  }
+
   virtual Logits build(Ptr<ExpressionGraph> /*graph*/,
                        Ptr<data::CorpusBatch> /*batch*/,
                        bool /*clearGraph*/ = true) override {
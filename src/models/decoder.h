@@ -72,6 +72,19 @@ public:
     state->setTargetHistoryEmbeddings(selectedEmbs);
   }
 
+  // Whether the last step() was built while the graph was recording in a way that replayStep() can
+  // replay, see ExpressionGraph::startRecording()
+  virtual bool canReplayStep() const { return false; }
+
+  // Same as embeddingsFromPrediction() and step() for the shapes of the recorded step: writes the words
+  // and position of the state into the recorded graph, which then has to be replayed to compute the
+  // logits of the returned state.
+  virtual Ptr<DecoderState> replayStep(Ptr<ExpressionGraph> /*graph*/,
+                                       Ptr<DecoderState> /*state*/,
+                                       const Words& /*words*/) {
+    ABORT("This decoder cannot replay a recorded step");
+  }
+
   virtual const std::vector<Expr> getAlignments(int /*i*/ = 0) { return {}; }; // [tgt index][beam depth, max src length, batch size, 1]
 
   virtual Ptr<data::Shortlist> getShortlist() { return shortlist_; }
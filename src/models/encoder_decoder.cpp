@@ -211,6 +211,17 @@ Ptr<DecoderState> EncoderDecoder::step(Ptr<ExpressionGraph> graph,
   return nextState;
 }
 
+Ptr<DecoderState> EncoderDecoder::replayStep(Ptr<ExpressionGraph> graph,
+                                             Ptr<DecoderState> state,
+                                             const std::vector<IndexType>& hypIndices,
+                                             const Words& words,
+                                             const std::vector<IndexType>& batchIndices,
+                                             int beamSize) {
+  // for states that replayStep() accepts, selecting hypotheses builds no nodes
+  state = hypIndices.empty() ? state : state->select(hypIndices, batchIndices, beamSize);
+  return decoders_[0]->replayStep(graph, state, words);
+}
+
 Ptr<DecoderState> EncoderDecoder::stepAll(Ptr<ExpressionGraph> graph,
                                           Ptr<data::CorpusBatch> batch,
                                           bool clearGraph) {
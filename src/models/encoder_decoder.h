@@ -53,6 +53,17 @@ public:
                                  int beamSize)
       = 0;
 
+  // see DecoderBase::canReplayStep() and DecoderBase::replayStep()
+  virtual bool canReplayStep() = 0;
+
+  virtual Ptr<DecoderState> replayStep(Ptr<ExpressionGraph> graph,
+                                       Ptr<DecoderState> state,
+                                       const std::vector<IndexType>& hypIndices,
+                                       const Words& words,
+                                       const std::vector<IndexType>& batchIndices,
+                                       int beamSize)
+      = 0;
+
   virtual Ptr<Options> getOptions() = 0;
 
   virtual void setShortlistGenerator(
@@ -161,6 +172,15 @@ public:
                                  const std::vector<IndexType>& batchIndices,
                                  int beamSize) override;
 
+  virtual bool canReplayStep() override { return decoders_[0]->canReplayStep(); }
+
+  virtual Ptr<DecoderState> replayStep(Ptr<ExpressionGraph> graph,
+                                       Ptr<DecoderState> state,
+                                       const std::vector<IndexType>& hypIndices,
+                                       const Words& words,
+                                       const std::vector<IndexType>& batchIndices,
+                                       int beamSize) override;
+
   virtual Ptr<DecoderState> stepAll(Ptr<ExpressionGraph> graph,
                                     Ptr<data::CorpusBatch> batch,
                                     bool clearGraph = true);
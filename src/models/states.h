@@ -32,6 +32,22 @@ public:
     // Dimension -2 is OK for both, RNN and Transformer models as the encoder context in Transformer gets transposed to the same dimension layout
     return New<EncoderState>(index_select(context_, -2, batchIndices), index_select(mask_, -2, batchIndices), batch_);
   }
+
+  // Appends the batch entries of other to the batch entries of this state, the shorter of the two source
+  // lengths is padded with masked positions. The batch stays that of this state.
+  Ptr<EncoderState> append(Ptr<EncoderState> other) {
+    auto pad = [](Expr x, int length) { // x [..., length, batch size, dim] padded with zeros to length
+      auto shape = x->shape();
+      if(shape[-3] == length)
+        return x;
+      shape.set(-3, length - shape[-3]);
+      return concatenate({x, x->graph()->constant(shape, inits::zeros(), x->value_type())}, -3);
+    };
+    int length = std::max(context_->shape()[-3], other->context_->shape()[-3]);
+    return New<EncoderState>(concatenate({pad(context_, length), pad(other->context_, length)}, -2),
+                             concatenate({pad(mask_, length), pad(other->mask_, length)}, -2),
+                             batch_);
+  }
 };
 
 class DecoderState {
@@ -49,6 +65,9 @@ protected:
   size_t position_{0};
 
 public:
+  // row in the hypIndices of select() of a hypothesis that does not extend one of this state, see append()
+  static constexpr IndexType NEW_ROW = std::numeric_limits<IndexType>::max();
+
   DecoderState(const rnn::States& states,
                Logits logProbs,
                const std::vector<Ptr<EncoderState>>& encStates,
@@ -107,6 +126,15 @@ public:
   void setPosition(size_t position) { position_ = position; }
 
   virtual void blacklist(Expr /*totalCosts*/, Ptr<data::CorpusBatch> /*batch*/) {}
+
+  // Whether append() can add sentences to the batch of this state while it is being decoded
+  virtual bool canAppend() const { return false; }
+
+  // Appends the batch entries of the start state other, e.g. of sentences that join a batch while it is
+  // being decoded. Their hypotheses start in the next step, where they have no previous hypotheses.
+  virtual Ptr<DecoderState> append(Ptr<DecoderState> /*other*/) const {
+    ABORT("Sentences cannot be appended to this decoder state");
+  }
 };
 
 /**
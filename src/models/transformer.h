@@ -11,6 +11,8 @@
 #include "models/states.h"
 #include "models/transformer_factory.h"
 #include "rnn/constructors.h"
+#include "tensors/cpu/int8_attention.h"
+#include "tensors/cpu/kv_cache.h"
 #define _USE_MATH_DEFINES  // enables math constants. We need M_PI_2
 #include <math.h>
 
@@ -30,6 +32,7 @@ protected:
   using Base::options_; using Base::inference_; using Base::batchIndex_; using Base::graph_;
   std::unordered_map<std::string, Expr> cache_;    // caching transformation of the encoder that should not be created again
   mutable/*lazy*/ std::vector<float> sinusoidalEmbeddingsFreq_, sinusoidalEmbeddingsOffs_;  // cached contributions to sinusoidal embeddings
+  mutable Expr recordedPositions_; // positions constant of the last addPositionalEmbeddings() while the graph records, see rewritePositions()
 
   // attention weights produced by step()
   // If enabled, it is set once per batch during training, and once per step during translation.
@@ -57,6 +60,7 @@ public:
     int dimWords = input->shape()[-3];
 
     Expr embeddings = input;
+    recordedPositions_ = nullptr;
 
     if(trainPosEmbeddings) {
       int maxLength = opt<int>("max-length");
@@ -88,22 +92,16 @@ public:
       embeddings = std::sqrt((float)dimEmb) * embeddings; // embeddings were initialized to unit length; so norms will be in order of sqrt(dimEmb)
 
 #ifdef USE_ONNX // TODO 'Sin' op and constant sine generate different result. So, use constant when 'USE_ONNX' is not defined for now.
-      // precompute the arguments to sin() (the cos(x) are expressed as sin(x+pi/2))
-      if (sinusoidalEmbeddingsFreq_.empty()) {
-        auto numTimescales = dimEmb / 2;
-        for (size_t i = 0; i < dimEmb; i++) {
-          sinusoidalEmbeddingsFreq_.push_back((float)pow(1e-4, ((i % numTimescales) / (numTimescales - 1.0))));  // rotor frequency
-          sinusoidalEmbeddingsOffs_.push_back((float)          ((i / numTimescales) * M_PI_2                ));  // 0 (for sin) or pi/2 (for cos)
-        }
-      }
-      auto frequencies = graph_->constant({ dimEmb }, inits::fromVector(sinusoidalEmbeddingsFreq_));
-      auto cosOffsets  = graph_->constant({ dimEmb }, inits::fromVector(sinusoidalEmbeddingsOffs_));
       auto positionRange = graph_->constant({ dimWords, 1, 1 }, inits::range((float)start, (float)start + (float)dimWords));
       positionRange->set_name("data_" + std::to_string(batchIndex_) + "_posrange");
-      auto signal = sin(positionRange * frequencies + cosOffsets);
+      auto signal = sinusoidalSignal(positionRange, dimEmb);
+      if(graph_->isRecording())
+        recordedPositions_ = positionRange;
 #else // USE_ONNX
       auto signal = graph_->constant({dimWords, 1, dimEmb},
                                      inits::sinusoidalPositionEmbeddings(start));
+      if(graph_->isRecording())
+        recordedPositions_ = signal;
 #endif // USE_ONNX
 
       embeddings = embeddings + signal;
@@ -112,6 +110,68 @@ public:
     return embeddings;
   }
 
+#ifdef USE_ONNX
+  // sin() of the positions [..., 1] times the rotor frequencies, the cos(x) are expressed as sin(x+pi/2)
+  Expr sinusoidalSignal(Expr positions, int dimEmb) const {
+    // precompute the arguments to sin()
+    if (sinusoidalEmbeddingsFreq_.empty()) {
+      auto numTimescales = dimEmb / 2;
+      for (size_t i = 0; i < dimEmb; i++) {
+        sinusoidalEmbeddingsFreq_.push_back((float)pow(1e-4, ((i % numTimescales) / (numTimescales - 1.0))));  // rotor frequency
+        sinusoidalEmbeddingsOffs_.push_back((float)          ((i / numTimescales) * M_PI_2                ));  // 0 (for sin) or pi/2 (for cos)
+      }
+    }
+    auto frequencies = graph_->constant({ dimEmb }, inits::fromVector(sinusoidalEmbeddingsFreq_));
+    auto cosOffsets  = graph_->constant({ dimEmb }, inits::fromVector(sinusoidalEmbeddingsOffs_));
+    return sin(positions * frequencies + cosOffsets);
+  }
+#endif // USE_ONNX
+
+  // Same as addPositionalEmbeddings() for one word per batch entry, input [-4: beam depth, -3: 1,
+  // -2: batch size, -1: vector dim], where each batch entry is at its own position.
+  Expr addPositionalEmbeddings(Expr input, const std::vector<size_t>& positions, bool trainPosEmbeddings = false) const {
+    if(trainPosEmbeddings) // trained positions are not offset by the position of the step either
+      return addPositionalEmbeddings(input, 0, trainPosEmbeddings);
+
+    int dimEmb   = input->shape()[-1];
+    int dimBatch = input->shape()[-2];
+    ABORT_IF(input->shape()[-3] != 1 || positions.size() != dimBatch,
+             "Positions of {} batch entries do not fit one word of {} entries", positions.size(), dimBatch);
+    recordedPositions_ = nullptr;
+
+    auto embeddings = std::sqrt((float)dimEmb) * input; // see above
+#ifdef USE_ONNX
+    std::vector<float> rangeValues(positions.begin(), positions.end());
+    auto positionRange = graph_->constant({ dimBatch, 1 }, inits::fromVector(rangeValues));
+    positionRange->set_name("data_" + std::to_string(batchIndex_) + "_posrange");
+    auto signal = sinusoidalSignal(positionRange, dimEmb);
+    if(graph_->isRecording())
+      recordedPositions_ = positionRange;
+#else // USE_ONNX
+    auto signal = graph_->constant({dimBatch, dimEmb}, inits::sinusoidalPositionEmbeddings(positions));
+    if(graph_->isRecording())
+      recordedPositions_ = signal;
+#endif // USE_ONNX
+    return embeddings + signal;
+  }
+
+  // Rewrites the positions recorded by addPositionalEmbeddings() for words from start on, or for the
+  // batch entries at batchPositions if the recorded step had a position per batch entry. Trained
+  // positions are not rewritten, they are not offset by start.
+  void rewritePositions(int start, const std::vector<size_t>& batchPositions = {}) const {
+    if(!recordedPositions_)
+      return;
+#ifdef USE_ONNX
+    std::vector<float> rangeValues(batchPositions.begin(), batchPositions.end());
+    int dimWords = recordedPositions_->shape()[-3];
+    graph_->rewrite(recordedPositions_, batchPositions.empty() ? inits::range((float)start, (float)start + (float)dimWords)
+                                                               : inits::fromVector(rangeValues));
+#else // USE_ONNX
+    graph_->rewrite(recordedPositions_, batchPositions.empty() ? inits::sinusoidalPositionEmbeddings(start)
+                                                               : inits::sinusoidalPositionEmbeddings(batchPositions));
+#endif // USE_ONNX
+  }
+
   virtual Expr addSpecialEmbeddings(Expr input, int start = 0, Ptr<data::CorpusBatch> /*batch*/ = nullptr) const {
     bool trainPosEmbeddings = opt<bool>("transformer-train-positions", false);
     return addPositionalEmbeddings(input, start, trainPosEmbeddings);
@@ -225,21 +285,51 @@ public:
 
   // determine the multiplicative-attention probability and performs the associative lookup as well
   // q, k, and v have already been split into multiple heads, undergone any desired linear transform.
-  Expr Attention(std::string /*prefix*/,
+  // int8 heads of x [-4: batch size, -3: num heads, -2: rows, -1: cols] and their quantization multipliers,
+  // optionally transposed. Cached keys and values are quantized only once per batch.
+  std::pair<Expr, Expr> QuantizeHeads(const std::string& name, Expr x, bool cache, bool transpose = false) {
+    if(cache && cache_.count(name + "_int8") > 0 && cache_[name + "_int8_source"] == x)
+      return std::make_pair(cache_[name + "_int8"], cache_[name + "_int8_mults"]);
+
+    auto mults = cpu::integer::headQuantMults(x);
+    auto quantized = cpu::integer::quantizeHeads(x, mults, transpose);
+    if(cache) {
+      cache_[name + "_int8"] = quantized;
+      cache_[name + "_int8_mults"] = mults;
+      cache_[name + "_int8_source"] = x;
+    }
+    return std::make_pair(quantized, mults);
+  }
+
+  // --int8-attention: Q*K^T and weights*V in int8 on CPU during inference
+  bool isInt8Attention() const {
+    return inference_ && graph_->getDeviceId().type == DeviceType::cpu && opt<bool>("int8-attention", false);
+  }
+
+  Expr Attention(std::string prefix,
                  Expr q,              // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: split vector dim]
                  Expr k,              // [-4: batch size, -3: num heads, -2: max src length, -1: split vector dim]
                  Expr v,              // [-4: batch size, -3: num heads, -2: max src length, -1: split vector dim]
                  Expr mask = nullptr, // [-4: batch size, -3: num heads broadcast=1, -2: max length broadcast=1, -1: max length]
                  bool saveAttentionWeights = false,
-                 int dimBeam = 1) {
+                 int dimBeam = 1,
+                 bool cache = false) { // k and v are the cached encoder context
     int dk = k->shape()[-1];
+    bool int8 = isInt8Attention();
 
     // softmax over batched dot product of query and keys (applied over all
     // time steps and batch entries), also add mask for illegal connections
 
     // multiplicative attention with flattened softmax
     float scale = 1.0f / std::sqrt((float)dk); // scaling to avoid extreme values due to matrix multiplication
-    auto z = bdot(q, k, false, true, scale); // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: max src length]
+    Expr z;
+    if(int8) {
+      auto qq = QuantizeHeads(prefix + "_queries", q, /*cache=*/false);
+      auto kq = QuantizeHeads(prefix + "_keys", k, cache);
+      z = cpu::integer::bdotInt8(qq.first, qq.second, kq.first, kq.second, scale);
+    } else {
+      z = bdot(q, k, false, true, scale); // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: max src length]
+    }
 
     // mask out garbage beyond end of sequences
     z = z + mask;
@@ -254,7 +344,14 @@ public:
     weights = dropout(weights, inference_ ? 0 : opt<float>("transformer-dropout-attention"));
 
     // apply attention weights to values
-    auto output = bdot(weights, v);   // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: split vector dim]
+    Expr output;
+    if(int8) { // values are transposed so that both products run over contiguous rows
+      auto wq = QuantizeHeads(prefix + "_weights", weights, /*cache=*/false);
+      auto vq = QuantizeHeads(prefix + "_values", v, cache, /*transpose=*/true);
+      output = cpu::integer::bdotInt8(wq.first, wq.second, vq.first, vq.second, 1.f);
+    } else {
+      output = bdot(weights, v);   // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: split vector dim]
+    }
 
     return output;
   }
@@ -267,19 +364,26 @@ public:
                  const Expr &values, // [-4: beam depth, -3: batch size, -2: max kv length, -1: vector dim]
                  const Expr &mask,   // [-4: batch size, -3: num heads broadcast=1, -2: max length broadcast=1, -1: max length]
                  bool cache = false,
-                 bool saveAttentionWeights = false) {
+                 bool saveAttentionWeights = false,
+                 bool projectedKeysValues = false, // keys and values have already been transformed with _Wk/_Wv and split into heads
+                 Ptr<cpu::KVCache> kvCache = nullptr) { // see TransformerState, keys and values are then those of the current step, projected but not split
     int dimModel = q->shape()[-1];
     // @TODO: good opportunity to implement auto-batching here or do something manually?
     auto Wq = graph_->param(prefix + "_Wq", {dimModel, dimModel}, inits::glorotUniform());
     auto bq = graph_->param(prefix + "_bq", {       1, dimModel}, inits::zeros());
     auto qh = affine(q, Wq, bq);
+    if(kvCache)
+      return ProjectAttentionOutput(prefix, CachedAttention(qh, keys, values, mask, dimHeads, kvCache), dimOut);
     qh = SplitHeads(qh, dimHeads); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
 
     Expr kh;
     // Caching transformation of the encoder that should not be created again.
     // @TODO: set this automatically by memoizing encoder context and
     // memoization propagation (short-term)
-    if (cache                                                                          // if caching
+    if (projectedKeysValues) {
+      kh = keys; // [-4: batch size, -3: num heads, -2: max length, -1: split vector dim]
+    }
+    else if (cache                                                                     // if caching
         && cache_.count(prefix + "_keys") > 0                                          // and the keys expression has been seen
         && cache_[prefix + "_keys"]->shape().elements() == keys->shape().elements()) { // and the underlying element size did not change
       kh = cache_[prefix + "_keys"];                                                   // then return cached tensor
@@ -294,7 +398,9 @@ public:
     }
 
     Expr vh;
-    if (cache 
+    if (projectedKeysValues) {
+      vh = values;
+    } else if (cache
         && cache_.count(prefix + "_values") > 0 
         && cache_[prefix + "_values"]->shape().elements() == values->shape().elements()) {
       vh = cache_[prefix + "_values"];
@@ -311,10 +417,32 @@ public:
 
     // apply multi-head attention to downscaled inputs
     auto output
-        = Attention(prefix, qh, kh, vh, mask, saveAttentionWeights, dimBeam); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
+        = Attention(prefix, qh, kh, vh, mask, saveAttentionWeights, dimBeam, cache); // [-4: beam depth * batch size, -3: num heads, -2: max length, -1: split vector dim]
 
     output = JoinHeads(output, dimBeam); // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
 
+    return ProjectAttentionOutput(prefix, output, dimOut);
+  }
+
+  // Appends the keys and values of one decoder step to the cache and attends over all its positions with
+  // the queries of the step, reading the cached keys and values in place instead of splitting the whole
+  // history into heads.
+  Expr CachedAttention(Expr q,      // [-4: beam depth, -3: batch size, -2: 1, -1: vector dim]
+                       Expr keys,   // ...
+                       Expr values, // ...
+                       Expr mask,   // [-4: batch size, -3: num heads broadcast=1, -2: 1, -1: 1 or positions]
+                       int dimHeads,
+                       Ptr<cpu::KVCache> kvCache) {
+    int dk = q->shape()[-1] / dimHeads;
+    float scale = 1.0f / std::sqrt((float)dk);
+    std::vector<Expr> nodes = {q, keys, values};
+    if(mask)
+      nodes.push_back(mask);
+    return Expression<cpu::KVCacheAttentionNodeOp>(nodes, kvCache, dimHeads, scale); // [-4: beam depth, -3: batch size, -2: 1, -1: vector dim]
+  }
+
+  // output projection _Wo of MultiHead()
+  Expr ProjectAttentionOutput(const std::string& prefix, Expr output, int dimOut) {
     int dimAtt = output->shape()[-1];
 
     bool project = !opt<bool>("transformer-no-projection");
@@ -358,7 +486,9 @@ public:
                       const Expr& mask,   // [-4: batch size, -3: num heads broadcast=1, -2: max length broadcast=1, -1: max length]
                       int dimHeads,
                       bool cache = false,
-                      bool saveAttentionWeights = false) {
+                      bool saveAttentionWeights = false,
+                      bool projectedKeysValues = false,
+                      Ptr<cpu::KVCache> kvCache = nullptr) {
     int dimModel = input->shape()[-1];
 
     float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
@@ -366,7 +496,7 @@ public:
     auto output = preProcess(prefix + "_Wo", opsPre, input, dropProb);
 
     // multi-head self-attention over previous input
-    output = MultiHead(prefix, dimModel, dimHeads, output, keys, values, mask, cache, saveAttentionWeights);
+    output = MultiHead(prefix, dimModel, dimHeads, output, keys, values, mask, cache, saveAttentionWeights, projectedKeysValues, kvCache);
     
     auto opsPost = opt<std::string>("transformer-postprocess");
     output = postProcess(prefix + "_Wo", opsPost, output, input, dropProb);
@@ -379,9 +509,35 @@ public:
                                  std::string prefix,
                                  Expr input,
                                  Expr selfMask,
-                                 int startPos) {
+                                 int startPos,
+                                 Ptr<cpu::KVCache> kvCache = nullptr) { // see TransformerState
     selfMask = transposedLogMask(selfMask);
 
+    if(inference_) {
+      // During translation the keys and values of already generated target positions do not change,
+      // hence we keep their _Wk/_Wv projections and only project the current position. This avoids
+      // re-transforming the whole target history in every step.
+      int dimHeads = opt<int>("transformer-heads");
+      auto keys   = ProjectKeysOrValues(prefix, "k", input); // [-4: beam depth, -3: batch size, -2: 1, -1: vector dim]
+      auto values = ProjectKeysOrValues(prefix, "v", input);
+      if(kvCache) // appended in place to the buffers of the batch and read there by the attention
+        return LayerAttention(prefix, input, keys, values, selfMask, dimHeads, /*cache=*/false,
+                              /*saveAttentionWeights=*/false, /*projectedKeysValues=*/true, kvCache);
+
+      // kept in the decoder state (output = keys, cell = values)
+      if(startPos > 0) {
+        keys   = concatenate({prevdecoderLayerState.output, keys},   /*axis=*/-2);
+        values = concatenate({prevdecoderLayerState.cell,   values}, /*axis=*/-2);
+      }
+      decoderLayerState.output = keys;
+      decoderLayerState.cell   = values;
+      keys   = SplitHeads(keys,   dimHeads);
+      values = SplitHeads(values, dimHeads);
+
+      return LayerAttention(prefix, input, keys, values, selfMask, dimHeads, /*cache=*/false,
+                            /*saveAttentionWeights=*/false, /*projectedKeysValues=*/true);
+    }
+
     auto values = input;
     if(startPos > 0) {
       values = concatenate({prevdecoderLayerState.output, input}, /*axis=*/-2);
@@ -392,6 +548,14 @@ public:
                           opt<int>("transformer-heads"), /*cache=*/false);
   }
 
+  // linear transformation of keys ("k") or values ("v") as done inside MultiHead()
+  Expr ProjectKeysOrValues(const std::string& prefix, const std::string& kv, Expr input) {
+    int dimModel = input->shape()[-1];
+    auto W = graph_->param(prefix + "_W" + kv, {dimModel, dimModel}, inits::glorotUniform());
+    auto b = graph_->param(prefix + "_b" + kv, {1,        dimModel}, inits::zeros());
+    return affine(input, W, b); // [-4: beam depth, -3: batch size, -2: max length, -1: vector dim]
+  }
+
   static inline
   std::function<Expr(Expr)> activationByName(const std::string& actName)
   {
@@ -600,12 +764,51 @@ public:
 };
 
 class TransformerState : public DecoderState {
+private:
+  // When translating on the CPU, the self-attention keys and values of each layer are kept in a cache
+  // per layer that lives for the batch, and the layer states are empty. Selecting hypotheses only
+  // records which rows of the previous step the hypotheses of the next step extend.
+  std::vector<Ptr<cpu::KVCache>> kvCaches_;
+
+  // target position of each batch entry once sentences joined the batch at different steps, see append(),
+  // empty while all batch entries are at getPosition()
+  std::vector<size_t> batchPositions_;
+
+  static_assert(NEW_ROW == cpu::KVCache::NEW_ROW, "New hypotheses are new rows of the KV caches");
+
 public:
   TransformerState(const rnn::States& states,
                    Logits logProbs,
                    const std::vector<Ptr<EncoderState>>& encStates,
-                   Ptr<data::CorpusBatch> batch)
-      : DecoderState(states, logProbs, encStates, batch) {}
+                   Ptr<data::CorpusBatch> batch,
+                   const std::vector<Ptr<cpu::KVCache>>& kvCaches = {})
+      : DecoderState(states, logProbs, encStates, batch), kvCaches_(kvCaches) {}
+
+  const std::vector<Ptr<cpu::KVCache>>& getKVCaches() const { return kvCaches_; }
+
+  const std::vector<size_t>& getBatchPositions() const { return batchPositions_; }
+  void setBatchPositions(const std::vector<size_t>& batchPositions) { batchPositions_ = batchPositions; }
+
+  // Sentences can join the batch if the self-attention keys and values are in KV caches, which start
+  // the rows of the new sentences at the next position, see cpu::KVCache::NEW_ROW.
+  virtual bool canAppend() const override { return !kvCaches_.empty(); }
+
+  virtual Ptr<DecoderState> append(Ptr<DecoderState> other) const override {
+    ABORT_IF(!canAppend(), "Sentences can only join batches decoded with KV caches");
+    ABORT_IF(other->getEncoderStates().size() != encStates_.size(), "Appended state has different encoders");
+    std::vector<Ptr<EncoderState>> newEncStates;
+    for(size_t i = 0; i < encStates_.size(); ++i)
+      newEncStates.push_back(encStates_[i]->append(other->getEncoderStates()[i]));
+
+    auto appendedState = New<TransformerState>(states_, logProbs_, newEncStates, batch_, kvCaches_);
+    auto batchPositions = batchPositions_;
+    if(batchPositions.empty())
+      batchPositions.resize(encStates_[0]->getContext()->shape()[-2], getPosition());
+    batchPositions.resize(newEncStates[0]->getContext()->shape()[-2], 0); // the new sentences start at position 0
+    appendedState->setBatchPositions(batchPositions);
+    appendedState->setPosition(getPosition());
+    return appendedState;
+  }
 
   virtual Ptr<DecoderState> select(const std::vector<IndexType>& hypIndices,   // [beamIndex * activeBatchSize + batchIndex]
                                    const std::vector<IndexType>& batchIndices, // [batchIndex]
@@ -619,11 +822,24 @@ public:
       newEncStates.push_back(es->getContext()->shape()[-2] == batchIndices.size() ? es : es->select(batchIndices));
 
     // Create hypothesis-selected state based on current state and hyp indices
-    auto selectedState = New<TransformerState>(states_.select(hypIndices, beamSize, /*isBatchMajor=*/true), logProbs_, newEncStates, batch_); 
+    Ptr<TransformerState> selectedState;
+    if(!kvCaches_.empty()) {
+      for(auto& kvCache : kvCaches_)
+        kvCache->select(hypIndices);
+      selectedState = New<TransformerState>(states_, logProbs_, newEncStates, batch_, kvCaches_);
+    } else {
+      selectedState = New<TransformerState>(states_.select(hypIndices, beamSize, /*isBatchMajor=*/true), logProbs_, newEncStates, batch_);
+    }
 
     // Set the same target token position as the current state
     // @TODO: This is the same as in base function.
     selectedState->setPosition(getPosition());
+    if(!batchPositions_.empty()) {
+      std::vector<size_t> batchPositions;
+      for(auto batchIndex : batchIndices)
+        batchPositions.push_back(batchPositions_[batchIndex]);
+      selectedState->setBatchPositions(batchPositions);
+    }
     return selectedState;
   }
 };
@@ -638,6 +854,13 @@ private:
   // To be removed after refactoring of transformer.h
   std::unordered_map<std::string, Ptr<rnn::RNN>> perLayerRnn_;
 
+  // word indices of the last step if it was built while the graph was recording, see replayStep()
+  Expr recordedWords_;
+
+  // encoder contexts that the entries of cache_ were computed from, they are recomputed when sentences
+  // leave or join the batch
+  std::vector<Expr> cachedContexts_;
+
 private:
   // @TODO: move this out for sharing with other models
   void lazyCreateOutputLayer()
@@ -682,10 +905,63 @@ public:
     }
     else {
       rnn::States startStates;
-      return New<TransformerState>(startStates, Logits(), encStates, batch);
+      std::vector<Ptr<cpu::KVCache>> kvCaches;
+      if(inference_ && layerType == "self-attention" && graph->getDeviceId().type == DeviceType::cpu
+         && opt<bool>("transformer-kv-cache", true)) {
+        // the cached self-attention computes in float, --int8-attention then only applies to the other attentions;
+        // sized like the search: beam size hypotheses of up to max-length-factor * source length words
+        size_t rows = opt<size_t>("beam-size", 1) * batch->size();
+        size_t positions = (size_t)std::ceil(opt<float>("max-length-factor", 3.f) * batch->front()->batchWidth()) + 1;
+        int dimModel = opt<int>("dim-emb");
+        for(int i = 0; i < opt<int>("dec-depth"); ++i)
+          kvCaches.push_back(New<cpu::KVCache>(dimModel, rows, positions));
+      }
+      return New<TransformerState>(startStates, Logits(), encStates, batch, kvCaches);
     }
   }
 
+  // While the graph records, the words of a step with a KV cache go into a constant of their own
+  // that replayStep() rewrites.
+  virtual void embeddingsFromPrediction(Ptr<ExpressionGraph> graph,
+                                        Ptr<DecoderState> state,
+                                        const Words& words,
+                                        int dimBatch,
+                                        int dimBeam) override {
+    recordedWords_ = nullptr;
+    auto transformerState = std::dynamic_pointer_cast<TransformerState>(state);
+    auto embedding = std::dynamic_pointer_cast<Embedding>(getEmbeddingLayer()); // not ULR
+    if(!graph->isRecording() || words.empty() || !transformerState || transformerState->getKVCaches().empty()
+       || !embedding)
+      return Base::embeddingsFromPrediction(graph, state, words, dimBatch, dimBeam);
+
+    graph_ = graph;
+    recordedWords_ = graph_->indices(toWordIndexVector(words));
+    auto selectedEmbs = embedding->applyIndices(recordedWords_, {dimBeam, 1, dimBatch, opt<int>("dim-emb")});
+    state->setTargetHistoryEmbeddings(selectedEmbs);
+  }
+
+  virtual bool canReplayStep() const override { return recordedWords_ != nullptr; }
+
+  // The self-attention of the recorded step reads the KV caches, which select() reorders without
+  // building nodes, so only the words and the position have to be rewritten.
+  virtual Ptr<DecoderState> replayStep(Ptr<ExpressionGraph> graph,
+                                       Ptr<DecoderState> state,
+                                       const Words& words) override {
+    ABORT_IF(!canReplayStep(), "No decoder step has been recorded");
+    ABORT_IF(words.size() != recordedWords_->shape().elements(),
+             "Decoder step was recorded for {} words, but {} were passed", recordedWords_->shape().elements(), words.size());
+    auto transformerState = std::dynamic_pointer_cast<TransformerState>(state);
+    graph->rewrite(recordedWords_, inits::fromVector(toWordIndexVector(words)));
+    rewritePositions((int)state->getPosition(), transformerState->getBatchPositions());
+
+    // the logits of the state are those of the recorded step
+    auto nextState = New<TransformerState>(
+      state->getStates(), state->getLogProbs(), state->getEncoderStates(), state->getBatch(), transformerState->getKVCaches());
+    nextState->setPosition(state->getPosition() + 1);
+    nextState->setBatchPositions(nextBatchPositions(transformerState->getBatchPositions()));
+    return nextState;
+  }
+
   virtual Ptr<DecoderState> step(Ptr<ExpressionGraph> graph,
                                  Ptr<DecoderState> state) override {
     ABORT_IF(graph != graph_, "An inconsistent graph parameter was passed to step()");
@@ -693,9 +969,19 @@ public:
     return step(state);
   }
 
+  static std::vector<size_t> nextBatchPositions(std::vector<size_t> batchPositions) {
+    for(auto& position : batchPositions)
+      position++;
+    return batchPositions;
+  }
+
   Ptr<DecoderState> step(Ptr<DecoderState> state) {
     auto embeddings  = state->getTargetHistoryEmbeddings(); // [-4: beam depth=1, -3: max length, -2: batch size, -1: vector dim]
     auto decoderMask = state->getTargetMask();              // [max length, batch size, 1]  --this is a hypothesis
+    auto transformerState = std::dynamic_pointer_cast<TransformerState>(state);
+    std::vector<size_t> batchPositions; // see TransformerState::append()
+    if(transformerState)
+      batchPositions = transformerState->getBatchPositions();
 
     //************************************************************************//
 
@@ -708,7 +994,19 @@ public:
     // Used for position embeddings and creating new decoder states.
     int startPos = (int)state->getPosition();
 
-    auto scaledEmbeddings = addSpecialEmbeddings(embeddings, startPos);
+    Expr scaledEmbeddings;
+    if(batchPositions.empty()) {
+      scaledEmbeddings = addSpecialEmbeddings(embeddings, startPos);
+    } else {
+      // sentences that just joined the batch start with the zero embedding, like all sentences in the first step
+      if(std::find(batchPositions.begin(), batchPositions.end(), 0) != batchPositions.end()) {
+        std::vector<float> started;
+        for(auto position : batchPositions)
+          started.push_back(position > 0 ? 1.f : 0.f);
+        embeddings = embeddings * graph_->constant({(int)batchPositions.size(), 1}, inits::fromVector(started));
+      }
+      scaledEmbeddings = addPositionalEmbeddings(embeddings, batchPositions, opt<bool>("transformer-train-positions", false));
+    }
     scaledEmbeddings = atleast_nd(scaledEmbeddings, 4);
 
     // reorganize batch and timestep
@@ -734,6 +1032,13 @@ public:
     // gather encoder contexts
     std::vector<Expr> encoderContexts;
     std::vector<Expr> encoderMasks;
+    std::vector<Expr> contexts;
+    for(auto encoderState : state->getEncoderStates())
+      contexts.push_back(encoderState->getContext());
+    if(contexts != cachedContexts_) { // e.g. sentences left or joined the batch, which may keep the shapes
+      cache_.clear();
+      cachedContexts_ = contexts;
+    }
     for(auto encoderState : state->getEncoderStates()) {
       auto encoderContext = encoderState->getContext(); // encoder output
       auto encoderMask = encoderState->getMask(); // note: may differ from Encoder self-attention mask in that additional positions are banned for cross-attention
@@ -765,6 +1070,9 @@ public:
 
     rnn::States prevDecoderStates = state->getStates();
     rnn::States decoderStates;
+    std::vector<Ptr<cpu::KVCache>> kvCaches;
+    if(transformerState && dimTrgWords == 1) // e.g. not when scoring a whole target sentence at once
+      kvCaches = transformerState->getKVCaches();
     // apply decoder layers
     auto decDepth = opt<int>("dec-depth");
     std::vector<size_t> tiedLayers = opt<std::vector<size_t>>("transformer-tied-layers",
@@ -787,7 +1095,8 @@ public:
       std::string layerType = opt<std::string>("transformer-decoder-autoreg", "self-attention");
       rnn::State decoderState;
       if(layerType == "self-attention")
-        query = DecoderLayerSelfAttention(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_self", query, selfMask, startPos);
+        query = DecoderLayerSelfAttention(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_self", query, selfMask, startPos,
+                                          kvCaches.empty() ? nullptr : kvCaches[i]);
       else if(layerType == "average-attention")
         query = DecoderLayerAAN(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_aan", query, selfMask, startPos);
       else if(layerType == "rnn")
@@ -872,8 +1181,10 @@ public:
       nextState = New<DecoderState>(
         decoderStates, logits, state->getEncoderStates(), state->getBatch());
     } else {
-      nextState = New<TransformerState>(
-        decoderStates, logits, state->getEncoderStates(), state->getBatch());
+      auto nextTransformerState = New<TransformerState>(
+        decoderStates, logits, state->getEncoderStates(), state->getBatch(), kvCaches);
+      nextTransformerState->setBatchPositions(nextBatchPositions(batchPositions));
+      nextState = nextTransformerState;
     }
     nextState->setPosition(state->getPosition() + 1);
     return nextState;
@@ -889,8 +1200,11 @@ public:
     if (output_)
       output_->clear();
     cache_.clear();
+    cachedContexts_.clear();
     alignments_.clear();
     perLayerRnn_.clear(); // this needs to be cleared between batches. 
+    recordedWords_ = nullptr;
+    recordedPositions_ = nullptr;
     // @TODO: figure out how to detect stale nodes i.e. nodes that are referenced, 
     // but where underlying memory has been deallocated by dropping all tensors 
     // from a TensorAllocator object. This can happen during ExpressionGraph::clear()
@@ -46,6 +46,7 @@ namespace marian {
       vocabs.emplace_back(vocab);
     }
     setInference(true);  // note: must also set "inference" parameter on options
+    modelOptions->set("transformer-kv-cache", false); // decoder states must be expressions to be exported
 
     // if we must suppress <unk>, we do that by patching the bias
     const auto trgUnkId = vocabs.back()->getUnkId();
@@ -33,13 +33,27 @@ struct State {
     int dimTime  = isBatchMajor ? sel->shape()[-2] : sel->shape()[-3];
 
     ABORT_IF(dimTime != 1 && !isBatchMajor, "unexpected time extent for RNN state"); // (the reshape()/rows() trick won't work in this case)
+    Shape selShape = { beamSize, isBatchMajor ? dimBatch : dimTime, isBatchMajor ? dimTime : dimBatch, dimDepth };
+
+    // nothing gets reordered or dropped (e.g. greedy search without finished sentences),
+    // return as is instead of copying the state, which for the Transformer grows with each step
+    if(sel->shape() == selShape && isIdentity(selIdx))
+      return sel;
+
     int numCols = isBatchMajor ? dimDepth * dimTime : dimDepth;
     // @TODO: Can this complex operation be more easily written using index_select()?
     sel = reshape(sel, { sel->shape().elements() / numCols, numCols }); // [beamSize * dimBatch, dimDepth] or [beamSize * dimBatch, dimTime * dimDepth]
     sel = rows(sel, selIdx);
-    sel = reshape(sel, { beamSize, isBatchMajor ? dimBatch : dimTime, isBatchMajor ? dimTime : dimBatch, dimDepth });
+    sel = reshape(sel, selShape);
     return sel;
   }
+
+  static bool isIdentity(const std::vector<IndexType>& selIdx) {
+    for(size_t i = 0; i < selIdx.size(); ++i)
+      if(selIdx[i] != (IndexType)i)
+        return false;
+    return true;
+  }
 };
 
 class States {
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <deque>
+#include <map>
 #include <memory>
 #include <set>
 #include <unordered_map>
@@ -87,9 +88,20 @@ private:
 
   bool throw_{false};
 
-  std::set<Gap> gaps_;
+  std::set<Gap> gaps_;                      // free gaps ordered by size for best-fit allocation
+  std::map<uint8_t*, size_t> gapsByAddress_; // the same gaps ordered by address to find adjacent gaps in logarithmic time
   std::unordered_map<uint8_t*, MemoryPiece::PtrType> allocated_;
 
+  void addGap(const Gap& gap) {
+    gaps_.insert(gap);
+    gapsByAddress_[gap.data()] = gap.size();
+  }
+
+  void removeGap(const Gap& gap) {
+    gaps_.erase(gap);
+    gapsByAddress_.erase(gap.data());
+  }
+
   void grow(size_t add) {
     add = alignedSize(add);
     uint8_t* oldData = device_->data();
@@ -99,10 +111,11 @@ private:
 
     std::set<Gap> oldGaps;
     gaps_.swap(oldGaps);
+    gapsByAddress_.clear();
 
     for(auto gap : oldGaps)
-      gaps_.insert(Gap(device_->data() + std::distance(oldData, gap.data()),
-                       gap.size()));
+      addGap(Gap(device_->data() + std::distance(oldData, gap.data()),
+                 gap.size()));
     insertGap(Gap(device_->data() + oldSize, add));
 
     std::unordered_map<uint8_t*, MemoryPiece::PtrType> oldAllocated;
@@ -116,7 +129,7 @@ private:
 
   Gap getGap(size_t size) {
     size = alignedSize(size);
-    auto it = std::lower_bound(gaps_.begin(), gaps_.end(), Gap(nullptr, size));
+    auto it = gaps_.lower_bound(Gap(nullptr, size)); // member lower_bound, std::lower_bound would be linear on set iterators
 
     if(throw_ && it == gaps_.end()) {
       //ABORT("Trying to allocate {}, but only {} available.", available_, size);
@@ -126,11 +139,11 @@ private:
     // @TODO: compact memory before re-allocation attempt, maybe by left shifting memory over currently largest gap
     while(it == gaps_.end()) {
       grow(step_);
-      it = std::lower_bound(gaps_.begin(), gaps_.end(), Gap(nullptr, size));
+      it = gaps_.lower_bound(Gap(nullptr, size));
     }
 
     Gap gap = *it;
-    gaps_.erase(it);
+    removeGap(gap);
 
     available_ -= gap.size();
     return gap;
@@ -139,19 +152,24 @@ private:
   void insertGap(Gap gap, bool consolidate = true) {
     available_ += gap.size();
     if(consolidate) {
-      auto it = gaps_.begin();
-      std::vector<decltype(it)> adjacent;
-      while(it != gaps_.end()) {
-        if(gap.adjacent(*it)) {
-          gap = gap.combine(*it);
-          adjacent.push_back(it);
+      // gaps never overlap, so there can be at most one adjacent gap on each side
+      auto next = gapsByAddress_.lower_bound(gap.data());
+      if(next != gapsByAddress_.end() && gap.data() + gap.size() == next->first) {
+        Gap nextGap(next->first, next->second);
+        ++next;
+        removeGap(nextGap);
+        gap = gap.combine(nextGap);
+      }
+      if(next != gapsByAddress_.begin()) {
+        auto prev = std::prev(next);
+        if(prev->first + prev->second == gap.data()) {
+          Gap prevGap(prev->first, prev->second);
+          removeGap(prevGap);
+          gap = gap.combine(prevGap);
         }
-        it++;
       }
-      for(auto&& a : adjacent)
-        gaps_.erase(a);
     }
-    gaps_.insert(gap);
+    addGap(gap);
   }
 
 public:
@@ -176,7 +194,7 @@ public:
   }
 
   size_t alignedSize(size_t size) {
-    return (size_t)(ceil(size / (double)alignment_) * alignment_);
+    return (size + alignment_ - 1) / alignment_ * alignment_;
   }
 
   void throwAtReallocation(bool throwRealloc) { throw_ = throwRealloc; }
@@ -240,6 +258,7 @@ public:
   void clear() {
     available_ = 0;
     gaps_.clear();
+    gapsByAddress_.clear();
     allocated_.clear();
     insertGap({device_->data(), device_->size()}, false);
   }
@@ -4,7 +4,11 @@
 #include <random>
 
 #include "common/config.h"
+#include "common/utils.h"
+#include "graph/auto_tuner.h"
 #include "tensors/backend.h"
+#include "tensors/cpu/column_cache.h"
+#include "tensors/cpu/intra_op_pool.h"
 
 namespace marian {
 namespace cpu {
@@ -16,8 +20,14 @@ protected:
   bool shifted_{false};
   bool shiftedAll_{false};
   bool dumpMatrices_{false};
+  bool calibrateAlphas_{false};
   bool alpha_{false};
   bool legacyBatch_{false};
+  Ptr<ColumnSelectionCache> columnCache_;
+  Ptr<IntraOpPool> intraOpPool_;
+  bool autoTune_{false};
+  std::vector<std::string> autoTuneKernels_;
+  Ptr<AutoTunerCache> autoTunerCache_;
 
   void setGemmPrecision(Ptr<const Options> options) {
     std::string gemmPrecision = options->get<std::string>("gemm-precision");
@@ -26,9 +36,21 @@ protected:
       setShifted(true);
       setShiftedAll(true);
       setDumpQuantMult(true);
+    } else if (!options->get<std::string>("calibrate-alphas", "").empty()) {
+      // Same activations as with precomputed alphas, quantized on the fly
+      setInt8(true);
+      setShifted(true);
+      setShiftedAll(gemmPrecision == "int8shiftAlphaAll");
+      calibrateAlphas_ = true;
       //float32, int16, int8, int8shift, int8shiftAlpha, int8shiftAll, int8shiftAlphaAll
     } else if (gemmPrecision == "float32") {
       return; // This is the default precisoin.
+    } else if (gemmPrecision == "auto") {
+      autoTune_ = true;
+      autoTuneKernels_ = options->get<std::vector<std::string>>("gemm-autotune-kernels", {"float32"});
+      auto path = options->get<std::string>("gemm-autotune-file", "");
+      if(!path.empty())
+        autoTunerCache_ = AutoTunerCache::open(path);
     } else if (gemmPrecision == "int16") {
       setInt16(true);
     } else if (gemmPrecision == "int8") {
@@ -67,6 +89,14 @@ public:
     setClip(options->get<float>("clip-gemm"));
     setGemmPrecision(options);
     setLegacyBatchedGemm(options->get<bool>("use-legacy-batching"));
+
+    auto cacheSizeMB = options->get<size_t>("shortlist-weights-cache", 0);
+    columnCache_ = cacheSizeMB > 0 ? New<ColumnSelectionCache>(cacheSizeMB * 1024 * 1024) : nullptr;
+
+    // with --worker-cores the worker of this device is pinned to the first of its cores, see WorkerPool
+    auto intraOpThreads = options->get<size_t>("cpu-intra-op-threads", 1);
+    auto cores = utils::workerCores(options->get<std::vector<size_t>>("worker-cores", {}), deviceId_.no, intraOpThreads);
+    intraOpPool_ = intraOpThreads > 1 ? New<IntraOpPool>(intraOpThreads, cores) : nullptr;
   }
 
   void synchronize() override {}
@@ -113,6 +143,9 @@ public:
     return dumpMatrices_;
   }
 
+  // whether activation maxima are collected for --calibrate-alphas
+  bool isCalibratingAlphas() const { return calibrateAlphas_; }
+
   void setPrecomputedAlpha(bool alpha) override {
     alpha_ = alpha;
   }
@@ -127,6 +160,17 @@ public:
     return legacyBatch_;
   }
 
+  // --gemm-precision auto: choose the fastest of the given GEMM kernels per matrix size
+  bool isGemmAutoTuned() { return autoTune_; }
+  const std::vector<std::string>& getGemmAutoTuneKernels() { return autoTuneKernels_; }
+  Ptr<AutoTunerCache> getAutoTunerCache() { return autoTunerCache_; }
+
+  // cache of shortlisted output weights, nullptr if disabled
+  Ptr<ColumnSelectionCache> getColumnSelectionCache() { return columnCache_; }
+
+  // threads splitting single operators (--cpu-intra-op-threads), nullptr if operators run on the calling thread
+  Ptr<IntraOpPool> getIntraOpPool() { return intraOpPool_; }
+
 };
 }  // namespace cpu
 }  // namespace marian
@@ -0,0 +1,71 @@
+#include "tensors/cpu/column_cache.h"
+#include "common/logging.h"
+#include "tensors/cpu/aligned.h"
+
+namespace marian {
+namespace cpu {
+
+ColumnSelectionCache::Block::Block(size_t size)
+    : data_((uint8_t*)genericMalloc(256, size)), size_(size) {}
+
+ColumnSelectionCache::Block::~Block() {
+  genericFree(data_);
+}
+
+ColumnSelectionCache::~ColumnSelectionCache() {
+  if(hits_ + misses_ > 0)
+    LOG(info,
+        "Shortlist weights cache: {} hits, {} misses ({:.1f}% hit rate), {} evictions, {} entries using {} bytes",
+        hits_, misses_, 100.f * hits_ / (hits_ + misses_), evictions_, entries_.size(), bytes_);
+}
+
+std::string ColumnSelectionCache::key(const void* source, Type type, const std::vector<uint_least32_t>& indices) {
+  std::string key((const char*)&source, sizeof(source));
+  key.append((const char*)&type, sizeof(type));
+  key.append((const char*)indices.data(), indices.size() * sizeof(uint_least32_t));
+  return key;
+}
+
+Ptr<ColumnSelectionCache::Block> ColumnSelectionCache::find(const void* source,
+                                                            Type type,
+                                                            const std::vector<uint_least32_t>& indices) {
+  auto k = key(source, type, indices);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(k);
+  if(it == index_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  entries_.splice(entries_.begin(), entries_, it->second); // mark as most recently used
+  return it->second->block;
+}
+
+void ColumnSelectionCache::put(const void* source,
+                               Type type,
+                               const std::vector<uint_least32_t>& indices,
+                               Ptr<Block> block) {
+  Entry entry{key(source, type, indices), block};
+  size_t bytes = 2 * entry.key.size() + block->size(); // the key is stored twice
+  if(bytes > maxBytes_)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(index_.count(entry.key) > 0) // selected concurrently
+    return;
+
+  while(bytes_ + bytes > maxBytes_) { // evict least recently used, blocks still in use are freed by their users
+    const auto& last = entries_.back();
+    bytes_ -= 2 * last.key.size() + last.block->size();
+    index_.erase(last.key);
+    entries_.pop_back();
+    evictions_++;
+  }
+
+  entries_.push_front(std::move(entry));
+  index_[entries_.front().key] = entries_.begin();
+  bytes_ += bytes;
+}
+
+}  // namespace cpu
+}  // namespace marian
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/types.h"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// LRU cache of column selections of quantized output matrices (see --shortlist-weights-cache), so that
+// batches with the same shortlist reuse the selected columns instead of copying them again. Keyed by the
+// memory of the selected matrix, which therefore has to be a parameter, and the selected column indices.
+// Blocks stay valid while they are referenced, also after they have been evicted. Thread-safe.
+class ColumnSelectionCache {
+public:
+  // 256-byte aligned memory holding one column selection
+  class Block {
+  public:
+    Block(size_t size);
+    ~Block();
+    Block(const Block&) = delete;
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    uint8_t* data_;
+    size_t size_;
+  };
+
+  ColumnSelectionCache(size_t maxBytes) : maxBytes_(maxBytes) {}
+  ~ColumnSelectionCache(); // logs hit, miss and eviction counts
+
+  // returns the cached selection of the given columns or nullptr
+  Ptr<Block> find(const void* source, Type type, const std::vector<uint_least32_t>& indices);
+
+  // stores a block filled with the selection of the given columns
+  void put(const void* source, Type type, const std::vector<uint_least32_t>& indices, Ptr<Block> block);
+
+private:
+  struct Entry {
+    std::string key;
+    Ptr<Block> block;
+  };
+
+  static std::string key(const void* source, Type type, const std::vector<uint_least32_t>& indices);
+
+  size_t maxBytes_;
+
+  std::list<Entry> entries_; // most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  size_t bytes_{0};
+
+  size_t hits_{0};
+  size_t misses_{0};
+  size_t evictions_{0};
+
+  std::mutex mutex_;
+};
+
+}  // namespace cpu
+}  // namespace marian
@@ -3,6 +3,7 @@
 #include "graph/expression_graph.h"
 #include "fbgemm/packed_gemm.h"
 #include "tensors/cpu/integer_common.h"
+#include "tensors/cpu/int4_gemm.h"
 
 namespace { //Temporary annonymous transposition, until we figure out how to access the proper one
 inline void transpose4x4_SSE(const float* A,
@@ -61,6 +62,7 @@ namespace marian {
 class ExpressionGraphPackable : public ExpressionGraph {
 public:
   bool compressWemb = true;
+  bool quantizePerColumn = false; // intgemm8: one quantization multiplier per output column, stored as <W>_QuantMultBCols
   ExpressionGraphPackable()
     : ExpressionGraph( /* inference =  */ true) {} // Packable expression graph only supports inference
 
@@ -68,7 +70,9 @@ public:
 
   // Convert model weights into packed format and save to IO items.
   // @TODO: review this
-  void packAndSave(const std::string& name, const std::string& meta, Type gemmElementType = Type::float32, Type saveElementType = Type::float32) {
+  // extraItems (e.g. a precomputed LSH index) are saved as they are.
+  void packAndSave(const std::string& name, const std::string& meta, Type gemmElementType = Type::float32, Type saveElementType = Type::float32,
+                   const std::vector<io::Item>& extraItems = {}) {
     std::vector<io::Item> ioItems;
 
     // sorted by name in std::map
@@ -211,6 +215,27 @@ public:
           ABORT("Int8::PrepareA is not implemented for wasm.");
 #elif defined(USE_INTGEMM)
           float quantMult = 127.0f / intgemm::MaxAbsolute(val->data(), val->data() + val->shape().elements());
+          // The output layer keeps a single multiplier as shortlisting selects columns of the packed matrix
+          if (quantizePerColumn && tmp != val && pName.find("ff_logit_out") == std::string::npos) {
+            // After the transpose each row of tmp is a column of the matrix. Scale it to the full int8 range
+            // and quantize with 1, the multipliers are applied to the output of the product.
+            int columns = cols(val);
+            int inner = rows(val);
+            io::Item multsItem;
+            multsItem.name = pName + "_QuantMultBCols";
+            multsItem.shape = Shape({1, columns});
+            multsItem.type = Type::float32;
+            multsItem.bytes.resize(columns * sizeof(float));
+            float* columnMults = reinterpret_cast<float*>(multsItem.bytes.data());
+            for (int j = 0; j < columns; ++j) {
+              float* column = tmp->data() + (size_t)j * inner;
+              columnMults[j] = 127.0f / std::max(intgemm::MaxAbsolute(column, column + inner), 1e-10f);
+              for (int i = 0; i < inner; ++i)
+                column[i] *= columnMults[j];
+            }
+            ioItems.emplace_back(std::move(multsItem));
+            quantMult = 1.0f;
+          }
           intgemm::Int8::PrepareA(tmp->data(), /*input*/
                                 paramMat->data<int8_t>(), /*output*/
                                 quantMult, /*Quant Mult*/
@@ -251,6 +276,28 @@ public:
 #else
 ABORT("Packed type {} only supported when compiled with -COMPILE_CPU=on", gemmElementType);
 #endif
+      } else if (gemmElementType == Type::int4grouped
+                 && (pName.find("_W") == pName.length() - 3 || pName.find("_W") == pName.length() - 2)
+                 && pName.find("ff_logit_out") == std::string::npos // output layer is used transposed and shortlisted
+                 && cpu::int4::isPackable(val->shape().elements() / val->shape()[-1], val->shape()[-1])) {
+        int cols = val->shape()[-1];
+        int rows = val->shape().elements() / cols;
+        auto allocator = New<TensorAllocator>(getBackend());
+
+        Tensor packedTensor;
+        allocator->allocate(packedTensor, val->shape(), Type::int4grouped);
+        cpu::int4::pack(val->data(), rows, cols, packedTensor->data<uint8_t>());
+
+        // The layout is architecture agnostic and can be memory-mapped as it is.
+        io::Item item;
+        item.name = pName;
+        item.shape = val->shape();
+        item.type = Type::int4grouped;
+
+        auto mem = packedTensor->memory();
+        item.bytes.resize(mem->size());
+        copy(backend_, mem->data<char>(), mem->data<char>() + mem->size(), item.bytes.data());
+        ioItems.emplace_back(std::move(item));
       } else {
         io::Item item;
         val->get(item, pName);
@@ -259,6 +306,8 @@ ABORT("Packed type {} only supported when compiled with -COMPILE_CPU=on", gemmEl
       }
     }
 
+    ioItems.insert(ioItems.end(), extraItems.begin(), extraItems.end());
+
     if (!meta.empty())
       io::addMetaToItems(meta, "special:model.yml", ioItems);
     io::saveItems(name, ioItems);
@@ -0,0 +1,177 @@
+#pragma once
+
+// Weight-only 4-bit quantization for CPU inference (Type::int4grouped). Weight matrices are stored with
+// 4 bits per value and a scale per group of consecutive values along the inner dimension. The product
+// unpacks them to int8 in registers and multiplies them with the activations quantized to int8 on the
+// fly, so the weights never exist as floats. Decoding with small batches is bound by memory bandwidth,
+// which this halves compared to int8 models.
+//
+// Layout of a [rows x cols] matrix (rows = inner dimension) is architecture agnostic and used as stored:
+// for each column, rows / 2 bytes of values, followed by cols * (rows / GROUP) float scales. Within a
+// group of GROUP values the i-th byte holds value i in its low and value i + GROUP / 2 in its high
+// nibble, each as q + 8 for q in [-7, 7].
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) && !defined(ARM)
+#include <immintrin.h>
+#endif
+
+namespace marian {
+namespace cpu {
+namespace int4 {
+
+const int GROUP = 32; // values of a column that share a scale
+
+inline size_t valueBytes(int rows, int cols) {
+  return (size_t)rows * cols / 2;
+}
+
+// bytes of a packed [rows x cols] matrix
+inline size_t packedBytes(int rows, int cols) {
+  return valueBytes(rows, cols) + (size_t)cols * (rows / GROUP) * sizeof(float);
+}
+
+inline bool isPackable(int rows, int /*cols*/) {
+  return rows % GROUP == 0;
+}
+
+// Packs W [rows x cols], row-major, with scale maxAbs / 7 for each group
+inline void pack(const float* W, int rows, int cols, uint8_t* out) {
+  int groups = rows / GROUP;
+  float* scales = reinterpret_cast<float*>(out + valueBytes(rows, cols));
+  for(int j = 0; j < cols; ++j) {
+    uint8_t* column = out + (size_t)j * rows / 2;
+    for(int g = 0; g < groups; ++g) {
+      float maxAbs = 0.f;
+      for(int i = 0; i < GROUP; ++i)
+        maxAbs = std::max(maxAbs, std::abs(W[(size_t)(g * GROUP + i) * cols + j]));
+      float scale = maxAbs > 0.f ? maxAbs / 7.f : 1.f;
+      scales[(size_t)j * groups + g] = scale;
+
+      uint8_t* bytes = column + g * GROUP / 2;
+      for(int i = 0; i < GROUP; ++i) {
+        int q = (int)std::round(W[(size_t)(g * GROUP + i) * cols + j] / scale);
+        uint8_t nibble = (uint8_t)(std::max(-7, std::min(7, q)) + 8);
+        if(i < GROUP / 2)
+          bytes[i] = nibble;
+        else
+          bytes[i - GROUP / 2] |= nibble << 4;
+      }
+    }
+  }
+}
+
+// Dot product of GROUP int8 activations with the GROUP / 2 bytes of a group of weights
+inline int32_t dotGroup(const int8_t* a, const uint8_t* b) {
+  int32_t sum = 0;
+  for(int i = 0; i < GROUP / 2; ++i) {
+    sum += (int32_t)a[i] * ((b[i] & 0x0F) - 8);
+    sum += (int32_t)a[i + GROUP / 2] * ((b[i] >> 4) - 8);
+  }
+  return sum;
+}
+
+#if defined(__AVX2__) && !defined(ARM)
+// GROUP int8 weights of a group, unpacked in a register
+inline __m256i unpackGroup(const uint8_t* b) {
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+  __m128i lo = _mm_and_si128(bytes, mask);
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+  __m256i values = _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+  return _mm256_sub_epi8(values, _mm256_set1_epi8(8));
+}
+
+// 8 partial sums of a * b as int32
+inline __m256i dotGroup(__m256i a, __m256i b) {
+  // maddubs multiplies unsigned with signed values, move the sign of b to a. |a * b| <= 127 * 7, so the
+  // sums of pairs do not saturate.
+  __m256i products = _mm256_maddubs_epi16(_mm256_sign_epi8(b, b), _mm256_sign_epi8(a, b));
+  return _mm256_madd_epi16(products, _mm256_set1_epi16(1));
+}
+
+inline float horizontalSum(__m256 x) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+}
+#endif
+
+// Rows of A [m x rows] quantized to int8 with their own multiplier, aUnquant gets scale / multiplier
+inline void quantizeRows(const float* A, int m, int rows, float scale, int8_t* aQuant, float* aUnquant) {
+  for(int r = 0; r < m; ++r) {
+    const float* row = A + (size_t)r * rows;
+    float maxAbs = 0.f;
+    for(int k = 0; k < rows; ++k)
+      maxAbs = std::max(maxAbs, std::abs(row[k]));
+    float quantMult = maxAbs > 0.f ? 127.f / maxAbs : 1.f;
+    for(int k = 0; k < rows; ++k)
+      aQuant[(size_t)r * rows + k] = (int8_t)std::round(row[k] * quantMult);
+    aUnquant[r] = scale / quantMult;
+  }
+}
+
+// Columns colBegin to colEnd of C [m x cols] for A quantized with quantizeRows()
+inline void gemmColumns(const int8_t* aQuant, const float* aUnquant, int m, const uint8_t* packed, int rows, int cols,
+                        const float* bias, float* C, int colBegin, int colEnd) {
+  const int RB = 4; // rows of A per unpacked group of weights
+  int groups = rows / GROUP;
+  const float* scales = reinterpret_cast<const float*>(packed + valueBytes(rows, cols));
+
+  for(int j = colBegin; j < colEnd; ++j) {
+    const uint8_t* column = packed + (size_t)j * rows / 2;
+    const float* columnScales = scales + (size_t)j * groups;
+    float b = bias ? bias[j] : 0.f;
+    for(int r0 = 0; r0 < m; r0 += RB) {
+      int rb = std::min(RB, m - r0);
+#if defined(__AVX2__) && !defined(ARM)
+      __m256 acc[RB];
+      for(int r = 0; r < rb; ++r)
+        acc[r] = _mm256_setzero_ps();
+      for(int g = 0; g < groups; ++g) {
+        __m256i w = unpackGroup(column + g * GROUP / 2);
+        __m256 groupScale = _mm256_set1_ps(columnScales[g]);
+        for(int r = 0; r < rb; ++r) {
+          __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&aQuant[(size_t)(r0 + r) * rows + g * GROUP]));
+          __m256 partial = _mm256_cvtepi32_ps(dotGroup(a, w));
+#ifdef __FMA__
+          acc[r] = _mm256_fmadd_ps(partial, groupScale, acc[r]);
+#else
+          acc[r] = _mm256_add_ps(_mm256_mul_ps(partial, groupScale), acc[r]);
+#endif
+        }
+      }
+      for(int r = 0; r < rb; ++r)
+        C[(size_t)(r0 + r) * cols + j] = horizontalSum(acc[r]) * aUnquant[r0 + r] + b;
+#else
+      for(int r = 0; r < rb; ++r) {
+        const int8_t* a = &aQuant[(size_t)(r0 + r) * rows];
+        float acc = 0.f;
+        for(int g = 0; g < groups; ++g)
+          acc += dotGroup(a + g * GROUP, column + g * GROUP / 2) * columnScales[g];
+        C[(size_t)(r0 + r) * cols + j] = acc * aUnquant[r0 + r] + b;
+      }
+#endif
+    }
+  }
+}
+
+// C [m x cols] = scale * A [m x rows] * W + bias for packed W. Rows of A are quantized to int8 with their own
+// multiplier. bias may be nullptr.
+inline void gemm(const float* A, int m, const uint8_t* packed, int rows, int cols,
+                 const float* bias, float scale, float* C) {
+  std::vector<int8_t> aQuant((size_t)m * rows);
+  std::vector<float> aUnquant(m);
+  quantizeRows(A, m, rows, scale, aQuant.data(), aUnquant.data());
+  gemmColumns(aQuant.data(), aUnquant.data(), m, packed, rows, cols, bias, C, 0, cols);
+}
+
+}  // namespace int4
+}  // namespace cpu
+}  // namespace marian
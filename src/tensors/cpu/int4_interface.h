@@ -0,0 +1,75 @@
+#pragma once
+
+// Graph node for products with 4-bit weight matrices (Type::int4grouped), see int4_gemm.h
+
+#include "graph/expression_operators.h"
+#include "graph/node_operators_unary.h"
+#include "tensors/cpu/int4_gemm.h"
+#include "tensors/cpu/intra_op_pool.h"
+
+namespace marian {
+namespace cpu {
+namespace int4 {
+
+// scale * a * b + bias for a packed int4grouped b
+struct AffineNodeOp : public NaryNodeOp {
+  float scale_;
+
+  AffineNodeOp(Expr a, Expr b, Expr bias, float scale)
+      : NaryNodeOp(bias ? std::vector<Expr>({a, b, bias}) : std::vector<Expr>({a, b}), newShape(a, b), Type::float32),
+        scale_(scale) {}
+
+  static Shape newShape(Expr a, Expr b) {
+    ABORT_IF(a->shape()[-1] != b->shape()[-2], "Int4 GEMM: inner dimensions {} and {} do not match", a->shape(), b->shape());
+    auto shape = a->shape();
+    shape.set(-1, b->shape()[-1]);
+    return shape;
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(
+      auto a = child(0)->val();
+      auto b = child(1)->val();
+      int rows = b->shape()[-2];
+      int cols = b->shape()[-1];
+      int m = a->shape().elements() / rows;
+      std::vector<int8_t> aQuant((size_t)m * rows);
+      std::vector<float> aUnquant(m);
+      quantizeRows(a->data(), m, rows, scale_, aQuant.data(), aUnquant.data());
+      const float* bias = children().size() > 2 ? child(2)->val()->data() : nullptr;
+      // columns are independent and contiguous in b, so split them over the intra-op threads
+      parallelFor(val_, cols, (size_t)m * rows, [&](size_t begin, size_t end) {
+        gemmColumns(aQuant.data(), aUnquant.data(), m, b->data<uint8_t>(), rows, cols, bias, val_->data(), (int)begin, (int)end);
+      })
+    )};
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("Only used for inference");
+    return {NodeOp(0)};
+  }
+
+  const std::string type() override { return "int4Affine"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, scale_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<AffineNodeOp>(node);
+    return cnode && scale_ == cnode->scale_;
+  }
+};
+
+static inline Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  ABORT_IF(transB, "Int4 weight matrices {} cannot be transposed", b->name());
+  return Expression<AffineNodeOp>(transA ? transpose(a) : a, b, bias, scale);
+}
+
+}  // namespace int4
+}  // namespace cpu
+}  // namespace marian
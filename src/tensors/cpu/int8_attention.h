@@ -0,0 +1,218 @@
+#pragma once
+
+// Int8 versions of the batched activation-by-activation products in attention (Q*K^T and weights*V).
+// Each head, i.e. each matrix over the last two axes, is quantized with its own multiplier computed
+// on the fly, so there is nothing to calibrate.
+
+#include "graph/node_operators_unary.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) && !defined(ARM)
+#include <immintrin.h>
+#endif
+
+namespace marian {
+namespace cpu {
+namespace integer {
+
+namespace attention {
+
+inline int heads(const Shape& shape) {
+  return shape.elements() / (shape[-1] * shape[-2]);
+}
+
+inline Shape headShape(Shape shape) {
+  shape.set(-1, 1);
+  shape.set(-2, 1);
+  return shape;
+}
+
+inline Shape transposedShape(Shape shape, bool transpose) {
+  if(transpose) {
+    int rows = shape[-2];
+    shape.set(-2, shape[-1]);
+    shape.set(-1, rows);
+  }
+  return shape;
+}
+
+inline int32_t dot(const int8_t* a, const int8_t* b, int k) {
+  int32_t sum = 0;
+  int i = 0;
+#if defined(__AVX2__) && !defined(ARM)
+  __m256i acc = _mm256_setzero_si256();
+  for(; i + 16 <= k; i += 16) {
+    __m256i a16 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    __m256i b16 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a16, b16));
+  }
+  __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  acc128 = _mm_hadd_epi32(acc128, acc128);
+  acc128 = _mm_hadd_epi32(acc128, acc128);
+  sum = _mm_cvtsi128_si32(acc128);
+#endif
+  for(; i < k; ++i)
+    sum += (int32_t)a[i] * (int32_t)b[i];
+  return sum;
+}
+
+}  // namespace attention
+
+// 127 / max(|x|) for each head of x, shape [..., 1, 1]
+struct HeadQuantMultNodeOp : public UnaryNodeOp {
+  HeadQuantMultNodeOp(Expr x) : UnaryNodeOp(x, attention::headShape(x->shape()), Type::float32) {}
+
+  NodeOps forwardOps() override {
+    return {NodeOp(
+      auto x = child(0)->val();
+      int size = x->shape()[-1] * x->shape()[-2];
+      int heads = attention::heads(x->shape());
+      const float* in = x->data();
+      float* out = val_->data();
+      for(int h = 0; h < heads; ++h) {
+        float maxAbs = 0.f;
+        for(int i = 0; i < size; ++i)
+          maxAbs = std::max(maxAbs, std::abs(in[(size_t)h * size + i]));
+        out[h] = 127.f / std::max(maxAbs, 1e-10f);
+      }
+    )};
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("Only used for inference");
+    return {NodeOp(0)};
+  }
+
+  const std::string type() override { return "int8HeadQuantMult"; }
+};
+
+// x rounded to int8 with the multiplier of its head, optionally with each head transposed
+struct QuantizeHeadsNodeOp : public NaryNodeOp {
+  bool transpose_;
+
+  QuantizeHeadsNodeOp(Expr x, Expr quantMults, bool transpose)
+      : NaryNodeOp({x, quantMults}, attention::transposedShape(x->shape(), transpose), Type::int8),
+        transpose_(transpose) {}
+
+  NodeOps forwardOps() override {
+    return {NodeOp(
+      auto x = child(0)->val();
+      int rows = x->shape()[-2];
+      int cols = x->shape()[-1];
+      int heads = attention::heads(x->shape());
+      const float* in = x->data();
+      const float* mults = child(1)->val()->data();
+      int8_t* out = val_->data<int8_t>();
+      for(int h = 0; h < heads; ++h) {
+        const float* head = in + (size_t)h * rows * cols;
+        int8_t* outHead = out + (size_t)h * rows * cols;
+        for(int r = 0; r < rows; ++r) {
+          for(int c = 0; c < cols; ++c) {
+            float q = std::round(head[r * cols + c] * mults[h]);
+            outHead[transpose_ ? c * rows + r : r * cols + c] = (int8_t)std::max(-127.f, std::min(127.f, q));
+          }
+        }
+      }
+    )};
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("Only used for inference");
+    return {NodeOp(0)};
+  }
+
+  const std::string type() override { return "int8QuantizeHeads"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, transpose_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<QuantizeHeadsNodeOp>(node);
+    return cnode && transpose_ == cnode->transpose_;
+  }
+};
+
+// scale * A * B^T for each head of int8 A [..., m, k] and B [..., n, k]. B is broadcast over the
+// leading batch entries of A, e.g. the beam, like in bdot().
+struct DotInt8BatchedNodeOp : public NaryNodeOp {
+  float scale_;
+
+  DotInt8BatchedNodeOp(Expr a, Expr aQuantMults, Expr b, Expr bQuantMults, float scale)
+      : NaryNodeOp({a, aQuantMults, b, bQuantMults}, newShape(a, b), Type::float32), scale_(scale) {}
+
+  static Shape newShape(Expr a, Expr b) {
+    ABORT_IF(a->shape()[-1] != b->shape()[-1], "Int8 attention: inner dimensions {} and {} do not match", a->shape()[-1], b->shape()[-1]);
+    ABORT_IF(attention::heads(a->shape()) % attention::heads(b->shape()) != 0,
+             "Int8 attention: cannot broadcast {} to {}", b->shape(), a->shape());
+    auto shape = a->shape();
+    shape.set(-1, b->shape()[-2]);
+    return shape;
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(
+      auto a = child(0)->val();
+      auto b = child(2)->val();
+      int m = a->shape()[-2];
+      int k = a->shape()[-1];
+      int n = b->shape()[-2];
+      int headsA = attention::heads(a->shape());
+      int headsB = attention::heads(b->shape());
+      const float* aMults = child(1)->val()->data();
+      const float* bMults = child(3)->val()->data();
+      float* out = val_->data();
+      for(int h = 0; h < headsA; ++h) {
+        int hb = h % headsB;
+        const int8_t* aHead = a->data<int8_t>() + (size_t)h * m * k;
+        const int8_t* bHead = b->data<int8_t>() + (size_t)hb * n * k;
+        float unquant = scale_ / (aMults[h] * bMults[hb]);
+        for(int i = 0; i < m; ++i)
+          for(int j = 0; j < n; ++j)
+            out[((size_t)h * m + i) * n + j] = unquant * attention::dot(aHead + i * k, bHead + j * k, k);
+      }
+    )};
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("Only used for inference");
+    return {NodeOp(0)};
+  }
+
+  const std::string type() override { return "int8DotBatched"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, scale_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<DotInt8BatchedNodeOp>(node);
+    return cnode && scale_ == cnode->scale_;
+  }
+};
+
+static inline Expr headQuantMults(Expr x) {
+  return Expression<HeadQuantMultNodeOp>(x);
+}
+
+static inline Expr quantizeHeads(Expr x, Expr quantMults, bool transpose = false) {
+  return Expression<QuantizeHeadsNodeOp>(x, quantMults, transpose);
+}
+
+static inline Expr bdotInt8(Expr a, Expr aQuantMults, Expr b, Expr bQuantMults, float scale) {
+  return Expression<DotInt8BatchedNodeOp>(a, aQuantMults, b, bQuantMults, scale);
+}
+
+}  // namespace integer
+}  // namespace cpu
+}  // namespace marian
@@ -1,4 +1,10 @@
 #include "integer_common.h"
+#include "common/io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
 
 #ifdef __SSE__
 #include <emmintrin.h>
@@ -64,6 +70,83 @@ void AddBias(marian::Tensor C, const marian::Tensor Bias) {
   }
 }
 
+void UnquantizeColumns(marian::Tensor C, const marian::Tensor columnQuantMults, const marian::Tensor Bias) {
+  float* y = C->data();
+  const float* bias = Bias ? Bias->data() : nullptr;
+
+  const int m = C->shape().elements() / C->shape()[-1];
+  const int n = C->shape()[-1];
+
+  std::vector<float> unquant(n);
+  for(int i = 0; i < n; i++)
+    unquant[i] = 1.0f / columnQuantMults->data()[i];
+
+  // Simple loops, vectorized by the compiler
+  for(int j = 0; j < m; ++j) {
+    float* row = y + (size_t)j * n;
+    if(bias) {
+      for(int i = 0; i < n; i++)
+        row[i] = row[i] * unquant[i] + bias[i];
+    } else {
+      for(int i = 0; i < n; i++)
+        row[i] = row[i] * unquant[i];
+    }
+  }
+}
+
+AlphaCalibration& AlphaCalibration::instance() {
+  static AlphaCalibration calibration;
+  return calibration;
+}
+
+void AlphaCalibration::add(const std::string& quantMultName, float maxAbs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  maxima_[quantMultName].push_back(maxAbs);
+}
+
+float AlphaCalibration::alpha(std::vector<float> maxima, float percentile) {
+  ABORT_IF(maxima.empty(), "No maxima to calibrate an alpha from");
+  size_t k = (size_t)std::ceil(percentile / 100.f * maxima.size());
+  k = std::min(std::max(k, (size_t)1), maxima.size()) - 1;
+  std::nth_element(maxima.begin(), maxima.begin() + k, maxima.end());
+  return 127.0f / std::max(maxima[k], 1e-10f);
+}
+
+void AlphaCalibration::save(const std::string& modelFile, const std::string& outFile, float percentile) {
+  ABORT_IF(percentile <= 0.f || percentile > 100.f, "Percentile for alpha calibration must be in (0, 100]");
+
+  std::map<std::string, float> alphas; // sorted for reproducible model files
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto& kv : maxima_) {
+      // Names are <namespace>::<B>_QuantMultA, the first model is F0
+      const std::string prefix = "F0::";
+      if(kv.first.compare(0, prefix.size(), prefix) != 0)
+        continue;
+      alphas[kv.first.substr(prefix.size())] = alpha(kv.second, percentile);
+    }
+  }
+  ABORT_IF(alphas.empty(), "No activations have been collected for alpha calibration");
+
+  // Intgemm matrices are written back as stored
+  auto items = io::loadItems(modelFile, /*prepareIntgemm=*/false);
+  items.erase(std::remove_if(items.begin(), items.end(),
+                             [&](const io::Item& item) { return alphas.count(item.name) > 0; }),
+              items.end());
+  for(const auto& kv : alphas) {
+    io::Item item;
+    item.name = kv.first;
+    item.shape = Shape({1});
+    item.type = Type::float32;
+    item.bytes.resize(sizeof(float));
+    std::memcpy(item.bytes.data(), &kv.second, sizeof(float));
+    items.emplace_back(std::move(item));
+  }
+
+  LOG(info, "Saving model with {} calibrated alphas ({}th percentile) to {}", alphas.size(), percentile, outFile);
+  io::saveItems(outFile, items);
+}
+
 } //integer
 } //cpu
 } //marian
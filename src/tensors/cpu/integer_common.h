@@ -22,6 +22,8 @@
 
 #include <cassert>
 #include <cstddef>
+#include <mutex>
+#include <unordered_map>
 
 namespace marian {
 namespace cpu {
@@ -76,6 +78,31 @@ inline int rows(Shape& shape) { return shape.elements() / cols(shape); }
 // This operates on floats after processing so doesn't care about int8_t vs int16_t.
 void AddBias(marian::Tensor C, const marian::Tensor Bias);
 
+// Finishes a product with a B quantized per column, which intgemm only unquantized with the multiplier of A:
+// C[i][j] = C[i][j] / columnQuantMults[j] + Bias[j]. Bias may be nullptr.
+void UnquantizeColumns(marian::Tensor C, const marian::Tensor columnQuantMults, const marian::Tensor Bias);
+
+// Collects the maxima of the activations that are quantized on the fly when decoding with
+// --calibrate-alphas and turns them into precomputed alphas for --gemm-precision int8shiftAlpha.
+class AlphaCalibration {
+public:
+  static AlphaCalibration& instance();
+
+  // maxAbs of one activation matrix quantized with the QuantMultA node of the given name
+  void add(const std::string& quantMultName, float maxAbs);
+
+  // Writes the model with items <B>_QuantMultA = 127 / (percentile of the maxima collected for B) added
+  // or replaced. Only the first model of an ensemble is calibrated.
+  void save(const std::string& modelFile, const std::string& outFile, float percentile);
+
+  // 127 / the nearest-rank percentile of the maxima
+  static float alpha(std::vector<float> maxima, float percentile);
+
+private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<float>> maxima_;
+};
+
 #ifdef USE_INTGEMM
 
 template<Type type> struct intgemm_;
@@ -1,11 +1,54 @@
 #pragma once
 #include "integer_common.h"
+#include "tensors/cpu/backend.h"
 
 namespace marian {
 
 namespace cpu {
 namespace integer {
 
+#if defined(USE_INTGEMM)
+// Splits the product of A [rows x width] and prepared B [width x cols] over the intra-op threads of the
+// backend of C: by rows of A if there are enough, otherwise by blocks of 8 columns of B, which are contiguous
+// in prepared B. multiply(rowBegin, rowCount, colBegin, colCount, out) computes that block of C into out,
+// which has colCount columns. C may have fewer columns than B if the last columns of B only pad a shortlist
+// to a multiple of 8, these are then computed into a buffer of a few rows and not copied to C.
+template <class Multiply>
+void parallelMultiply(Tensor C, intgemm::Index rows, intgemm::Index width, intgemm::Index cols, const Multiply& multiply) {
+  float* c = C->data();
+  intgemm::Index outCols = C->shape()[-1];
+  auto multiplyBlock = [&](intgemm::Index rowBegin, intgemm::Index rowCount, intgemm::Index colBegin, intgemm::Index colCount) {
+    if (colBegin == 0 && colCount == outCols) { // whole rows of C
+      multiply(rowBegin, rowCount, colBegin, colCount, c + (size_t)rowBegin * outCols);
+      return;
+    }
+    if (colBegin >= outCols) // padding only
+      return;
+    intgemm::Index copyCount = std::min(colCount, outCols - colBegin);
+    const intgemm::Index chunkRows = 8;
+    std::vector<float> block((size_t)std::min(rowCount, chunkRows) * colCount);
+    for (intgemm::Index r0 = rowBegin; r0 < rowBegin + rowCount; r0 += chunkRows) {
+      intgemm::Index chunk = std::min(chunkRows, rowBegin + rowCount - r0);
+      multiply(r0, chunk, colBegin, colCount, block.data());
+      for (intgemm::Index r = 0; r < chunk; ++r)
+        std::copy(block.data() + (size_t)r * colCount, block.data() + (size_t)r * colCount + copyCount, c + (size_t)(r0 + r) * outCols + colBegin);
+    }
+  };
+
+  auto backend = std::dynamic_pointer_cast<cpu::Backend>(C->getBackend());
+  auto pool = backend ? backend->getIntraOpPool() : nullptr;
+  if (!pool || rows >= pool->size()) {
+    parallelFor(C, rows, (size_t)width * cols, [&](size_t begin, size_t end) {
+      multiplyBlock((intgemm::Index)begin, (intgemm::Index)(end - begin), 0, cols);
+    });
+  } else {
+    parallelFor(C, cols / 8, (size_t)rows * width * 8, [&](size_t begin, size_t end) {
+      multiplyBlock(0, rows, (intgemm::Index)begin * 8, (intgemm::Index)(end - begin) * 8);
+    });
+  }
+}
+#endif
+
 template<Type vtype>
 struct PrepareANodeOp : public NaryNodeOp {
 float clipValue_;
@@ -164,8 +207,11 @@ struct SelectColumnsBNodeOp : public UnaryNodeOp {
 public:
   float clipValue_;
   float quantMult_;
-  SelectColumnsBNodeOp(Expr input, const std::vector<uint_least32_t>  &indices, float clipValue)
-      : UnaryNodeOp(input, newShape(input, indices), intgemm_<vtype>::intgemmType), clipValue_(clipValue), indices_(indices) {
+  size_t numSelected_; // columns before padding, the products with B are cut to these
+
+  SelectColumnsBNodeOp(Expr input, const std::vector<uint_least32_t>  &indices, float clipValue, size_t numSelected)
+      : UnaryNodeOp(input, newShape(input, indices), intgemm_<vtype>::intgemmType), clipValue_(clipValue),
+        numSelected_(numSelected ? numSelected : indices.size()), indices_(indices) {
 
     set_name(input->name());
     setMemoize(false); // Enabling memoization leads to a massive memory leak. 
@@ -175,6 +221,8 @@ public:
 
     // Check number of selected columns
     ABORT_IF(indices.size() % 8 != 0, "Shortlist selected vocabulary must be a multiple of 8.");
+    ABORT_IF(numSelected_ > indices.size() || indices.size() - numSelected_ >= 8,
+             "{} selected columns cannot be padded to {}", numSelected_, indices.size());
   }
 
   NodeOps forwardOps() override {
@@ -200,6 +248,8 @@ public:
                     num_cols,
                     val_->data<int8_t>());
   #else
+      if (cached_) // selected for an earlier batch
+        return;
       typedef typename intgemm_<vtype>::type Integer;
       intgemm_<vtype>::width::SelectColumnsB(
                     reinterpret_cast<Integer *>(input->data()),
@@ -207,6 +257,8 @@ public:
                     rows(input),
                     indices_.data(),
                     indices_.data()+indices_.size());
+      if (block_)
+        cache_->put(input->data(), value_type(), indices_, block_);
   #endif
     }};
 #else
@@ -214,11 +266,40 @@ public:
 #endif
   }
 
+  // With --shortlist-weights-cache, selections of parameters are cached across batches. The value then
+  // lives in a cache block instead of the graph workspace.
+  void allocate() override {
+#if defined(COMPILE_CPU) && !defined(WASM)
+    auto backend = std::dynamic_pointer_cast<cpu::Backend>(getBackend());
+    cache_ = backend ? backend->getColumnSelectionCache() : nullptr;
+    if (!val_ && cache_ && child(0)->type() == "param") {
+      const void* source = child(0)->val()->data();
+      block_ = cache_->find(source, value_type(), indices_);
+      cached_ = block_ != nullptr;
+      if (!block_)
+        block_ = New<ColumnSelectionCache::Block>(requiredBytes(shape(), value_type()));
+      val_ = TensorBase::New(MemoryPiece::New(block_->data(), block_->size()), shape(), value_type(), getBackend());
+      return;
+    }
+#endif
+    UnaryNodeOp::allocate();
+  }
+
+  void free() override {
+    if (block_) { // not allocated in the graph
+      val_ = nullptr;
+      block_ = nullptr;
+    } else {
+      UnaryNodeOp::free();
+    }
+  }
+
   const std::string type() override { return "intgemmSelectColumnsB"; }
 
   size_t hash() override {
     if (!hash_) {
       hash_ = NaryNodeOp::hash();
+      util::hash_combine(hash_, numSelected_);
       for(auto i : indices_)
         util::hash_combine(hash_, i);
     }
@@ -229,7 +310,7 @@ public:
     if(!NaryNodeOp::equal(node)) return false;
     auto cnode = std::dynamic_pointer_cast<SelectColumnsBNodeOp<vtype>>(node);
     if (!cnode) return false;
-    return indices_ == cnode->indices_;
+    return numSelected_ == cnode->numSelected_ && indices_ == cnode->indices_;
   }
 
 private:
@@ -240,8 +321,22 @@ private:
   }
 
   std::vector<uint_least32_t> indices_;
+
+  Ptr<ColumnSelectionCache> cache_;
+  Ptr<ColumnSelectionCache::Block> block_; // holds the value if cached
+  bool cached_{false};                     // value has been selected for an earlier batch
 };
 
+// Columns of the product with B, i.e. without the columns that pad a selection to a multiple of 8
+template<Type vtype>
+static inline int outputColumns(Expr b) {
+#if !defined(WASM)
+  if (b->type() == "intgemmSelectColumnsB")
+    return (int)std::static_pointer_cast<SelectColumnsBNodeOp<vtype> >(b)->numSelected_;
+#endif
+  return b->shape()[-1];
+}
+
 template<Type vtype>
 struct QuantMultNodeOp : public UnaryNodeOp {
   bool isA_;
@@ -276,7 +371,11 @@ struct QuantMultNodeOp : public UnaryNodeOp {
         }
         auto input = child(0)->val();
         #if defined(USE_INTGEMM)
-          *val_->data() = 127.0f / intgemm::MaxAbsolute(input->data(), input->data() + input->size());
+          float maxAbs = intgemm::MaxAbsolute(input->data(), input->data() + input->size());
+          auto backend = std::dynamic_pointer_cast<cpu::Backend>(child(0)->graph()->getBackend());
+          if (isA_ && backend && backend->isCalibratingAlphas())
+            AlphaCalibration::instance().add(name(), maxAbs);
+          *val_->data() = 127.0f / maxAbs;
         #endif
       }
     #endif // COMPILE_CPU
@@ -313,8 +412,8 @@ struct QuantMultNodeOp : public UnaryNodeOp {
 class PrepareBiasForBNodeOp : public NaryNodeOp {
   bool alreadyPrepared_ = false;
 public:
-  PrepareBiasForBNodeOp(Expr bias, Expr inputB_preppd, Expr a_quant_mult, Expr b_quant_mult)
-      : NaryNodeOp({bias, inputB_preppd, a_quant_mult, b_quant_mult}, bias->shape(), Type::float32) {
+  PrepareBiasForBNodeOp(Expr bias, Expr inputB_preppd, Expr a_quant_mult, Expr b_quant_mult, Expr b_column_quant_mults = nullptr)
+      : NaryNodeOp(inputs(bias, inputB_preppd, a_quant_mult, b_quant_mult, b_column_quant_mults), bias->shape(), Type::float32) {
 
     set_name(bias->name() + "_Prepared");
     if (bias->type() == "cols" && bias->graph()->getBackend()->isPrecomputedAlpha()) {
@@ -348,7 +447,12 @@ public:
         int8PrepareBias((const int8_t *)b->data(), scale_a, 0.0 /*zero_point_a*/, scale_b, 0.0 /*zero_point_b*/, rows(b), cols(b), bias->data(), val_->data());
     #elif defined(USE_INTGEMM)
         float unquant_mult = (-1)*((127.0f / *quant_mult_a->data())*(127.0f / *quant_mult_b->data()))/(127.0f); //Minus one to invert add_ps later on
-        intgemm::Int8Shift::PrepareBias((const int8_t *)b->data(), rows(b), cols(b), intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias->data(), val_->data()));
+        if (children().size() > 4) { // B quantized per column, the correction is divided by the column's multiplier
+          intgemm::Int8Shift::PrepareBias((const int8_t *)b->data(), rows(b), cols(b), intgemm::callbacks::UnquantizeAndWrite(unquant_mult, val_->data()));
+          UnquantizeColumns(val_, this->child(4)->val(), bias);
+        } else {
+          intgemm::Int8Shift::PrepareBias((const int8_t *)b->data(), rows(b), cols(b), intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias->data(), val_->data()));
+        }
     #else
         ABORT("PrepareBias should not be called on ARM");
     #endif
@@ -360,12 +464,20 @@ public:
   }
 
   const std::string type() override { return "prepareBias"; }
+
+private:
+  static std::vector<Expr> inputs(Expr bias, Expr b, Expr aQuantMult, Expr bQuantMult, Expr bColumnQuantMults) {
+    std::vector<Expr> nodes = {bias, b, aQuantMult, bQuantMult};
+    if (bColumnQuantMults)
+      nodes.push_back(bColumnQuantMults);
+    return nodes;
+  }
 };
 
 class PrepareFakeBiasForBNodeOp : public NaryNodeOp {
 public:
-  PrepareFakeBiasForBNodeOp(Expr inputB_preppd, Expr a_quant_mult, Expr b_quant_mult)
-      : NaryNodeOp({inputB_preppd, a_quant_mult, b_quant_mult}, {1, inputB_preppd->shape()[-1]}, Type::float32) {
+  PrepareFakeBiasForBNodeOp(Expr inputB_preppd, Expr a_quant_mult, Expr b_quant_mult, Expr b_column_quant_mults = nullptr)
+      : NaryNodeOp(inputs(inputB_preppd, a_quant_mult, b_quant_mult, b_column_quant_mults), {1, inputB_preppd->shape()[-1]}, Type::float32) {
 
     set_name(inputB_preppd->name() + "_FakeBias");
     if (!inputB_preppd->graph()->getBackend()->isPrecomputedAlpha()) {
@@ -388,6 +500,8 @@ public:
   #elif defined(USE_INTGEMM)
     float unquant_mult = (-1)*((127.0f / *quant_mult_a->data())*(127.0f / *quant_mult_b->data()))/(127.0f); //Minus one to invert add_ps later on
     intgemm::Int8Shift::PrepareBias((const int8_t *)b->data(), rows(b), cols(b), intgemm::callbacks::UnquantizeAndWrite(unquant_mult, val_->data()));
+    if (children().size() > 3) // B quantized per column
+      UnquantizeColumns(val_, this->child(3)->val(), nullptr);
   #else
     ABORT("PrepareBias should not be called on ARM");
   #endif
@@ -398,6 +512,14 @@ public:
   }
 
   const std::string type() override { return "prepareFakeBias"; }
+
+private:
+  static std::vector<Expr> inputs(Expr b, Expr aQuantMult, Expr bQuantMult, Expr bColumnQuantMults) {
+    std::vector<Expr> nodes = {b, aQuantMult, bQuantMult};
+    if (bColumnQuantMults)
+      nodes.push_back(bColumnQuantMults);
+    return nodes;
+  }
 };
 
 template<Type vtype>
@@ -406,14 +528,14 @@ private:
 float scalar_;
 
 public:
-  DotNodeOp(Expr a, Expr b, float scalar)
-      : NaryNodeOp({a, b}, newShape(a, b), Type::float32), scalar_(scalar) {
+  DotNodeOp(Expr a, Expr b, float scalar, Expr bColumnQuantMults = nullptr)
+      : NaryNodeOp(bColumnQuantMults ? std::vector<Expr>({a, b, bColumnQuantMults}) : std::vector<Expr>({a, b}), newShape(a, b), Type::float32), scalar_(scalar) {
         setMemoize(false); // AFAIK dot is never called with the same matrices
       }
 
   Shape newShape(Expr a, Expr b) {
     Shape result = a->shape();
-    result.set(-1, b->shape()[-1]);
+    result.set(-1, outputColumns<vtype>(b));
     return result;
   }
 
@@ -440,12 +562,16 @@ public:
               "Int8::Multiply is not implemented for wasm.");
       #elif defined(USE_INTGEMM)
           typedef typename intgemm_<vtype>::type Integer;
-          intgemm_<vtype>::width::Multiply(reinterpret_cast<Integer *>(child(0)->val()->data()), /*A*/
-                                           reinterpret_cast<Integer *>(child(1)->val()->data()), /*B*/
-                                           rows(child(0)->val()),
-                                           cols(child(0)->val()),
-                                           cols(child(1)->val()),
-                                           intgemm::callbacks::UnquantizeAndWrite(unquant_mult, val_->data()));
+          const Integer* A = reinterpret_cast<Integer *>(child(0)->val()->data());
+          const Integer* B = reinterpret_cast<Integer *>(child(1)->val()->data());
+          intgemm::Index width = cols(child(0)->val());
+          parallelMultiply(val_, rows(child(0)->val()), width, cols(child(1)->val()),
+              [&](intgemm::Index rowBegin, intgemm::Index rowCount, intgemm::Index colBegin, intgemm::Index colCount, float* out) {
+            intgemm_<vtype>::width::Multiply(A + rowBegin * width, B + colBegin * width, rowCount, width, colCount,
+                                             intgemm::callbacks::UnquantizeAndWrite(unquant_mult, out));
+          });
+          if (children().size() > 2) // B quantized per column
+            UnquantizeColumns(val_, child(2)->val(), nullptr);
       #endif
     }};
 #else
@@ -468,14 +594,14 @@ private:
   bool shifted_;
 
 public:
-  AffineNodeOp(Expr a, Expr b, Expr Bias, float scalar, bool shifted=false)
-      : NaryNodeOp({a, b, Bias}, newShape(a, b), Type::float32), scalar_(scalar), shifted_(shifted) {
+  AffineNodeOp(Expr a, Expr b, Expr Bias, float scalar, bool shifted=false, Expr bColumnQuantMults = nullptr)
+      : NaryNodeOp(bColumnQuantMults ? std::vector<Expr>({a, b, Bias, bColumnQuantMults}) : std::vector<Expr>({a, b, Bias}), newShape(a, b), Type::float32), scalar_(scalar), shifted_(shifted) {
         setMemoize(false); // AFAIK affine is never called with the same matrices
       }
 
   Shape newShape(Expr a, Expr b) {
     Shape result = a->shape();
-    result.set(-1, b->shape()[-1]);
+    result.set(-1, outputColumns<vtype>(b));
     return result;
   }
 
@@ -514,21 +640,32 @@ public:
                                 val_->data());
       #elif defined(USE_INTGEMM)
           typedef typename intgemm_<vtype>::type Integer;
-          if (!shifted_) {
-            intgemm_<vtype>::width::Multiply(reinterpret_cast<Integer *>(child(0)->val()->data()), /*A*/
-                                             reinterpret_cast<Integer *>(child(1)->val()->data()), /*B*/
-                                             rows(child(0)->val()),
-                                             cols(child(0)->val()),
-                                             cols(child(1)->val()),                                          /*child(2) is bias*/
-                                             intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, child(2)->val()->data(), val_->data()));
-          } else {
-            intgemm::Int8Shift::Multiply(reinterpret_cast<int8_t *>(child(0)->val()->data()), /*A*/
-                                  reinterpret_cast<int8_t *>(child(1)->val()->data()), /*B*/
-                                  rows(child(0)->val()),
-                                  cols(child(0)->val()),
-                                  cols(child(1)->val()),                                          /*child(2) is bias*/
-                                  intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, child(2)->val()->data(), val_->data()));
-          }
+          const Integer* A = reinterpret_cast<Integer *>(child(0)->val()->data());
+          const Integer* B = reinterpret_cast<Integer *>(child(1)->val()->data());
+          const float* bias = child(2)->val()->data(); /*child(2) is bias*/
+          intgemm::Index width = cols(child(0)->val());
+          // B quantized per column: unquantize with the multiplier of A here, the columns and the bias after
+          bool perColumn = children().size() > 3;
+          parallelMultiply(val_, rows(child(0)->val()), width, cols(child(1)->val()),
+              [&](intgemm::Index rowBegin, intgemm::Index rowCount, intgemm::Index colBegin, intgemm::Index colCount, float* out) {
+            const Integer* a = A + rowBegin * width;
+            const Integer* b = B + colBegin * width;
+            if (perColumn && !shifted_) {
+              intgemm_<vtype>::width::Multiply(a, b, rowCount, width, colCount,
+                                               intgemm::callbacks::UnquantizeAndWrite(unquant_mult, out));
+            } else if (perColumn) {
+              intgemm::Int8Shift::Multiply(reinterpret_cast<const int8_t *>(a), reinterpret_cast<const int8_t *>(b), rowCount, width, colCount,
+                                           intgemm::callbacks::UnquantizeAndWrite(unquant_mult, out));
+            } else if (!shifted_) {
+              intgemm_<vtype>::width::Multiply(a, b, rowCount, width, colCount,
+                                               intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias + colBegin, out));
+            } else {
+              intgemm::Int8Shift::Multiply(reinterpret_cast<const int8_t *>(a), reinterpret_cast<const int8_t *>(b), rowCount, width, colCount,
+                                           intgemm::callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias + colBegin, out));
+            }
+          });
+          if (perColumn)
+            UnquantizeColumns(val_, child(3)->val(), child(2)->val());
       #endif
     }};
 #else
@@ -560,8 +697,24 @@ static inline Expr prepareB(Expr b, Expr quantMult, float clipValue, bool transp
 }
 
 template<Type vtype>
-static inline Expr selectColumnsB(Expr b, const std::vector<uint_least32_t> &cols, float clipValue) {
-  return Expression<SelectColumnsBNodeOp<vtype > >(b, cols, clipValue);
+static inline Expr selectColumnsB(Expr b, const std::vector<uint_least32_t> &cols, float clipValue, size_t numSelected = 0) {
+  return Expression<SelectColumnsBNodeOp<vtype > >(b, cols, clipValue, numSelected);
+}
+
+// Per-column multipliers [1 x cols] of B as stored by marian-conv --quantize-per-column, nullptr if B has
+// a single multiplier. B then carries the multiplier 1, i.e. columns are scaled before quantization.
+static inline Expr columnQuantMults(Expr b) {
+  if (b->type() != "param" || !isIntgemm(b->value_type()))
+    return nullptr;
+  std::string name = b->name();
+  auto pos = name.find("::"); // graph->get() adds the namespace again
+  if (pos != std::string::npos)
+    name = name.substr(pos + 2);
+  auto mults = b->graph()->get(name + "_QuantMultBCols");
+#if defined(WASM)
+  ABORT_IF(mults, "Per-column quantization of {} is not implemented for wasm", b->name());
+#endif
+  return mults;
 }
 
 template<Type vtype>
@@ -576,6 +729,7 @@ static inline Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, f
   }
   auto aQuant = prepareA<vtype>(transA ? transpose(a) : a, aQuantMult, scale, shiftedBias);
   Expr bQuantMult = quantMult<vtype>(b);
+  Expr bColumnQuantMults = vtype == Type::int8 ? columnQuantMults(b) : nullptr;
   Expr bQuant = nullptr;
   if (isIntgemm(bElementType)) {
     //This is the case where we already run SelectColumnB or we loaded a prepacked model.
@@ -587,15 +741,15 @@ static inline Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, f
     // This is the case of the preprocessed bias. It's hacky but otherwise node caching is broken.
     // The bias node is the shortlisted bias and it has been prepared before index_select was run
   } else if (shiftedBias && bias) {
-    bias = Expression<PrepareBiasForBNodeOp>(bias, bQuant, aQuantMult, bQuantMult);
+    bias = Expression<PrepareBiasForBNodeOp>(bias, bQuant, aQuantMult, bQuantMult, bColumnQuantMults);
   } else if (shiftedBias) {
-    bias = Expression<PrepareFakeBiasForBNodeOp>(bQuant, aQuantMult, bQuantMult);
+    bias = Expression<PrepareFakeBiasForBNodeOp>(bQuant, aQuantMult, bQuantMult, bColumnQuantMults);
   }
 
   if (bias) {
-    return Expression<AffineNodeOp<vtype> >(aQuant, bQuant, bias, scale, shiftedBias);
+    return Expression<AffineNodeOp<vtype> >(aQuant, bQuant, bias, scale, shiftedBias, bColumnQuantMults);
   } else {
-    return Expression<DotNodeOp<vtype> >(aQuant, bQuant, scale);
+    return Expression<DotNodeOp<vtype> >(aQuant, bQuant, scale, bColumnQuantMults);
   }
 }
 
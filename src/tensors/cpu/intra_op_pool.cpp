@@ -0,0 +1,110 @@
+#include "tensors/cpu/intra_op_pool.h"
+#include "tensors/cpu/backend.h"
+#include "common/utils.h"
+
+#include <algorithm>
+
+namespace marian {
+namespace cpu {
+
+namespace {
+thread_local bool inPoolThread = false;
+}
+
+IntraOpPool::IntraOpPool(size_t threads, const std::vector<size_t>& cores) {
+  for(size_t i = 1; i < threads; ++i) {
+    workers_.emplace_back([this, i, cores]() {
+      if(!cores.empty()) // otherwise the thread inherits the affinity of the calling thread
+        utils::pinCurrentThread(cores[i % cores.size()]);
+      work();
+    });
+  }
+}
+
+IntraOpPool::~IntraOpPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for(auto& worker : workers_)
+    worker.join();
+}
+
+void IntraOpPool::runChunks(Job& job) {
+  for(;;) {
+    size_t i = job.next++;
+    if(i >= job.chunks)
+      return;
+    size_t begin = i * job.chunkSize;
+    (*job.f)(begin, std::min(job.n, begin + job.chunkSize));
+    job.finished++;
+  }
+}
+
+void IntraOpPool::work() {
+  inPoolThread = true;
+  size_t seen = 0;
+  for(;;) {
+    Job* job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+      if(stop_)
+        return;
+      seen = generation_;
+      job = job_;
+      if(!job) // woke up after the job was done
+        continue;
+      job->active++;
+    }
+
+    runChunks(*job);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job->active--;
+    }
+    done_.notify_one();
+  }
+}
+
+void IntraOpPool::parallelFor(size_t n, size_t workPerItem, const std::function<void(size_t, size_t)>& f) {
+  size_t chunks = std::min(std::min(size(), n), std::max(n * workPerItem / MIN_WORK, (size_t)1));
+  std::unique_lock<std::mutex> call(callMutex_, std::try_to_lock);
+  if(chunks <= 1 || inPoolThread || !call.owns_lock()) {
+    f(0, n);
+    return;
+  }
+
+  Job job;
+  job.f = &f;
+  job.n = n;
+  job.chunkSize = (n + chunks - 1) / chunks;
+  job.chunks = (n + job.chunkSize - 1) / job.chunkSize;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &job;
+    generation_++;
+  }
+  wake_.notify_all();
+
+  runChunks(job);
+
+  // pool threads that have not picked up the job by now find nothing left to do
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [&]() { return job.finished == job.chunks && job.active == 0; });
+  job_ = nullptr;
+}
+
+void parallelFor(Tensor t, size_t n, size_t workPerItem, const std::function<void(size_t, size_t)>& f) {
+  auto backend = std::dynamic_pointer_cast<cpu::Backend>(t->getBackend());
+  auto pool = backend ? backend->getIntraOpPool() : nullptr;
+  if(pool)
+    pool->parallelFor(n, workPerItem, f);
+  else
+    f(0, n);
+}
+
+}  // namespace cpu
+}  // namespace marian
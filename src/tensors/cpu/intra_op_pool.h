@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "tensors/tensor.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// Threads that split the work of single operators, e.g. the rows or columns of a GEMM, so that one CPU
+// device (one graph, see --cpu-threads) can use more than one core for one request. The calling thread
+// takes part in the work. Operators called from within a pool thread run on that thread.
+class IntraOpPool {
+public:
+  // Minimum amount of work (roughly multiply-adds) per thread, smaller operators run on the calling thread
+  static const size_t MIN_WORK = 1 << 15;
+
+  // threads includes the calling thread. With cores, the calling thread is expected to run on cores[0]
+  // and pool thread i is pinned to cores[i % cores.size()].
+  IntraOpPool(size_t threads, const std::vector<size_t>& cores = {});
+  ~IntraOpPool();
+  IntraOpPool(const IntraOpPool&) = delete;
+
+  size_t size() const { return workers_.size() + 1; }
+
+  // Calls f(begin, end) for consecutive ranges covering [0, n) and returns once all of them are done.
+  // workPerItem is the cost of one item, so that each range gets at least MIN_WORK.
+  void parallelFor(size_t n, size_t workPerItem, const std::function<void(size_t, size_t)>& f);
+
+private:
+  struct Job {
+    const std::function<void(size_t, size_t)>* f;
+    size_t n;
+    size_t chunkSize;
+    size_t chunks;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> finished{0};
+    size_t active{0}; // pool threads working on the job, guarded by mutex_
+  };
+
+  void work();
+  static void runChunks(Job& job);
+
+  std::vector<std::thread> workers_;
+  std::mutex callMutex_; // one operator at a time, others run on their calling thread
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  Job* job_{nullptr};
+  size_t generation_{0};
+  bool stop_{false};
+};
+
+// IntraOpPool::parallelFor() with the pool of the backend of t or on the calling thread if it has none
+void parallelFor(Tensor t, size_t n, size_t workPerItem, const std::function<void(size_t, size_t)>& f);
+
+}  // namespace cpu
+}  // namespace marian
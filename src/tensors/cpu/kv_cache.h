@@ -0,0 +1,331 @@
+#pragma once
+
+// Keys and values of the decoder self-attention of one layer, kept across the steps of translating a batch.
+// Positions are appended time-major, each [rows, dim] with row = beam index * batch size + batch index
+// in the order of the step that appended it. Selecting hypotheses does not move any keys or values: each
+// position records for each of its rows the row of the previous position it extends, and attention
+// follows these back-pointers while it reads the buffers, so a step only copies its own position.
+// With continuous batching, sentences join a running batch: their rows have no previous row and start at
+// the position they are appended with, and the positions no row reads any more are dropped now and then.
+
+#include "functional/functional.h"
+#include "graph/node_operators_unary.h"
+#include "tensors/cpu/intra_op_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX__) && !defined(ARM)
+#include <immintrin.h>
+#endif
+
+namespace marian {
+namespace cpu {
+
+class KVCache {
+private:
+  // reserved up front, further positions grow the buffers geometrically
+  static const size_t INITIAL_POSITIONS = 16;
+
+public:
+  // in selIdx, a row that does not extend a previous one but starts at the next position
+  static constexpr IndexType NEW_ROW = std::numeric_limits<IndexType>::max();
+
+private:
+
+  int dimModel_;
+  std::vector<float> keys_;
+  std::vector<float> values_;
+  std::vector<size_t> offsets_;                 // [position] start of the position in keys_ and values_
+  std::vector<std::vector<IndexType>> parents_; // [position][row] row of the previous position, empty for the same row
+  int rows_{0};                                 // rows of the last position
+  int builtPositions_{0};                       // positions of the nodes created so far
+  std::vector<IndexType> selIdx_;               // rows of the next step, applied when the next position is appended
+  int trimAt_{2 * (int)INITIAL_POSITIONS};      // number of positions at which unread ones are dropped next
+
+  static void grow(std::vector<float>& buffer, size_t size) {
+    if(size > buffer.capacity())
+      buffer.reserve(std::max(size, 2 * buffer.capacity()));
+    buffer.resize(size);
+  }
+
+public:
+  // rows and positions are the largest expected, e.g. beam size * batch size and the maximum output length
+  KVCache(int dimModel, size_t rows, size_t positions) : dimModel_(dimModel) {
+    size_t size = rows * std::min(positions, INITIAL_POSITIONS) * dimModel;
+    keys_.reserve(size);
+    values_.reserve(size);
+  }
+
+  // Same as rnn::State::select(): the rows of the next step are the rows selIdx of this one.
+  void select(const std::vector<IndexType>& selIdx) {
+    int rows = selIdx_.empty() ? rows_ : (int)selIdx_.size();
+    bool identity = (int)selIdx.size() == rows;
+    for(size_t i = 0; identity && i < selIdx.size(); ++i)
+      identity = selIdx[i] == (IndexType)i;
+    if(identity || builtPositions_ == 0)
+      return;
+    if(selIdx_.empty()) {
+      selIdx_ = selIdx;
+    } else { // selected again before the previous selection has been applied
+      std::vector<IndexType> composed(selIdx.size());
+      for(size_t i = 0; i < selIdx.size(); ++i)
+        composed[i] = selIdx[i] == NEW_ROW ? NEW_ROW : selIdx_[selIdx[i]];
+      selIdx_.swap(composed);
+    }
+  }
+
+  int dimModel() const { return dimModel_; }
+  int nextPosition() { return builtPositions_++; }
+  int positions() const { return (int)offsets_.size(); }
+
+  // appends keys and values [rows, dimModel] of the next position and returns it
+  int append(const float* keys, const float* values, int rows) {
+    if(!offsets_.empty()) {
+      int expected = selIdx_.empty() ? rows_ : (int)selIdx_.size();
+      ABORT_IF(rows != expected, "Decoder state has {} rows, but the step has {}", expected, rows);
+    }
+    size_t offset = keys_.size();
+    size_t size = (size_t)rows * dimModel_;
+    grow(keys_, offset + size);
+    grow(values_, offset + size);
+    std::copy(keys, keys + size, keys_.data() + offset);
+    std::copy(values, values + size, values_.data() + offset);
+    offsets_.push_back(offset);
+    parents_.emplace_back();
+    parents_.back().swap(selIdx_);
+    rows_ = rows;
+    if(positions() >= trimAt_)
+      trim();
+    return positions() - 1;
+  }
+
+  // rowsOf[t] = the row of position t that hypothesis row of the last position extends, for t from the
+  // returned first position of the hypothesis on
+  int history(int row, std::vector<IndexType>& rowsOf) const {
+    rowsOf.resize(offsets_.size());
+    for(int t = positions() - 1; t >= 0; --t) {
+      rowsOf[t] = (IndexType)row;
+      if(t > 0 && !parents_[t].empty()) {
+        row = (int)parents_[t][row];
+        if((IndexType)row == NEW_ROW)
+          return t;
+      }
+    }
+    return 0;
+  }
+
+  // Drops the positions before the first one of every row of the last position. Runs when the number of
+  // positions has doubled since the last time, which keeps the cost per position constant.
+  void trim() {
+    std::vector<IndexType> rowsOf;
+    int first = positions() - 1;
+    for(int r = 0; r < rows_ && first > 0; ++r)
+      first = std::min(first, history(r, rowsOf));
+    if(first > 0) {
+      size_t offset = offsets_[first];
+      keys_.erase(keys_.begin(), keys_.begin() + offset);
+      values_.erase(values_.begin(), values_.begin() + offset);
+      offsets_.erase(offsets_.begin(), offsets_.begin() + first);
+      for(auto& o : offsets_)
+        o -= offset;
+      parents_.erase(parents_.begin(), parents_.begin() + first);
+      parents_.front().clear(); // the new first position has no previous one
+    }
+    trimAt_ = std::max(trimAt_, 2 * positions());
+  }
+
+  const float* key(int position, IndexType row) const {
+    return keys_.data() + offsets_[position] + (size_t)row * dimModel_;
+  }
+  const float* value(int position, IndexType row) const {
+    return values_.data() + offsets_[position] + (size_t)row * dimModel_;
+  }
+};
+
+namespace kvcache {
+
+#if defined(__AVX__) && !defined(ARM)
+inline float horizontalSum(__m256 x) {
+  __m128 x128 = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  x128 = _mm_hadd_ps(x128, x128);
+  x128 = _mm_hadd_ps(x128, x128);
+  return _mm_cvtss_f32(x128);
+}
+#endif
+
+// sum of a[i] * b[i]
+inline float dot(const float* a, const float* b, int n) {
+  float sum = 0.f;
+  int i = 0;
+#if defined(__AVX__) && !defined(ARM)
+  __m256 acc = _mm256_setzero_ps();
+  for(; i + 8 <= n; i += 8) {
+#ifdef __FMA__
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+#else
+    acc = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), acc);
+#endif
+  }
+  sum = horizontalSum(acc);
+#endif
+  for(; i < n; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+// y += w * x
+inline void axpy(float w, const float* x, float* y, int n) {
+  int i = 0;
+#if defined(__AVX__) && !defined(ARM)
+  __m256 w8 = _mm256_set1_ps(w);
+  for(; i + 8 <= n; i += 8) {
+#ifdef __FMA__
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(w8, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+#else
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_mul_ps(w8, _mm256_loadu_ps(x + i)), _mm256_loadu_ps(y + i)));
+#endif
+  }
+#endif
+  for(; i < n; ++i)
+    y[i] += w * x[i];
+}
+
+// x[i] = exp(x[i] - max), returns the sum
+inline float expSum(float* x, int n, float max) {
+  float sum = 0.f;
+  int i = 0;
+#if defined(__AVX__) && !defined(ARM)
+  __m256 max8 = _mm256_set1_ps(max);
+  __m256 acc = _mm256_setzero_ps();
+  for(; i + 8 <= n; i += 8) {
+    __m256 e = functional::Ops<float32x8>::exp(_mm256_sub_ps(_mm256_loadu_ps(x + i), max8));
+    _mm256_storeu_ps(x + i, e);
+    acc = _mm256_add_ps(acc, e);
+  }
+  sum = horizontalSum(acc);
+#endif
+  for(; i < n; ++i) {
+    x[i] = std::exp(x[i] - max);
+    sum += x[i];
+  }
+  return sum;
+}
+
+}  // namespace kvcache
+
+// Self-attention of one decoder step over all positions in the cache. Appends the keys and values
+// k and v [beam depth, batch size, 1, vector dim] of the step to the cache, then attends with the queries q
+// of the same shape over the history of each row. The optional mask [1, batch size or rows, 1, 1 or positions]
+// is added to the scaled scores.
+struct KVCacheAttentionNodeOp : public NaryNodeOp {
+  Ptr<KVCache> cache_;
+  int heads_;
+  float scale_;
+  int position_; // of the step when the node was created, only distinguishes the nodes of different steps
+
+  KVCacheAttentionNodeOp(const std::vector<Expr>& nodes, Ptr<KVCache> cache, int heads, float scale)
+      : NaryNodeOp(nodes, nodes[0]->shape(), Type::float32),
+        cache_(cache), heads_(heads), scale_(scale), position_(cache->nextPosition()) {
+    auto shape = nodes[0]->shape();
+    ABORT_IF(shape[-2] != 1, "Decoder self-attention cache appends one position at a time");
+    ABORT_IF(shape[-1] != cache->dimModel(), "Cache for vector dim {} cannot store {}", cache->dimModel(), shape[-1]);
+    ABORT_IF(shape[-1] % heads != 0, "Vector dim {} cannot be split into {} heads", shape[-1], heads);
+    ABORT_IF(nodes[1]->shape() != shape || nodes[2]->shape() != shape, "Queries, keys and values differ in shape");
+    setMemoize(false);
+  }
+
+  NodeOps forwardOps() override {
+    return {NodeOp(attend())};
+  }
+
+  void attend() {
+    int dimModel = cache_->dimModel();
+    int dimHead = dimModel / heads_;
+    int rows = val_->shape().elements() / dimModel;
+    int position = cache_->append(child(1)->val()->data(), child(2)->val()->data(), rows);
+    int positions = position + 1;
+
+    const float* mask = nullptr;
+    int maskRows = 1, maskPositions = 1;
+    if(children().size() > 3) {
+      auto maskShape = child(3)->shape();
+      maskRows = maskShape[-4];
+      maskPositions = maskShape[-1];
+      ABORT_IF(maskShape.elements() != maskRows * maskPositions
+               || rows % maskRows != 0 || (maskPositions != 1 && maskPositions != positions),
+               "Mask of shape {} does not fit {} rows and {} positions", maskShape, rows, positions);
+      mask = child(3)->val()->data();
+    }
+
+    const float* queries = child(0)->val()->data();
+    float* out = val_->data();
+    auto attendRows = [&](size_t begin, size_t end) {
+      std::vector<IndexType> rowsOf;
+      std::vector<const float*> keys, values; // of the positions the row attends to
+      std::vector<float> scores;              // [head, position]
+      std::vector<float> sums(heads_);
+      for(size_t r = begin; r < end; ++r) {
+        int first = cache_->history((int)r, rowsOf); // after the position of a sentence that joined the batch
+        int n = positions - first;
+        keys.resize(n);
+        values.resize(n);
+        for(int i = 0; i < n; ++i) {
+          keys[i] = cache_->key(first + i, rowsOf[first + i]);
+          values[i] = cache_->value(first + i, rowsOf[first + i]);
+        }
+
+        const float* q = queries + r * dimModel;
+        const float* maskRow = mask ? mask + (r % maskRows) * maskPositions : nullptr;
+        scores.resize((size_t)heads_ * n);
+        for(int i = 0; i < n; ++i) { // all heads of a position are next to each other in the cache
+          for(int h = 0; h < heads_; ++h) {
+            float score = scale_ * kvcache::dot(q + h * dimHead, keys[i] + h * dimHead, dimHead);
+            if(maskRow)
+              score += maskRow[maskPositions == 1 ? 0 : first + i];
+            scores[h * n + i] = score;
+          }
+        }
+        for(int h = 0; h < heads_; ++h) {
+          float* s = scores.data() + h * n;
+          sums[h] = kvcache::expSum(s, n, *std::max_element(s, s + n));
+        }
+
+        float* o = out + r * dimModel;
+        std::fill(o, o + dimModel, 0.f);
+        for(int i = 0; i < n; ++i)
+          for(int h = 0; h < heads_; ++h)
+            kvcache::axpy(scores[h * n + i] / sums[h], values[i] + h * dimHead, o + h * dimHead, dimHead);
+      }
+    };
+    parallelFor(val_, rows, (size_t)2 * positions * dimModel, attendRows);
+  }
+
+  NodeOps backwardOps() override {
+    ABORT("Only used for inference");
+    return {NodeOp(0)};
+  }
+
+  const std::string type() override { return "kvCacheAttention"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, cache_.get());
+    util::hash_combine(seed, heads_);
+    util::hash_combine(seed, scale_);
+    util::hash_combine(seed, position_);
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    if(!NaryNodeOp::equal(node))
+      return false;
+    auto cnode = std::dynamic_pointer_cast<KVCacheAttentionNodeOp>(node);
+    return cnode && cache_ == cnode->cache_ && heads_ == cnode->heads_ && scale_ == cnode->scale_
+           && position_ == cnode->position_;
+  }
+};
+
+}  // namespace cpu
+}  // namespace marian
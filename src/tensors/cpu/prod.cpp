@@ -16,7 +16,9 @@
 #endif
 
 #include "integer_common.h"
+#include "intra_op_pool.h"
 #include "prod_blas.h"
+#include "small_gemm.h"
 
 
 namespace marian {
@@ -50,19 +52,27 @@ void Prod(marian::Tensor C,
   if(transB)
     ldc = B->shape().elements() / B->shape()[-1];
 
-  sgemm(transA,
-        transB,
-        m,
-        n,
-        k,
-        alpha,
-        A->data(),
-        lda,
-        B->data(),
-        ldb,
-        beta,
-        C->data(),
-        ldc);
+  // With intra-op threads, split the rows of C or, when decoding few sentences, its columns
+  float* a = A->data();
+  float* b = B->data();
+  float* c = C->data();
+  if(m >= n) {
+    parallelFor(C, m, (size_t)n * k, [&](size_t begin, size_t end) {
+      sgemm(transA, transB, (int)(end - begin), n, k, alpha,
+            a + (transA ? begin : begin * lda), lda,
+            b, ldb,
+            beta,
+            c + begin * ldc, ldc);
+    });
+  } else {
+    parallelFor(C, n, (size_t)m * k, [&](size_t begin, size_t end) {
+      sgemm(transA, transB, m, (int)(end - begin), k, alpha,
+            a, lda,
+            b + (transB ? begin * ldb : begin), ldb,
+            beta,
+            c + begin, ldc);
+    });
+  }
 #else
   C; A; B; transA; transB; beta; scalar;
   ABORT("You need to compile with MKL in order to use the CPU version");
@@ -164,21 +174,36 @@ void ProdBatchedOld(marian::Tensor C,
     group_count,
     &group_size[0]);
 #else
-  for(size_t i = 0; i < batchC; ++i) {
-    sgemm(transA,
-          transB,
-          (int)m,
-          (int)n,
-          (int)k,
-          alpha,
-          A->data() + (i % batchA) * strideA,
-          (int)lda,
-          B->data() + (i % batchB) * strideB,
-          (int)ldb,
-          beta,
-          C->data() + i * strideC,
-          (int)ldc);
+  // e.g. attention, where one BLAS call per sentence and head costs more than the product itself
+  // products are split over the intra-op threads
+  if(small_gemm::isSmall(m, n, k)) {
+    parallelFor(C, batchC, m * n * k, [&](size_t begin, size_t end) {
+      small_gemm::gemmBatched(transA, transB, (int)m, (int)n, (int)k, alpha,
+                              A->data(), (int)lda, strideA, batchA,
+                              B->data(), (int)ldb, strideB, batchB,
+                              beta,
+                              C->data(), (int)ldc, strideC, begin, end);
+    });
+    return;
   }
+
+  parallelFor(C, batchC, m * n * k, [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; ++i) {
+      sgemm(transA,
+            transB,
+            (int)m,
+            (int)n,
+            (int)k,
+            alpha,
+            A->data() + (i % batchA) * strideA,
+            (int)lda,
+            B->data() + (i % batchB) * strideB,
+            (int)ldb,
+            beta,
+            C->data() + i * strideC,
+            (int)ldc);
+    }
+  });
 #endif
 }
 
@@ -0,0 +1,149 @@
+#pragma once
+
+// Batched GEMM for many small matrices, e.g. the per-head products in attention. Calling BLAS once per
+// matrix costs more in call overhead and packing than the multiplication itself for these shapes.
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX__) && !defined(ARM)
+#include <immintrin.h>
+#endif
+
+namespace marian {
+namespace cpu {
+namespace small_gemm {
+
+const int MR = 4;  // rows of C per micro-kernel
+const int NR = 16; // columns of C per micro-kernel
+
+// whether the products are small enough that the native kernel beats per-matrix BLAS calls
+inline bool isSmall(size_t m, size_t n, size_t k) {
+  return k <= 256 && m <= 256 && n <= 256;
+}
+
+// rows x NR block of C for a rows x k panel of A (packed as k columns of MR values) and a
+// k x NR panel of B (packed as k rows of NR values), accumulators are kept in registers
+template <int rows>
+inline void microKernel(int k, const float* a, const float* b, float* acc) {
+#if defined(__AVX__) && !defined(ARM)
+  __m256 c0[rows], c1[rows];
+  for(int r = 0; r < rows; ++r) {
+    c0[r] = _mm256_setzero_ps();
+    c1[r] = _mm256_setzero_ps();
+  }
+  for(int kk = 0; kk < k; ++kk) {
+    __m256 b0 = _mm256_loadu_ps(b + kk * NR);
+    __m256 b1 = _mm256_loadu_ps(b + kk * NR + 8);
+    for(int r = 0; r < rows; ++r) {
+      __m256 ar = _mm256_broadcast_ss(a + kk * MR + r);
+#ifdef __FMA__
+      c0[r] = _mm256_fmadd_ps(ar, b0, c0[r]);
+      c1[r] = _mm256_fmadd_ps(ar, b1, c1[r]);
+#else
+      c0[r] = _mm256_add_ps(_mm256_mul_ps(ar, b0), c0[r]);
+      c1[r] = _mm256_add_ps(_mm256_mul_ps(ar, b1), c1[r]);
+#endif
+    }
+  }
+  for(int r = 0; r < rows; ++r) {
+    _mm256_storeu_ps(acc + r * NR, c0[r]);
+    _mm256_storeu_ps(acc + r * NR + 8, c1[r]);
+  }
+#else // fixed-size loops the compiler vectorizes for the target instruction set
+  float c[rows][NR] = {};
+  for(int kk = 0; kk < k; ++kk)
+    for(int r = 0; r < rows; ++r)
+      for(int j = 0; j < NR; ++j)
+        c[r][j] += a[kk * MR + r] * b[kk * NR + j];
+  for(int r = 0; r < rows; ++r)
+    std::copy(c[r], c[r] + NR, acc + r * NR);
+#endif
+}
+
+// C[m x n] = alpha * op(A)[m x k] * op(B)[k x n] + beta * C, row-major like cblas_sgemm.
+// packA and packB need space for roundUp(m, MR) * k and roundUp(n, NR) * k floats.
+inline void gemm(bool transA, bool transB,
+                 int m, int n, int k,
+                 float alpha,
+                 const float* A, int lda,
+                 const float* B, int ldb,
+                 float beta,
+                 float* C, int ldc,
+                 float* packA, float* packB) {
+  // panels of NR columns of op(B), zero-padded
+  for(int j0 = 0; j0 < n; j0 += NR) {
+    float* panel = packB + (size_t)j0 * k;
+    int cols = std::min(NR, n - j0);
+    for(int kk = 0; kk < k; ++kk) {
+      float* row = panel + kk * NR;
+      for(int j = 0; j < cols; ++j)
+        row[j] = transB ? B[(size_t)(j0 + j) * ldb + kk] : B[(size_t)kk * ldb + j0 + j];
+      std::fill(row + cols, row + NR, 0.f);
+    }
+  }
+
+  // panels of MR rows of op(A), zero-padded
+  for(int i0 = 0; i0 < m; i0 += MR) {
+    float* panel = packA + (size_t)i0 * k;
+    int rows = std::min(MR, m - i0);
+    for(int kk = 0; kk < k; ++kk) {
+      float* col = panel + kk * MR;
+      for(int i = 0; i < rows; ++i)
+        col[i] = transA ? A[(size_t)kk * lda + i0 + i] : A[(size_t)(i0 + i) * lda + kk];
+      std::fill(col + rows, col + MR, 0.f);
+    }
+  }
+
+  float acc[MR * NR];
+  for(int i0 = 0; i0 < m; i0 += MR) {
+    int rows = std::min(MR, m - i0);
+    const float* a = packA + (size_t)i0 * k;
+    for(int j0 = 0; j0 < n; j0 += NR) {
+      const float* b = packB + (size_t)j0 * k;
+      switch(rows) { // single-row products are common when decoding
+        case 1:  microKernel<1>(k, a, b, acc); break;
+        case 2:  microKernel<2>(k, a, b, acc); break;
+        case 3:  microKernel<3>(k, a, b, acc); break;
+        default: microKernel<MR>(k, a, b, acc); break;
+      }
+
+      int cols = std::min(NR, n - j0);
+      for(int i = 0; i < rows; ++i) {
+        float* c = C + (size_t)(i0 + i) * ldc + j0;
+        const float* accRow = acc + i * NR;
+        if(beta == 0.f) // C may be uninitialized
+          for(int j = 0; j < cols; ++j)
+            c[j] = alpha * accRow[j];
+        else
+          for(int j = 0; j < cols; ++j)
+            c[j] = alpha * accRow[j] + beta * c[j];
+      }
+    }
+  }
+}
+
+// products batchBegin to batchEnd of a batch of products of the same shape, A and B are broadcast if their
+// batch size is 1
+inline void gemmBatched(bool transA, bool transB,
+                        int m, int n, int k,
+                        float alpha,
+                        const float* A, int lda, size_t strideA, size_t batchA,
+                        const float* B, int ldb, size_t strideB, size_t batchB,
+                        float beta,
+                        float* C, int ldc, size_t strideC, size_t batchBegin, size_t batchEnd) {
+  std::vector<float> packA((size_t)(m + MR - 1) / MR * MR * k);
+  std::vector<float> packB((size_t)(n + NR - 1) / NR * NR * k);
+  for(size_t i = batchBegin; i < batchEnd; ++i) {
+    gemm(transA, transB, m, n, k, alpha,
+         A + (i % batchA) * strideA, lda,
+         B + (i % batchB) * strideB, ldb,
+         beta,
+         C + i * strideC, ldc,
+         packA.data(), packB.data());
+  }
+}
+
+}  // namespace small_gemm
+}  // namespace cpu
+}  // namespace marian
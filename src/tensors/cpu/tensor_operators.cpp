@@ -5,6 +5,7 @@
 
 #include "tensors/tensor_operators.h"
 #include "tensors/cpu/backend.h"
+#include "tensors/cpu/intra_op_pool.h"
 #include "tensors/allocator.h"
 
 #include "functional/approx.h"
@@ -400,7 +401,8 @@ void Softmax(Tensor out, Tensor in) {
   int rows = fout.shape().elements() / fout.shape().back();
   int cols = fout.shape().back();
 
-  for(int j = 0; j < rows; ++j) {
+  parallelFor(out, rows, cols * sizeof(ElementType), [&](size_t begin, size_t end) {
+  for(int j = (int)begin; j < (int)end; ++j) {
     ElementType* so = pOut + j * cols;
     const ElementType* sp = pIn + j * cols;
 
@@ -426,6 +428,7 @@ void Softmax(Tensor out, Tensor in) {
       so[i] = Ops<ElementType>::div(so[i], sums);
     }
   }
+  });
 }
 
 
@@ -460,7 +463,8 @@ void LogSoftmax(Tensor out, Tensor in) {
   int rows = fout.shape().elements() / fout.shape().back();
   int cols = fout.shape().back();
 
-  for(int j = 0; j < rows; ++j) {
+  parallelFor(out, rows, cols * sizeof(ElementType), [&](size_t begin, size_t end) {
+  for(int j = (int)begin; j < (int)end; ++j) {
     ElementType* so = pOut + j * cols;
     const ElementType* sp = pIn + j * cols;
 
@@ -483,6 +487,7 @@ void LogSoftmax(Tensor out, Tensor in) {
       so[i] = Ops<ElementType>::sub(so[i], logSum);
     }
   }
+  });
 }
 
 void LogSoftmax(Tensor out, Tensor in) {
@@ -564,8 +569,8 @@ void CopyRows(Tensor out_,
   float* out = out_->data();
   const float* in = in_->data();
 
-#pragma omp parallel for
-  for(size_t j = 0; j < rows; ++j) {
+  parallelFor(out_, rows, cols, [&](size_t begin, size_t end) {
+  for(size_t j = begin; j < end; ++j) {
     size_t dst = j;
 
     // @TODO: consider moving type checking to this function
@@ -577,6 +582,7 @@ void CopyRows(Tensor out_,
 
     std::copy(rowIn, rowIn + cols, rowOut);
   }
+  });
 }
 
 void PasteRows(Tensor out_,
@@ -1107,7 +1113,6 @@ void LayerNormalizationImpl(float* out,
                             float eps,
                             int rows,
                             int cols) {
-#pragma omp parallel for
   for(int j = 0; j < rows; ++j) {
     float* so = out + j * cols;
     const float* sp = in + j * cols;
@@ -1171,11 +1176,15 @@ void LayerNormalization(Tensor out_,
 
   int rows = in_->shape().elements() / in_->shape().back();
   int cols = in_->shape().back();
-  if (alphaStride == 0) {
-    LayerNormalizationDispatchBeta<0>(out, in, alpha, beta, eps, rows, cols);
-  } else {
-    LayerNormalizationDispatchBeta<1>(out, in, alpha, beta, eps, rows, cols);
-  }
+  parallelFor(out_, rows, cols * 4, [&](size_t begin, size_t end) {
+    size_t offset = begin * cols;
+    int n = (int)(end - begin);
+    if (alphaStride == 0) {
+      LayerNormalizationDispatchBeta<0>(out + offset, in + offset, alpha, beta, eps, n, cols);
+    } else {
+      LayerNormalizationDispatchBeta<1>(out + offset, in + offset, alpha, beta, eps, n, cols);
+    }
+  });
 }
 
 MARIAN_FFAST_MATH_BEGIN
@@ -1,18 +1,152 @@
+#include "tensors/cpu/topk.h"
 #include "tensors/tensor_operators.h"
 #include "tensors/allocator.h"
-#include <numeric>
 
-// CPU implementation of proper Marian top-k operator for TopkNodeOp
-// This file contains a lot of code-duplicaton with src/translator/nth_element.cpp
-// the goal is to replace the beam-search specific topk search with this code. 
-// Currently this is only used in the unit tests, but we will move forward and 
-// make the beam-search more graph and operator-based.
+#include <algorithm>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#elif __SSE__
+#include <xmmintrin.h>
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// CPU implementation of proper Marian top-k operator for TopkNodeOp.
+// The row-wise selection in TopKSelector is also used by the beam search in src/translator/nth_element.cpp.
 
 namespace marian {
-namespace cpu {  
+namespace cpu {
+
+namespace {
+
+typedef std::pair<float, IndexType> ValueIndex;
+
+// strict ordering, true if a should come before b in the result
+template <bool descending>
+struct Better {
+  bool operator()(const ValueIndex& a, const ValueIndex& b) const {
+    if(a.first != b.first)
+      return descending ? a.first > b.first : a.first < b.first;
+    return a.second < b.second;
+  }
+};
+
+inline unsigned int lowestSetBit(unsigned int mask) {
+#ifdef _MSC_VER
+  unsigned long pos;
+  _BitScanForward(&pos, mask);
+  return (unsigned int)pos;
+#else
+  return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+// Returns a bit mask of the positions in in[0, BLOCK) whose values beat the threshold.
+#ifdef __AVX512F__
+const size_t BLOCK = 16;
+template <bool descending>
+inline unsigned int candidates(const float* in, float threshold) {
+  __m512 v = _mm512_loadu_ps(in);
+  __m512 t = _mm512_set1_ps(threshold);
+  return (unsigned int)_mm512_cmp_ps_mask(v, t, descending ? _CMP_GT_OQ : _CMP_LT_OQ);
+}
+#elif __AVX__
+const size_t BLOCK = 8;
+template <bool descending>
+inline unsigned int candidates(const float* in, float threshold) {
+  __m256 v = _mm256_loadu_ps(in);
+  __m256 t = _mm256_set1_ps(threshold);
+  return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(v, t, descending ? _CMP_GT_OQ : _CMP_LT_OQ));
+}
+#elif __SSE__
+const size_t BLOCK = 4;
+template <bool descending>
+inline unsigned int candidates(const float* in, float threshold) {
+  __m128 v = _mm_loadu_ps(in);
+  __m128 t = _mm_set1_ps(threshold);
+  return (unsigned int)_mm_movemask_ps(descending ? _mm_cmpgt_ps(v, t) : _mm_cmplt_ps(v, t));
+}
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+const size_t BLOCK = 4;
+template <bool descending>
+inline unsigned int candidates(const float* in, float threshold) {
+  float32x4_t v = vld1q_f32(in);
+  float32x4_t t = vdupq_n_f32(threshold);
+  uint32x4_t m = descending ? vcgtq_f32(v, t) : vcltq_f32(v, t);
+  if(vmaxvq_u32(m) == 0) // common case, nothing in this block can enter the heap
+    return 0;
+  static const uint32_t bits[4] = {1, 2, 4, 8};
+  return vaddvq_u32(vandq_u32(m, vld1q_u32(bits)));
+}
+#else
+const size_t BLOCK = 1;
+template <bool descending>
+inline unsigned int candidates(const float* in, float threshold) {
+  return (descending ? in[0] > threshold : in[0] < threshold) ? 1 : 0;
+}
+#endif
+
+template <bool descending>
+void selectTopK(const float* in, size_t cols, size_t k,
+                std::vector<ValueIndex>& heap,
+                IndexType* outIndices, float* outValues) {
+  Better<descending> better; // with this comparator the heap root is the worst of the current k best
+  heap.clear();
+
+  size_t i = 0;
+  for(; i < cols && heap.size() < k; ++i) {
+    heap.emplace_back(in[i], (IndexType)i);
+    std::push_heap(heap.begin(), heap.end(), better);
+  }
+
+  auto offer = [&](size_t j) {
+    ValueIndex candidate(in[j], (IndexType)j);
+    if(better(candidate, heap.front())) {
+      std::pop_heap(heap.begin(), heap.end(), better);
+      heap.back() = candidate;
+      std::push_heap(heap.begin(), heap.end(), better);
+    }
+  };
+
+  if(!heap.empty()) {
+    // Values equal to the threshold never enter the heap since they come with a larger index,
+    // so a strict comparison in candidates() is sufficient. The threshold only ever improves,
+    // positions flagged in a block are re-checked against the updated root in offer().
+    for(; i + BLOCK <= cols; i += BLOCK)
+      for(unsigned int mask = candidates<descending>(in + i, heap.front().first); mask; mask &= mask - 1)
+        offer(i + lowestSetBit(mask));
+    for(; i < cols; ++i)
+      offer(i);
+  }
+
+  std::sort_heap(heap.begin(), heap.end(), better); // best first
+  for(size_t j = 0; j < heap.size(); ++j) {
+    outIndices[j] = heap[j].second;
+    outValues[j]  = heap[j].first;
+  }
+}
+
+}  // namespace
+
+void TopKSelector::select(const float* in,
+                          size_t cols,
+                          size_t k,
+                          bool descending,
+                          IndexType* outIndices,
+                          float* outValues) {
+  if(descending)
+    selectTopK</*descending=*/true>(in, cols, k, heap_, outIndices, outValues);
+  else
+    selectTopK</*descending=*/false>(in, cols, k, heap_, outIndices, outValues);
+}
 
 void TopK(Tensor outVal, Tensor outInd, Ptr<Allocator> /*allocator*/, const Tensor in, int k, int axis, bool descending) {
-  
+
   ABORT_IF(axis != in->shape().size() - 1, "Currently only works for last axis");
   ABORT_IF(in->type() != Type::float32, "Input should have type {}", Type::float32);
   ABORT_IF(outInd->type() != Type::uint32, "Output should be have type {}", Type::uint32);
@@ -22,28 +156,14 @@ void TopK(Tensor outVal, Tensor outInd, Ptr<Allocator> /*allocator*/, const Tens
 
   ABORT_IF(k > cols, "Cannot select more than {} elements for axis {}", cols, axis);
 
-  std::vector<IndexType> idxs(cols);
-  std::iota(idxs.begin(), idxs.end(), 0);
+  TopKSelector selector;
 
   const float* inDataPtr = in->data<float>();
   IndexType* outIndPtr   = outInd->data<IndexType>();
   float* outValPtr       = outVal->data<float>();
   for(int i = 0; i < rows; ++i) {
-    std::partial_sort( 
-      // sorts the top N (beam size) idxs by score to the front
-      idxs.begin(),
-      idxs.begin() + k,
-      idxs.end(),
-      [&](int a, int b) { 
-        return descending ? inDataPtr[a] > inDataPtr[b] : inDataPtr[a] < inDataPtr[b]; 
-      }
-    );
-    
-    for(int j = 0; j < k; j++) {
-      outIndPtr[j] = idxs[j];
-      outValPtr[j] = inDataPtr[idxs[j]];
-    }
-    
+    selector.select(inDataPtr, cols, k, descending, outIndPtr, outValPtr);
+
     outIndPtr += k;
     outValPtr += k;
     inDataPtr += cols;
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common/definitions.h"
+
+#include <utility>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+// Selects the k best values of a contiguous row of floats (largest if descending, else smallest)
+// in a single streaming pass. The current k best entries are kept in a small heap whose root is the
+// worst of them; blocks of values that cannot beat the root are skipped with a SIMD comparison.
+// Results are written best first. Among equal values the one with the lower index is preferred.
+// Shared by the TopK operator and the beam search n-best selection in translator/nth_element.cpp.
+class TopKSelector {
+private:
+  std::vector<std::pair<float, IndexType>> heap_; // [k] (value, index), re-used between calls
+
+public:
+  void select(const float* in,       // [cols]
+              size_t cols,
+              size_t k,
+              bool descending,
+              IndexType* outIndices, // [k]
+              float* outValues);     // [k]
+};
+
+}  // namespace cpu
+}  // namespace marian
@@ -5,9 +5,12 @@
 #include "tensors/gpu/backend.h"
 #endif
 
+#include "models/transformer.h"
 #include "rnn/rnn.h"
 #include "rnn/constructors.h"
 #include "rnn/attention.h"
+#include "tensors/cpu/int8_attention.h"
+#include "tensors/cpu/kv_cache.h"
 
 using namespace marian;
 
@@ -147,3 +150,213 @@ TEST_CASE("Model components, Attention (cpu)", "[attention]") {
   tests<float>(DeviceType::cpu);
 }
 #endif
+
+#ifdef BLAS_FOUND
+// values in [-1, 1) that differ between heads
+static std::vector<float> attentionValues(const Shape& shape, int seed) {
+  std::vector<float> values(shape.elements());
+  for(size_t i = 0; i < values.size(); ++i)
+    values[i] = std::sin(0.37f * (float)i + (float)seed) * (1.f - 0.5f * (float)((i / 7) % 2));
+  return values;
+}
+
+TEST_CASE("Int8 attention products match float bdot (cpu)", "[attention]") {
+  auto floatApprox = [](float x, float y) { return x == Approx(y).margin(0.02f); };
+
+  Config::seed = 1234;
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDefaultElementType(Type::float32);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  // queries of all beam entries share the keys and values of their sentence, heads of the
+  // queries are [beam, batch, head], those of keys and values [batch, head]
+  int dimBeam = 2, dimBatch = 3, dimHeads = 2, dimSrc = 7, dimK = 20; // dimK is not a multiple of the SIMD width
+  Shape qShape({dimBeam * dimBatch, dimHeads, 1, dimK});
+  Shape kShape({dimBatch, dimHeads, dimSrc, dimK});
+
+  auto q = graph->constant(qShape, inits::fromVector(attentionValues(qShape, 1)));
+  auto k = graph->constant(kShape, inits::fromVector(attentionValues(kShape, 2)));
+  auto v = graph->constant(kShape, inits::fromVector(attentionValues(kShape, 3)));
+  float scale = 1.f / std::sqrt((float)dimK);
+
+  // float reference with keys and values repeated for each beam entry
+  auto kBeam = concatenate({k, k}, /*axis=*/-4);
+  auto vBeam = concatenate({v, v}, /*axis=*/-4);
+
+  SECTION("queries times transposed keys") {
+    auto qMults = cpu::integer::headQuantMults(q);
+    auto kMults = cpu::integer::headQuantMults(k);
+    auto z8 = cpu::integer::bdotInt8(cpu::integer::quantizeHeads(q, qMults), qMults,
+                                     cpu::integer::quantizeHeads(k, kMults), kMults, scale);
+    auto z  = bdot(q, kBeam, false, true, scale);
+    graph->forward();
+
+    CHECK( z8->shape() == Shape({dimBeam * dimBatch, dimHeads, 1, dimSrc}) );
+    std::vector<float> values, expected;
+    z8->val()->get(values);
+    z->val()->get(expected);
+    CHECK( std::equal(values.begin(), values.end(), expected.begin(), floatApprox) );
+  }
+
+  SECTION("attention weights times transposed values") {
+    auto weights = softmax(bdot(q, kBeam, false, true, scale));
+    auto wMults = cpu::integer::headQuantMults(weights);
+    auto vMults = cpu::integer::headQuantMults(v);
+    auto vQuant = cpu::integer::quantizeHeads(v, vMults, /*transpose=*/true);
+    auto out8 = cpu::integer::bdotInt8(cpu::integer::quantizeHeads(weights, wMults), wMults, vQuant, vMults, 1.f);
+    auto out  = bdot(weights, vBeam);
+    graph->forward();
+
+    // each head of the quantized values is transposed and scaled with 127 / max(|head|)
+    CHECK( vQuant->shape() == Shape({dimBatch, dimHeads, dimK, dimSrc}) );
+    std::vector<float> vValues = attentionValues(kShape, 3);
+    std::vector<int8_t> quantized;
+    vQuant->val()->get(quantized);
+    for(int h = 0; h < dimBatch * dimHeads; ++h) {
+      const float* head = vValues.data() + h * dimSrc * dimK;
+      float maxAbs = 0.f;
+      for(int i = 0; i < dimSrc * dimK; ++i)
+        maxAbs = std::max(maxAbs, std::abs(head[i]));
+      for(int s = 0; s < dimSrc; ++s)
+        for(int d = 0; d < dimK; ++d)
+          CHECK( (int)quantized[(h * dimK + d) * dimSrc + s] == (int)std::round(head[s * dimK + d] * (127.f / maxAbs)) );
+    }
+
+    CHECK( out8->shape() == out->shape() );
+    std::vector<float> values, expected;
+    out8->val()->get(values);
+    out->val()->get(expected);
+    CHECK( std::equal(values.begin(), values.end(), expected.begin(), floatApprox) );
+  }
+
+  SECTION("cached keys are quantized again for new keys") {
+    auto options = New<Options>();
+    options->set("inference", true);
+    EncoderTransformer transformer(graph, options);
+
+    auto cached = transformer.QuantizeHeads("test_keys", k, /*cache=*/true);
+    CHECK( transformer.QuantizeHeads("test_keys", k, /*cache=*/true).first == cached.first );
+
+    // e.g. the next batch, the cache must not return the keys of the previous one
+    auto k2 = graph->constant(kShape, inits::fromVector(attentionValues(kShape, 4)));
+    auto requantized = transformer.QuantizeHeads("test_keys", k2, /*cache=*/true);
+    CHECK( requantized.first != cached.first );
+    CHECK( transformer.QuantizeHeads("test_keys", k2, /*cache=*/true).first == requantized.first );
+    graph->forward();
+
+    std::vector<float> k2Values = attentionValues(kShape, 4);
+    std::vector<int8_t> quantized;
+    requantized.first->val()->get(quantized);
+    for(int h = 0; h < dimBatch * dimHeads; ++h) {
+      float maxAbs = 0.f;
+      for(int i = 0; i < dimSrc * dimK; ++i)
+        maxAbs = std::max(maxAbs, std::abs(k2Values[h * dimSrc * dimK + i]));
+      for(int i = 0; i < dimSrc * dimK; ++i)
+        CHECK( (int)quantized[h * dimSrc * dimK + i] == (int)std::round(k2Values[h * dimSrc * dimK + i] * (127.f / maxAbs)) );
+    }
+  }
+}
+
+TEST_CASE("Decoder self-attention reads the cache through hypothesis back-pointers (cpu)", "[attention]") {
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDefaultElementType(Type::float32);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  const int dimModel = 6, heads = 2, dimHead = dimModel / heads;
+  const float scale = 1.f / std::sqrt((float)dimHead);
+  // reserves fewer positions than are appended below, so the buffers have to grow
+  auto cache = New<cpu::KVCache>(dimModel, /*rows=*/1, /*positions=*/2);
+
+  // reference: the keys and values of each row as rnn::State::select() would keep them
+  std::vector<std::vector<std::vector<float>>> keys, values; // [row][position][dim]
+  auto select = [&](const std::vector<IndexType>& selIdx) {
+    cache->select(selIdx);
+    std::vector<std::vector<std::vector<float>>> selectedKeys, selectedValues;
+    for(auto i : selIdx) {
+      selectedKeys.push_back(i == cpu::KVCache::NEW_ROW ? std::vector<std::vector<float>>() : keys[i]);
+      selectedValues.push_back(i == cpu::KVCache::NEW_ROW ? std::vector<std::vector<float>>() : values[i]);
+    }
+    keys.swap(selectedKeys);
+    values.swap(selectedValues);
+  };
+
+  // one step with the given number of rows, rows are [beam depth, batch size] flattened
+  auto step = [&](int t, int rows) {
+    std::vector<float> q(rows * dimModel), k(rows * dimModel), v(rows * dimModel);
+    for(int r = 0; r < rows; ++r) {
+      for(int d = 0; d < dimModel; ++d) {
+        q[r * dimModel + d] = 0.1f * ((r + d + t) % 5) - 0.2f;
+        k[r * dimModel + d] = 0.1f * ((3 * r + d + 2 * t) % 7) - 0.3f;
+        v[r * dimModel + d] = 10.f * t + r + 0.1f * d;
+      }
+      if(t == 0) {
+        keys.emplace_back();
+        values.emplace_back();
+      }
+      keys[r].emplace_back(k.begin() + r * dimModel, k.begin() + (r + 1) * dimModel);
+      values[r].emplace_back(v.begin() + r * dimModel, v.begin() + (r + 1) * dimModel);
+    }
+    auto input = [&](const std::vector<float>& x) { return graph->constant({1, rows, 1, dimModel}, inits::fromVector(x)); };
+    auto out = Expression<cpu::KVCacheAttentionNodeOp>(std::vector<Expr>{input(q), input(k), input(v)}, cache, heads, scale);
+    if(t == 0)
+      graph->forward();
+    else
+      graph->forwardNext();
+
+    CHECK( out->shape() == Shape({1, rows, 1, dimModel}) );
+    std::vector<float> output;
+    out->val()->get(output);
+    for(int r = 0; r < rows; ++r) {
+      int positions = (int)keys[r].size(); // fewer than t + 1 for rows that joined later
+      for(int h = 0; h < heads; ++h) {
+        std::vector<float> weights(positions);
+        float sum = 0.f;
+        for(int p = 0; p < positions; ++p) {
+          float score = 0.f;
+          for(int j = 0; j < dimHead; ++j)
+            score += q[r * dimModel + h * dimHead + j] * keys[r][p][h * dimHead + j];
+          weights[p] = std::exp(score * scale);
+          sum += weights[p];
+        }
+        for(int j = 0; j < dimHead; ++j) {
+          float expected = 0.f;
+          for(int p = 0; p < positions; ++p)
+            expected += weights[p] / sum * values[r][p][h * dimHead + j];
+          CHECK( output[r * dimModel + h * dimHead + j] == Approx(expected).epsilon(1e-5) );
+        }
+      }
+    }
+    CHECK( cache->positions() <= t + 1 );
+  };
+
+  step(0, 2);
+  select({0, 1, 0, 1}); // beam of 2 for a batch of 2
+  step(1, 4);
+  select({3, 0, 1, 2});
+  step(2, 4);
+  select({2, 3});       // sentences dropped from the batch, then reordered before the next step
+  select({1, 0});
+  step(3, 2);
+  select({0, 1});       // nothing to reorder
+  step(4, 2);
+  select({0, 1, 1, 0}); // more rows than before
+  step(5, 4);
+  select({1, 1, 3, 2});
+  step(6, 4);
+  CHECK( cache->positions() == 7 );
+
+  // sentences joining a running batch (continuous batching) start without previous positions
+  const auto newRow = cpu::KVCache::NEW_ROW;
+  select({1, newRow, 3, newRow});
+  step(7, 4);
+  select({newRow, newRow, newRow, newRow, 1, 3}); // rows 1 and 3 joined in the last step, no row reads the positions before
+  step(8, 6);
+  for(int t = 9; t < 40; ++t) {
+    select({5, 4, 3, 2, 1, 0});
+    step(t, 6);
+  }
+  CHECK( cache->positions() == 40 - 7 ); // dropped once the number of positions doubled
+}
+#endif
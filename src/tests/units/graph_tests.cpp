@@ -1,6 +1,12 @@
 #include "catch.hpp"
 #include "graph/expression_graph.h"
 #include "graph/expression_operators.h"
+#include "common/io.h"
+#include "tensors/allocator.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 
 #ifdef CUDA_FOUND
 #include "tensors/gpu/backend.h"
@@ -121,3 +127,159 @@ TEST_CASE("Expression graph can be initialized with constant values (cpu)",
     REQUIRE(values == v);
   }
 }
+
+TEST_CASE("Models can be memory-mapped into one graph with and without alignment (cpu)", "[graph]") {
+  std::vector<float> vW({1, 2, 3, 4, 5, 6});
+  std::vector<float> vB({-1, -2, -3});
+
+  // binary model with two float32 items
+  std::vector<io::Item> items(2);
+  items[0].name = "W";
+  items[0].shape = {2, 3};
+  items[0].bytes.assign((const char*)vW.data(), (const char*)(vW.data() + vW.size()));
+  items[1].name = "b";
+  items[1].shape = {1, 3};
+  items[1].bytes.assign((const char*)vB.data(), (const char*)(vB.data() + vB.size()));
+  // items are padded to 256 bytes like in converted models, so that all of them can be mapped
+  for(auto& item : items)
+    item.bytes.resize((item.bytes.size() + 255) / 256 * 256);
+
+  const std::string fileName = "graph_tests_mmap.bin";
+  io::saveItems(fileName, items);
+  std::ifstream file(fileName, std::ios::binary);
+  std::vector<char> model((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  file.close();
+  std::remove(fileName.c_str());
+
+  // copies of the model that start at a 256-byte boundary, whose items are used from the buffer,
+  // and 8 bytes after one, whose items are copied into regular tensors
+  std::vector<char> buffer(2 * model.size() + 1024);
+  char* aligned = buffer.data() + (256 - (uintptr_t)buffer.data() % 256) % 256;
+  char* unaligned = aligned + (model.size() + 255) / 256 * 256 + 256 + 8;
+  std::copy(model.begin(), model.end(), aligned);
+  std::copy(model.begin(), model.end(), unaligned);
+
+  auto inBuffer = [&](Expr p, const char* start) {
+    auto data = (const char*)p->val()->data();
+    return data >= start && data < start + model.size();
+  };
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(4);
+
+  std::vector<float> values;
+  auto check = [&](const std::string& name) {
+    graph->switchParams(name);
+    auto W = graph->get("W");
+    auto b = graph->get("b");
+    REQUIRE(W);
+    REQUIRE(b);
+    W->val()->get(values);
+    CHECK(values == vW);
+    b->val()->get(values);
+    CHECK(values == vB);
+    return inBuffer(W, aligned) && inBuffer(b, aligned);
+  };
+
+  SECTION("aligned model first") {
+    graph->switchParams("F0");
+    graph->mmap(aligned);
+    graph->switchParams("F1");
+    graph->mmap(unaligned);
+    graph->forward();
+
+    CHECK(check("F0"));
+    CHECK(!check("F1"));
+  }
+
+  SECTION("unaligned model first") {
+    graph->switchParams("F0");
+    graph->mmap(unaligned);
+    graph->switchParams("F1");
+    graph->mmap(aligned);
+    graph->forward();
+
+    CHECK(!check("F0"));
+    CHECK(!check("F1")); // float32 parameters already exist, so the mapped items are copied into them
+  }
+}
+
+TEST_CASE("Allocator coalesces free gaps, also across growing (cpu)", "[allocator]") {
+  const size_t piece = 256;
+  Allocator allocator({0, DeviceType::cpu}, 4 * piece, /*step=*/4 * piece, /*alignment=*/piece);
+  auto offset = [&](MemoryPiece::PtrType mp) { return (size_t)(mp->data() - allocator.memory()->data()); };
+
+  std::vector<MemoryPiece::PtrType> pieces;
+  for(int i = 0; i < 4; ++i)
+    pieces.push_back(allocator.alloc(piece));
+  CHECK( allocator.available() == 0 );
+
+  SECTION("freed neighbours on both sides form one gap") {
+    allocator.free(pieces[1]);
+    allocator.free(pieces[3]);
+    allocator.free(pieces[2]);
+    CHECK( allocator.available() == 3 * piece );
+
+    auto mp = allocator.alloc(3 * piece); // fits without growing only if the three pieces were combined
+    CHECK( allocator.size() == 4 * piece );
+    CHECK( offset(mp) == piece );
+  }
+
+  SECTION("the gap at the end is combined with the grown memory") {
+    allocator.free(pieces[3]);
+    auto mp = allocator.alloc(2 * piece); // does not fit, grows by 4 pieces
+    CHECK( allocator.size() == 8 * piece );
+    CHECK( offset(mp) == 3 * piece );     // starts in the old gap
+    CHECK( allocator.available() == 3 * piece );
+
+    // allocated pieces moved with the memory
+    for(int i = 0; i < 3; ++i)
+      CHECK( offset(pieces[i]) == i * piece );
+
+    allocator.free(pieces[1]);
+    allocator.free(pieces[0]);
+    allocator.free(mp);
+    allocator.free(pieces[2]);
+    CHECK( allocator.available() == 8 * piece );
+
+    auto all = allocator.alloc(8 * piece); // everything is one gap again
+    CHECK( allocator.size() == 8 * piece );
+    CHECK( offset(all) == 0 );
+  }
+}
+
+TEST_CASE("Recorded nodes are replayed with rewritten constants (cpu)", "[graph]") {
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(4);
+
+  auto W = graph->param("W", {2, 3}, inits::fromVector(std::vector<float>({1, 2, 3, 4, 5, 6})));
+  graph->forward();
+
+  graph->startRecording();
+  auto x = graph->constant({1, 2}, inits::fromVector(std::vector<float>({1, 1})));
+  auto y = relu(dot(x, W) - 6.f);
+  graph->forwardNext();
+  graph->stopRecording();
+
+  std::vector<float> values;
+  y->val()->get(values);
+  CHECK(values == std::vector<float>({0, 1, 3}));
+
+  graph->rewrite(x, inits::fromVector(std::vector<float>({2, 1})));
+  graph->replay();
+  y->val()->get(values);
+  CHECK(values == std::vector<float>({0, 3, 6}));
+
+  // nodes built after recording are computed as usual and do not change the recorded ones
+  auto z = y * 2.f;
+  graph->forwardNext();
+  z->val()->get(values);
+  CHECK(values == std::vector<float>({0, 6, 12}));
+
+  graph->rewrite(x, inits::fromVector(std::vector<float>({0, 2})));
+  graph->replay();
+  y->val()->get(values);
+  CHECK(values == std::vector<float>({2, 4, 6}));
+}
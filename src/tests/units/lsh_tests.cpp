@@ -0,0 +1,106 @@
+#include "catch.hpp"
+#include "graph/expression_graph.h"
+#include "layers/lsh.h"
+
+#if BLAS_FOUND
+#include "faiss/IndexLSH.h"
+#endif
+
+#include <algorithm>
+#include <bitset>
+#include <random>
+
+using namespace marian;
+
+#if BLAS_FOUND
+TEST_CASE("Hamming k-nearest neighbours match a full sort (cpu)", "[lsh]") {
+  std::mt19937 rng(1234);
+
+  // few bits give many ties, the row counts cross the query and code blocks of the search
+  for(int nbits : {12, 100}) {
+    const int words = (nbits + 63) / 64;
+    const int qRows = 20, vRows = 300;
+
+    auto randomCodes = [&](int rows) {
+      std::vector<uint64_t> codes((size_t)rows * words, 0);
+      for(int r = 0; r < rows; ++r)
+        for(int j = 0; j < nbits; ++j)
+          if(rng() % 2)
+            codes[(size_t)r * words + j / 64] |= (uint64_t)1 << (j % 64);
+      return codes;
+    };
+    auto queries = randomCodes(qRows);
+    auto codes = randomCodes(vRows);
+
+    for(int k : {1, 10, vRows - 1, vRows}) {
+      std::vector<IndexType> ids((size_t)qRows * k);
+      LSH::hammingKnn(queries.data(), qRows, codes.data(), vRows, words, nbits, k, ids.data());
+
+      for(int q = 0; q < qRows; ++q) {
+        // ids by distance, ties by lowest id
+        std::vector<std::pair<int, IndexType>> sorted;
+        for(int v = 0; v < vRows; ++v) {
+          int d = 0;
+          for(int w = 0; w < words; ++w)
+            d += (int)std::bitset<64>(queries[(size_t)q * words + w] ^ codes[(size_t)v * words + w]).count();
+          sorted.emplace_back(d, (IndexType)v);
+        }
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<IndexType> expected;
+        for(int i = 0; i < k; ++i)
+          expected.push_back(sorted[i].second);
+        std::sort(expected.begin(), expected.end());
+
+        std::vector<IndexType> found(ids.begin() + (size_t)q * k, ids.begin() + (size_t)(q + 1) * k);
+        std::sort(found.begin(), found.end()); // in no particular order
+
+        INFO("nbits=" << nbits << " k=" << k << " query=" << q);
+        CHECK( found == expected );
+      }
+    }
+  }
+}
+
+TEST_CASE("LSH index items match the codes of faiss::IndexLSH (cpu)", "[lsh]") {
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDefaultElementType(Type::float32);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  const int rows = 50, dim = 32;
+  std::mt19937 rng(1234);
+  std::normal_distribution<float> normal(0.f, 1.f);
+  std::vector<float> vValues(rows * dim);
+  for(auto& v : vValues)
+    v = normal(rng);
+  auto values = graph->constant({rows, dim}, inits::fromVector(vValues));
+  graph->forward();
+
+  // with a rotation to more or fewer bits, and without one when the number of bits is the dimension
+  for(int nbits : {16, 32, 100}) {
+    auto items = LSH::createIndexItems("Wemb", values->val(), nbits);
+    CHECK( items.size() == (nbits != dim ? 2 : 1) );
+    const auto& codes = items.back();
+    CHECK( codes.name == "Wemb_lsh_codes" );
+    int bytes = codes.shape[-1];
+    CHECK( bytes == (nbits + 63) / 64 * 8 );
+
+    faiss::IndexLSH index(dim, nbits, /*rotate=*/nbits != dim, /*train_thresholds=*/false);
+    index.train(rows, vValues.data());
+    index.add(rows, vValues.data());
+    CHECK( (int)index.bytes_per_vec == (nbits + 7) / 8 );
+
+    const uint8_t* ours = (const uint8_t*)codes.bytes.data();
+    for(int r = 0; r < rows; ++r) {
+      INFO("nbits=" << nbits << " row=" << r);
+      CHECK( std::equal(ours + r * bytes, ours + r * bytes + index.bytes_per_vec,
+                        index.codes.data() + r * index.bytes_per_vec) );
+      // padding up to whole 64-bit words
+      if(nbits % 8 != 0)
+        CHECK( (ours[r * bytes + nbits / 8] >> (nbits % 8)) == 0 );
+      CHECK( std::all_of(ours + r * bytes + index.bytes_per_vec, ours + (r + 1) * bytes,
+                         [](uint8_t b) { return b == 0; }) );
+    }
+  }
+}
+#endif
@@ -5,12 +5,25 @@
 #include "catch.hpp"
 #include "graph/expression_graph.h"
 #include "graph/expression_operators.h"
+#include "tensors/cpu/expression_graph_packable.h"
+#include "tensors/cpu/int4_gemm.h"
+#include "tensors/cpu/integer_common.h"
+#include "tensors/cpu/intgemm_interface.h"
+#include "tensors/cpu/prod_blas.h"
+#include "tensors/cpu/topk.h"
+#include "tensors/tensor_allocator.h"
+#include "tensors/tensor_operators.h"
 
 #ifdef CUDA_FOUND
 #include "tensors/gpu/backend.h"
 #endif
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <random>
 
 using namespace marian;
 
@@ -992,6 +1005,617 @@ TEST_CASE("Expression graph supports basic math operations (gpu fp16)", "[operat
 TEST_CASE("Expression graph supports basic math operations (cpu)", "[operator]") {
   tests<float>(DeviceType::cpu);
 }
+
+// k best (value, index) pairs of a row by full sort, lower index first among equal values
+static std::vector<std::pair<float, IndexType>> topkReference(const std::vector<float>& row, size_t k, bool descending) {
+  std::vector<std::pair<float, IndexType>> sorted;
+  for(size_t i = 0; i < row.size(); ++i)
+    sorted.emplace_back(row[i], (IndexType)i);
+  std::stable_sort(sorted.begin(), sorted.end(), [=](const std::pair<float, IndexType>& a, const std::pair<float, IndexType>& b) {
+    return descending ? a.first > b.first : a.first < b.first;
+  });
+  sorted.resize(k);
+  return sorted;
+}
+
+TEST_CASE("TopKSelector selects the k best values of a row (cpu)", "[operator]") {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> uniform(-10.f, 10.f);
+
+  cpu::TopKSelector selector; // re-used for all calls like in the beam search
+
+  auto check = [&](const std::vector<float>& row, size_t k, bool descending) {
+    std::vector<IndexType> indices(k);
+    std::vector<float> values(k);
+    selector.select(row.data(), row.size(), k, descending, indices.data(), values.data());
+
+    auto expected = topkReference(row, k, descending);
+    for(size_t i = 0; i < k; ++i) {
+      CHECK( values[i]  == expected[i].first );
+      CHECK( indices[i] == expected[i].second );
+    }
+  };
+
+  // lengths around and between the SIMD block sizes, and the size of a small vocabulary
+  std::vector<size_t> lengths = {1, 3, 7, 8, 16, 17, 100, 8000};
+
+  SECTION("k = 1") {
+    for(auto cols : lengths) {
+      std::vector<float> row(cols);
+      for(auto& v : row)
+        v = uniform(rng);
+      check(row, 1, /*descending=*/true);
+      check(row, 1, /*descending=*/false);
+    }
+  }
+
+  SECTION("k = N") {
+    for(auto cols : lengths) {
+      std::vector<float> row(cols);
+      for(auto& v : row)
+        v = uniform(rng);
+      check(row, cols, /*descending=*/true);
+      check(row, cols, /*descending=*/false);
+    }
+  }
+
+  SECTION("k between 1 and N, sorted and reversed input") {
+    for(auto cols : lengths) {
+      std::vector<float> row(cols);
+      for(size_t i = 0; i < cols; ++i)
+        row[i] = (float)i;
+      for(size_t k : {(size_t)2, cols / 2, cols - 1}) {
+        if(k < 1 || k > cols)
+          continue;
+        check(row, k, /*descending=*/true);
+        check(row, k, /*descending=*/false);
+        std::reverse(row.begin(), row.end());
+        check(row, k, /*descending=*/true);
+        check(row, k, /*descending=*/false);
+        std::reverse(row.begin(), row.end());
+      }
+    }
+  }
+
+  SECTION("ties are broken by the lower index") {
+    std::uniform_int_distribution<int> few(0, 3);
+    for(auto cols : lengths) {
+      std::vector<float> row(cols);
+      for(auto& v : row)
+        v = (float)few(rng); // many equal values
+      for(size_t k : {(size_t)1, (cols + 1) / 2, cols}) {
+        check(row, k, /*descending=*/true);
+        check(row, k, /*descending=*/false);
+      }
+    }
+
+    std::vector<float> constant(100, -1.5f);
+    check(constant, 10, /*descending=*/true);
+    check(constant, 10, /*descending=*/false);
+  }
+
+  SECTION("topk operator over rows with ties") {
+    Config::seed = 1234;
+    auto graph = New<ExpressionGraph>();
+    graph->setDefaultElementType(Type::float32);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(16);
+
+    std::vector<float> vA = { 2, 1, 2, 0, 1,
+                              0, 0, 3, 3, 3,
+                              5, 4, 3, 2, 1 };
+    auto a = graph->constant({3, 5}, inits::fromVector(vA));
+
+    auto top1 = topk(a, /*k=*/1, /*axis=*/-1, /*descending=*/true);
+    auto topN = topk(a, /*k=*/5, /*axis=*/-1, /*descending=*/true);
+    auto lowN = topk(a, /*k=*/5, /*axis=*/-1, /*descending=*/false);
+    graph->forward();
+
+    std::vector<float> values;
+    std::vector<IndexType> indices;
+
+    get<0>(top1)->val()->get(values);
+    get<1>(top1)->val()->get(indices);
+    CHECK( values  == std::vector<float>({2, 3, 5}) );
+    CHECK( indices == std::vector<IndexType>({0, 2, 0}) );
+
+    get<0>(topN)->val()->get(values);
+    get<1>(topN)->val()->get(indices);
+    CHECK( values  == std::vector<float>({2, 2, 1, 1, 0,
+                                          3, 3, 3, 0, 0,
+                                          5, 4, 3, 2, 1}) );
+    CHECK( indices == std::vector<IndexType>({0, 2, 1, 4, 3,
+                                              2, 3, 4, 0, 1,
+                                              0, 1, 2, 3, 4}) );
+
+    get<0>(lowN)->val()->get(values);
+    get<1>(lowN)->val()->get(indices);
+    CHECK( values  == std::vector<float>({0, 1, 1, 2, 2,
+                                          0, 0, 3, 3, 3,
+                                          1, 2, 3, 4, 5}) );
+    CHECK( indices == std::vector<IndexType>({3, 1, 4, 0, 2,
+                                              0, 1, 2, 3, 4,
+                                              4, 3, 2, 1, 0}) );
+  }
+}
+
+TEST_CASE("ProdBatched matches per-matrix sgemm (cpu)", "[operator]") {
+  Config::seed = 1234;
+  auto graph = New<ExpressionGraph>();
+  graph->setDefaultElementType(Type::float32);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+  auto tensors = graph->getTensorAllocator();
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+  auto random = [&](size_t size) {
+    std::vector<float> v(size);
+    for(auto& x : v)
+      x = uniform(rng);
+    return v;
+  };
+
+  const int batch = 3;
+  const float alpha = 0.5f;
+  // products small enough for the native kernel, rows of C below and above its micro-kernel height and
+  // columns that are not a multiple of its width; A or B broadcast over the batch if its batch size is 1
+  for(bool transA : {false, true})
+  for(bool transB : {false, true})
+  for(int m : {1, 2, 3, 4, 5})
+  for(int n : {1, 7, 16, 33})
+  for(int k : {1, 13, 64})
+  for(float beta : {0.f, 0.75f})
+  for(auto batches : {std::make_pair(batch, batch), std::make_pair(1, batch), std::make_pair(batch, 1)}) {
+    int batchA = batches.first, batchB = batches.second;
+    Shape shapeA = transA ? Shape({batchA, k, m}) : Shape({batchA, m, k});
+    Shape shapeB = transB ? Shape({batchB, n, k}) : Shape({batchB, k, n});
+
+    auto vA = random(shapeA.elements());
+    auto vB = random(shapeB.elements());
+    auto vC = random((size_t)batch * m * n);
+
+    Tensor A, B, C;
+    tensors->allocate(A, shapeA);
+    tensors->allocate(B, shapeB);
+    tensors->allocate(C, {batch, m, n});
+    A->set(vA);
+    B->set(vB);
+    C->set(vC);
+
+    ProdBatched(C, graph->allocator(), A, B, transA, transB, beta, alpha);
+    std::vector<float> values;
+    C->get(values);
+
+    std::vector<float> expected = vC;
+    for(int i = 0; i < batch; ++i)
+      sgemm(transA, transB, m, n, k, alpha,
+            vA.data() + (i % batchA) * m * k, transA ? m : k,
+            vB.data() + (i % batchB) * k * n, transB ? k : n,
+            beta,
+            expected.data() + i * m * n, n);
+
+    INFO("transA=" << transA << " transB=" << transB << " m=" << m << " n=" << n << " k=" << k
+         << " beta=" << beta << " batchA=" << batchA << " batchB=" << batchB);
+    CHECK( std::equal(values.begin(), values.end(), expected.begin(),
+                      [](float x, float y) { return x == Approx(y).margin(1e-5f); }) );
+
+    graph->free(A);
+    graph->free(B);
+    graph->free(C);
+  }
+}
+
+TEST_CASE("Int4 affine matches float affine with the unpacked weights (cpu)", "[operator]") {
+  Config::seed = 1234;
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+
+  const int rows = 3 * cpu::int4::GROUP, cols = 37;
+  std::vector<float> vW(rows * cols), vBias(cols);
+  for(auto& w : vW)
+    w = uniform(rng);
+  for(auto& b : vBias)
+    b = uniform(rng);
+  vW[5] = 0.f; // an exact zero and the extremes of a group
+  vW[7 * cols] = 1.f;
+  vW[8 * cols] = -1.f;
+
+  io::Item item;
+  item.name  = "W";
+  item.shape = {rows, cols};
+  item.type  = Type::int4grouped;
+  item.bytes.resize(cpu::int4::packedBytes(rows, cols));
+  cpu::int4::pack(vW.data(), rows, cols, (uint8_t*)item.bytes.data());
+
+  // unpacks the layout described in int4_gemm.h: value i of a group is in the low nibble of byte i
+  // for the first half of the group and in the high nibble of byte i - GROUP / 2 for the second
+  const int groups = rows / cpu::int4::GROUP;
+  const uint8_t* bytes = (const uint8_t*)item.bytes.data();
+  const float* scales = (const float*)(bytes + cpu::int4::valueBytes(rows, cols));
+  std::vector<float> vUnpacked(rows * cols);
+  for(int j = 0; j < cols; ++j) {
+    for(int i = 0; i < rows; ++i) {
+      int g = i / cpu::int4::GROUP, pos = i % cpu::int4::GROUP, half = cpu::int4::GROUP / 2;
+      uint8_t byte = bytes[(size_t)j * rows / 2 + g * half + pos % half];
+      int q = (pos < half ? byte & 0x0F : byte >> 4) - 8;
+      CHECK( q >= -7 );
+      float scale = scales[j * groups + g];
+      vUnpacked[i * cols + j] = q * scale;
+      CHECK( std::abs(vUnpacked[i * cols + j] - vW[i * cols + j]) <= scale / 2 + 1e-6f );
+    }
+  }
+  CHECK( vUnpacked[5] == 0.f );
+  CHECK( vUnpacked[7 * cols] == Approx(1.f) );
+  CHECK( vUnpacked[8 * cols] == Approx(-1.f) );
+
+  for(int m : {1, 5}) { // rows of the activations below and above the rows per unpacked group of weights
+    std::vector<float> vX(m * rows);
+    for(auto& x : vX)
+      x = uniform(rng);
+
+    auto graph = New<ExpressionGraph>();
+    graph->setDefaultElementType(Type::float32);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(16);
+
+    auto x        = graph->constant({m, rows}, inits::fromVector(vX));
+    auto W        = graph->constant({rows, cols}, inits::fromItem(item), Type::int4grouped);
+    auto unpacked = graph->constant({rows, cols}, inits::fromVector(vUnpacked));
+    auto bias     = graph->constant({1, cols}, inits::fromVector(vBias));
+
+    auto int4Out  = affine(x, W, bias);
+    auto floatOut = affine(x, unpacked, bias);
+    graph->forward();
+
+    std::vector<float> values, expected;
+    int4Out->val()->get(values);
+    floatOut->val()->get(expected);
+
+    // the activations are quantized to int8 per row, which bounds the difference
+    CHECK( std::equal(values.begin(), values.end(), expected.begin(),
+                      [](float a, float b) { return a == Approx(b).margin(0.05f); }) );
+
+    // the SIMD kernel against the scalar dot product of a group
+    std::vector<int8_t> aQuant(m * rows);
+    std::vector<float> aUnquant(m);
+    cpu::int4::quantizeRows(vX.data(), m, rows, 1.f, aQuant.data(), aUnquant.data());
+    for(int r = 0; r < m; ++r) {
+      for(int j = 0; j < cols; ++j) {
+        float acc = 0.f;
+        for(int g = 0; g < groups; ++g)
+          acc += cpu::int4::dotGroup(&aQuant[r * rows + g * cpu::int4::GROUP], bytes + (size_t)j * rows / 2 + g * cpu::int4::GROUP / 2)
+                 * scales[j * groups + g];
+        CHECK( values[r * cols + j] == Approx(acc * aUnquant[r] + vBias[j]).epsilon(1e-5f).margin(1e-5f) );
+      }
+    }
+  }
+}
+
+TEST_CASE("Operators give the same results with and without intra-op threads (cpu)", "[operator]") {
+  // value of expr built by build() in a new graph with the given --cpu-intra-op-threads
+  auto run = [](size_t threads, const std::string& gemmPrecision, const std::function<Expr(Ptr<ExpressionGraph>)>& build) {
+    Config::seed = 1234;
+    auto options = New<Options>();
+    options->set("clip-gemm", 0.f);
+    options->set("gemm-precision", gemmPrecision);
+    options->set("use-legacy-batching", false);
+    options->set("dump-quantmult", false);
+    options->set("cpu-intra-op-threads", threads);
+
+    auto graph = New<ExpressionGraph>(/*inference=*/true);
+    graph->setDefaultElementType(Type::float32);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->getBackend()->configureDevice(options);
+    graph->reserveWorkspaceMB(64);
+
+    auto expr = build(graph);
+    graph->forward();
+    std::vector<float> values;
+    expr->val()->get(values);
+    return values;
+  };
+
+  auto random = [](size_t size, int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+    std::vector<float> v(size);
+    for(auto& x : v)
+      x = uniform(rng);
+    return v;
+  };
+
+  // operators are split over rows; products with fewer rows than threads are split over columns
+  SECTION("Prod") {
+    for(int rows : {37, 2}) {
+      auto vA = random(rows * 256, 1);
+      auto vB = random(256 * 200, 2);
+      auto build = [&](Ptr<ExpressionGraph> graph) {
+        auto A = graph->constant({rows, 256}, inits::fromVector(vA));
+        auto B = graph->constant({256, 200}, inits::fromVector(vB));
+        return dot(A, B);
+      };
+      auto single = run(1, "float32", build);
+      auto threaded = run(4, "float32", build);
+      // BLAS may block the partial products differently, outputs are around 10
+      CHECK( std::equal(single.begin(), single.end(), threaded.begin(),
+                        [](float x, float y) { return x == Approx(y).epsilon(1e-5f).margin(1e-4f); }) );
+    }
+  }
+
+  SECTION("Softmax") {
+    auto vX = random(128 * 2048, 3);
+    auto build = [&](Ptr<ExpressionGraph> graph) {
+      return softmax(graph->constant({128, 2048}, inits::fromVector(vX)));
+    };
+    CHECK( run(1, "float32", build) == run(4, "float32", build) );
+  }
+
+  SECTION("LayerNormalization") {
+    auto vX = random(128 * 2048, 4);
+    auto vGamma = random(2048, 5);
+    auto vBeta = random(2048, 6);
+    auto build = [&](Ptr<ExpressionGraph> graph) {
+      auto x = graph->constant({128, 2048}, inits::fromVector(vX));
+      auto gamma = graph->constant({1, 2048}, inits::fromVector(vGamma));
+      auto beta = graph->constant({1, 2048}, inits::fromVector(vBeta));
+      return layerNorm(x, gamma, beta);
+    };
+    CHECK( run(1, "float32", build) == run(4, "float32", build) );
+  }
+
+#if defined(USE_INTGEMM) && !defined(ARM)
+  SECTION("int8 affine") {
+    for(int rows : {37, 2}) {
+      auto vA = random(rows * 256, 7);
+      auto vB = random(256 * 512, 8);
+      auto vBias = random(512, 9);
+      auto build = [&](Ptr<ExpressionGraph> graph) {
+        auto A = graph->constant({rows, 256}, inits::fromVector(vA));
+        auto B = graph->constant({256, 512}, inits::fromVector(vB));
+        auto bias = graph->constant({1, 512}, inits::fromVector(vBias));
+        return affine(A, B, bias);
+      };
+      CHECK( run(1, "int8", build) == run(4, "int8", build) );
+    }
+  }
+#endif
+}
+
+TEST_CASE("Alpha calibration uses the nearest-rank percentile of the maxima (cpu)", "[operator]") {
+  using cpu::integer::AlphaCalibration;
+
+  std::vector<float> maxima(100);
+  std::iota(maxima.begin(), maxima.end(), 1.f);
+  std::shuffle(maxima.begin(), maxima.end(), std::mt19937(1234));
+
+  CHECK( AlphaCalibration::alpha(maxima, 100.f) == Approx(127.f / 100.f) );
+  CHECK( AlphaCalibration::alpha(maxima, 99.9f) == Approx(127.f / 100.f) );
+  CHECK( AlphaCalibration::alpha(maxima, 99.f)  == Approx(127.f / 99.f) );
+  CHECK( AlphaCalibration::alpha(maxima, 50.f)  == Approx(127.f / 50.f) );
+  CHECK( AlphaCalibration::alpha(maxima, 0.5f)  == Approx(127.f / 1.f) );
+  CHECK( AlphaCalibration::alpha({3.f}, 10.f)   == Approx(127.f / 3.f) );
+  CHECK( AlphaCalibration::alpha({0.f}, 100.f)  == Approx(127.f / 1e-10f) );
+
+  SECTION("calibrated model") {
+    // a model with a matrix and an alpha from an earlier calibration
+    std::vector<io::Item> items(2);
+    std::vector<float> vW = {1, 2, 3, 4}, vAlpha = {5};
+    items[0].name = "W";
+    items[0].shape = {2, 2};
+    items[0].bytes.assign((const char*)vW.data(), (const char*)(vW.data() + vW.size()));
+    items[1].name = "W_QuantMultA";
+    items[1].shape = {1};
+    items[1].bytes.assign((const char*)vAlpha.data(), (const char*)(vAlpha.data() + vAlpha.size()));
+    const std::string modelFile = "operator_tests_calibration.bin", outFile = "operator_tests_calibrated.bin";
+    io::saveItems(modelFile, items);
+
+    auto& calibration = AlphaCalibration::instance();
+    for(float maxAbs : {4.f, 2.f, 8.f, 1.f}) {
+      calibration.add("F0::W_QuantMultA", maxAbs);
+      calibration.add("F1::W_QuantMultA", 100.f * maxAbs); // other models of an ensemble are not calibrated
+    }
+    calibration.add("F0::V_QuantMultA", 2.f);
+    calibration.save(modelFile, outFile, 75.f);
+
+    auto calibrated = io::loadItems(outFile);
+    std::remove(modelFile.c_str());
+    std::remove(outFile.c_str());
+
+    std::map<std::string, std::vector<float>> values;
+    for(const auto& item : calibrated) {
+      auto data = (const float*)(item.ptr ? item.ptr : item.bytes.data());
+      values[item.name].assign(data, data + item.shape.elements());
+    }
+    CHECK( values.size() == 3 );
+    CHECK( values["W"] == vW );
+    REQUIRE( values["W_QuantMultA"].size() == 1 );
+    CHECK( values["W_QuantMultA"][0] == Approx(127.f / 4.f) ); // 3rd of 4 maxima replaces the old alpha
+    REQUIRE( values["V_QuantMultA"].size() == 1 );
+    CHECK( values["V_QuantMultA"][0] == Approx(127.f / 2.f) );
+  }
+}
+
+#if defined(USE_INTGEMM) && !defined(ARM)
+TEST_CASE("Int8 affine over shortlist columns padded to a multiple of 8 matches float affine (cpu)", "[operator]") {
+  const int inner = 64, vocab = 40;
+  std::mt19937 rng(4321);
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+  std::vector<float> vW(inner * vocab), vBias(vocab);
+  for(auto& x : vW)
+    x = uniform(rng);
+  for(auto& x : vBias)
+    x = uniform(rng);
+
+  // 13 shortlisted words, padded to 16 columns by repeating the last one like the output layer does
+  const std::vector<WordIndex> shortlisted = {0, 3, 4, 9, 11, 17, 20, 22, 25, 31, 33, 36, 39};
+  auto indices = shortlisted;
+  while(indices.size() % 8 != 0)
+    indices.push_back(shortlisted.back());
+  const int selected = (int)shortlisted.size();
+
+  auto run = [&](const std::vector<float>& vX, int rows, bool withBias, size_t threads) {
+    auto options = New<Options>();
+    options->set("clip-gemm", 0.f);
+    options->set("gemm-precision", std::string("int8"));
+    options->set("use-legacy-batching", false);
+    options->set("dump-quantmult", false);
+    options->set("cpu-intra-op-threads", threads);
+
+    auto graph = New<ExpressionGraph>(/*inference=*/true);
+    graph->setDefaultElementType(Type::float32);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->getBackend()->configureDevice(options);
+    graph->reserveWorkspaceMB(16);
+
+    auto x = graph->constant({rows, inner}, inits::fromVector(vX));
+    auto W = graph->constant({inner, vocab}, inits::fromVector(vW));
+    auto bQuantMult = cpu::integer::quantMult<Type::int8>(W);
+    auto Wq = cpu::integer::prepareB<Type::int8>(W, bQuantMult, -1000.f);
+    auto shortWq = cpu::integer::selectColumnsB<Type::int8>(Wq, indices, -1000.f, shortlisted.size());
+    auto shortb = withBias ? index_select(graph->constant({1, vocab}, inits::fromVector(vBias)), -1, indices) : nullptr;
+    auto y = cpu::integer::affine<Type::int8>(x, shortWq, shortb, false, false, 1.f);
+    REQUIRE( y->shape()[-1] == selected );
+    graph->forward();
+
+    std::vector<float> values;
+    y->val()->get(values);
+    return values;
+  };
+
+  // 37 rows are split over rows, 2 rows with 4 threads over blocks of 8 columns, the second of which
+  // holds the 3 padding columns
+  for(int rows : {37, 2}) {
+    std::vector<float> vX(rows * inner);
+    for(auto& x : vX)
+      x = uniform(rng);
+    for(bool withBias : {false, true}) {
+      std::vector<float> expected(rows * selected);
+      float maxAbs = 0.f;
+      for(int r = 0; r < rows; ++r)
+        for(int j = 0; j < selected; ++j) {
+          double acc = withBias ? vBias[shortlisted[j]] : 0.0;
+          for(int i = 0; i < inner; ++i)
+            acc += (double)vX[r * inner + i] * vW[i * vocab + shortlisted[j]];
+          expected[r * selected + j] = (float)acc;
+          maxAbs = std::max(maxAbs, std::abs((float)acc));
+        }
+
+      for(size_t threads : {1, 4}) {
+        auto values = run(vX, rows, withBias, threads);
+        REQUIRE( values.size() == expected.size() );
+        for(size_t i = 0; i < values.size(); ++i) {
+          INFO("rows=" << rows << " bias=" << withBias << " threads=" << threads << " index=" << i);
+          CHECK( values[i] == Approx(expected[i]).margin(0.05f * maxAbs) );
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Int8 affine with per-column quantization matches float affine (cpu)", "[operator]") {
+  const int rows = 5, inner = 64, cols = 48;
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+
+  // columns of very different magnitudes, which a single multiplier for B would quantize coarsely
+  std::vector<float> vW(inner * cols), vBias(cols), vX(rows * inner);
+  std::vector<float> columnScale(cols);
+  for(int j = 0; j < cols; ++j)
+    columnScale[j] = std::pow(2.f, (float)(j % 8)) / 16.f;
+  for(int i = 0; i < inner; ++i)
+    for(int j = 0; j < cols; ++j)
+      vW[i * cols + j] = uniform(rng) * columnScale[j];
+  for(int j = 0; j < cols; ++j)
+    vBias[j] = uniform(rng) * columnScale[j];
+  for(auto& x : vX)
+    x = uniform(rng);
+
+  // model converted like marian-conv --gemm-type intgemm8 --quantize-per-column
+  const std::string modelFile = "operator_tests_per_column.bin";
+  {
+    auto packable = New<ExpressionGraphPackable>();
+    packable->setDevice({0, DeviceType::cpu});
+    packable->reserveWorkspaceMB(16);
+    packable->param("layer_W", {inner, cols}, inits::fromVector(vW));
+    packable->param("layer_b", {1, cols}, inits::fromVector(vBias));
+    packable->forward();
+    packable->quantizePerColumn = true;
+    packable->packAndSave(modelFile, "", Type::intgemm8, Type::float32);
+  }
+  auto items = io::loadItems(modelFile);
+  std::remove(modelFile.c_str());
+
+  bool hasColumnMults = false;
+  for(const auto& item : items)
+    hasColumnMults |= item.name == "layer_W_QuantMultBCols";
+  REQUIRE( hasColumnMults );
+
+  // x * W (+ bias) in float, in double precision
+  auto reference = [&](bool withBias) {
+    std::vector<float> out(rows * cols);
+    for(int r = 0; r < rows; ++r)
+      for(int j = 0; j < cols; ++j) {
+        double acc = withBias ? vBias[j] : 0.0;
+        for(int i = 0; i < inner; ++i)
+          acc += (double)vX[r * inner + i] * vW[i * cols + j];
+        out[r * cols + j] = (float)acc;
+      }
+    return out;
+  };
+
+  auto run = [&](const std::string& gemmPrecision, bool withBias, size_t threads) {
+    auto options = New<Options>();
+    options->set("clip-gemm", 0.f);
+    options->set("gemm-precision", gemmPrecision);
+    options->set("use-legacy-batching", false);
+    options->set("dump-quantmult", false);
+    options->set("cpu-intra-op-threads", threads);
+
+    auto graph = New<ExpressionGraph>(/*inference=*/true);
+    graph->setDefaultElementType(Type::float32);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->getBackend()->configureDevice(options);
+    graph->reserveWorkspaceMB(16);
+    graph->load(items);
+
+    auto x = graph->constant({rows, inner}, inits::fromVector(vX));
+    auto W = graph->get("layer_W");
+    auto b = graph->get("layer_b");
+    REQUIRE( W );
+    REQUIRE( W->value_type() == Type::intgemm8 );
+    auto y = withBias ? affine(x, W, b) : dot(x, W);
+    graph->forward();
+
+    std::vector<float> values;
+    y->val()->get(values);
+    return values;
+  };
+
+  // with 4 threads and 5 rows the product is split over columns
+  for(std::string gemmPrecision : {"int8", "int8shift"}) {
+    for(bool withBias : {false, true}) {
+      for(size_t threads : {1, 4}) {
+        auto values = run(gemmPrecision, withBias, threads);
+        auto expected = reference(withBias);
+        REQUIRE( values.size() == expected.size() );
+
+        // the error of each column is relative to the magnitude of that column
+        for(int j = 0; j < cols; ++j) {
+          float maxAbs = 0.f;
+          for(int r = 0; r < rows; ++r)
+            maxAbs = std::max(maxAbs, std::abs(expected[r * cols + j]));
+          for(int r = 0; r < rows; ++r) {
+            INFO("gemm-precision=" << gemmPrecision << " bias=" << withBias << " threads=" << threads
+                 << " row=" << r << " col=" << j);
+            CHECK( values[r * cols + j] == Approx(expected[r * cols + j]).margin(0.05f * maxAbs + 1e-4f) );
+          }
+        }
+      }
+    }
+  }
+}
+#endif
 #endif
 
 #ifdef BLAS_FOUND
@@ -0,0 +1,148 @@
+#include "catch.hpp"
+#include "translator/translation_cache.h"
+
+using namespace marian;
+
+namespace {
+
+// batch of the given sentences, [stream][sentence] word indices, with the given sentence ids
+Ptr<data::CorpusBatch> makeBatch(const std::vector<std::vector<std::vector<WordIndex>>>& streams,
+                                 const std::vector<size_t>& sentenceIds) {
+  std::vector<Ptr<data::SubBatch>> subBatches;
+  for(const auto& sentences : streams) {
+    size_t width = 0;
+    for(const auto& words : sentences)
+      width = std::max(width, words.size());
+    auto sb = New<data::SubBatch>(sentences.size(), width, nullptr);
+    size_t numWords = 0;
+    for(size_t b = 0; b < sentences.size(); ++b) {
+      for(size_t s = 0; s < sentences[b].size(); ++s) {
+        sb->data()[sb->locate(b, s)] = Word::fromWordIndex(sentences[b][s]);
+        sb->mask()[sb->locate(b, s)] = 1.f;
+        numWords++;
+      }
+    }
+    sb->setWords(numWords);
+    subBatches.push_back(sb);
+  }
+  auto batch = New<data::CorpusBatch>(subBatches);
+  batch->setSentenceIds(sentenceIds);
+  return batch;
+}
+
+// batch indices and 1-best outputs passed to found()
+struct Found {
+  std::vector<size_t> indices;
+  std::vector<std::string> best1;
+  std::vector<std::string> bestn;
+};
+
+std::vector<size_t> lookup(TranslationCache& cache, Ptr<data::CorpusBatch> batch, Found& found) {
+  return cache.lookup(batch, [&](size_t batchIdx, const std::string& best1, const std::string& bestn) {
+    found.indices.push_back(batchIdx);
+    found.best1.push_back(best1);
+    found.bestn.push_back(bestn);
+  });
+}
+
+}  // namespace
+
+TEST_CASE("TranslationCache returns stored translations", "[translator]") {
+  TranslationCache cache(1024 * 1024, /*optionsHash=*/42);
+  auto batch = makeBatch({{{1, 2, 3}, {4, 5}}}, {0, 1});
+
+  SECTION("misses before anything is stored") {
+    Found found;
+    CHECK( lookup(cache, batch, found) == std::vector<size_t>({0, 1}) );
+    CHECK( found.indices.empty() );
+  }
+
+  SECTION("hits the stored sentence and misses the other one") {
+    cache.put(batch, 1, "translation", "");
+    Found found;
+    CHECK( lookup(cache, batch, found) == std::vector<size_t>({0}) );
+    CHECK( found.indices == std::vector<size_t>({1}) );
+    CHECK( found.best1 == std::vector<std::string>({"translation"}) );
+  }
+
+  SECTION("hits the same sentence in another batch at another position") {
+    cache.put(batch, 0, "translation", "");
+    auto other = makeBatch({{{7}, {1, 2, 3}}}, {5, 6});
+    Found found;
+    CHECK( lookup(cache, other, found) == std::vector<size_t>({0}) );
+    CHECK( found.indices == std::vector<size_t>({1}) );
+  }
+
+  SECTION("keys keep the words of different streams apart") {
+    auto twoStreams = makeBatch({{{1, 2}}, {{3}}}, {0});
+    cache.put(twoStreams, 0, "translation", "");
+    auto splitDifferently = makeBatch({{{1}}, {{2, 3}}}, {0});
+    Found found;
+    CHECK( lookup(cache, splitDifferently, found) == std::vector<size_t>({0}) );
+    CHECK( lookup(cache, twoStreams, found).empty() );
+  }
+
+  SECTION("filter returns a batch of the missed sentences only") {
+    cache.put(batch, 0, "translation", "");
+    auto missed = cache.filter(batch, [](size_t, const std::string&, const std::string&) {});
+    REQUIRE( missed );
+    CHECK( missed->size() == 1 );
+    CHECK( missed->getSentenceIds() == std::vector<size_t>({1}) );
+
+    cache.put(batch, 1, "translation", "");
+    CHECK( !cache.filter(batch, [](size_t, const std::string&, const std::string&) {}) );
+  }
+}
+
+TEST_CASE("TranslationCache renumbers n-best lists", "[translator]") {
+  TranslationCache cache(1024 * 1024, /*optionsHash=*/42);
+  auto batch = makeBatch({{{1, 2, 3}}}, {5});
+  cache.put(batch, 0, "a b", "5 ||| a b ||| F0= -1 ||| -1\n5 ||| a c ||| F0= -2 ||| -2");
+
+  auto later = makeBatch({{{9}, {1, 2, 3}}}, {11, 12});
+  Found found;
+  lookup(cache, later, found);
+  REQUIRE( found.bestn.size() == 1 );
+  CHECK( found.bestn[0] == "12 ||| a b ||| F0= -1 ||| -1\n12 ||| a c ||| F0= -2 ||| -2" );
+}
+
+TEST_CASE("TranslationCache evicts the least recently used entry at its byte budget", "[translator]") {
+  // keys are the options hash, then a length and the word indices per stream
+  const size_t keyBytes = sizeof(size_t) + sizeof(uint32_t) + 2 * sizeof(WordIndex);
+  const std::string best1(32, 'x');
+  const size_t entryBytes = 2 * keyBytes + best1.size() + 128; // see entryBytes() in translation_cache.cpp
+  TranslationCache cache(2 * entryBytes + entryBytes / 2, /*optionsHash=*/42);
+
+  auto batch = makeBatch({{{1, 2}, {3, 4}, {5, 6}}}, {0, 1, 2});
+  cache.put(batch, 0, best1, "");
+  cache.put(batch, 1, best1, "");
+
+  Found found;
+  auto first = makeBatch({{{1, 2}}}, {0});
+  CHECK( lookup(cache, first, found).empty() ); // the first sentence is now the most recently used
+
+  cache.put(batch, 2, best1, ""); // evicts the second sentence
+  CHECK( lookup(cache, batch, found) == std::vector<size_t>({1}) );
+
+  SECTION("entries larger than the budget are not stored") {
+    auto large = makeBatch({{{7, 8}}}, {3});
+    cache.put(large, 0, std::string(3 * entryBytes, 'x'), "");
+    CHECK( lookup(cache, large, found) == std::vector<size_t>({0}) );
+    CHECK( lookup(cache, batch, found) == std::vector<size_t>({1}) );
+  }
+}
+
+TEST_CASE("TranslationCache::select keeps sentence ids and trims the width", "[translator]") {
+  auto batch = makeBatch({{{1, 2, 3, 4}, {5}, {6, 7}}}, {10, 11, 12});
+  auto selected = TranslationCache::select(batch, {2, 1});
+  REQUIRE( selected->size() == 2 );
+  CHECK( selected->getSentenceIds() == std::vector<size_t>({12, 11}) );
+
+  auto sb = selected->front();
+  CHECK( sb->batchWidth() == 2 );
+  CHECK( sb->batchWords() == 3 );
+  CHECK( sb->data()[sb->locate(0, 0)] == Word::fromWordIndex(6) );
+  CHECK( sb->data()[sb->locate(0, 1)] == Word::fromWordIndex(7) );
+  CHECK( sb->data()[sb->locate(1, 0)] == Word::fromWordIndex(5) );
+  CHECK( sb->mask()[sb->locate(1, 1)] == 0.f );
+}
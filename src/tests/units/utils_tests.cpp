@@ -34,3 +34,24 @@ TEST_CASE("utils::splitTsv", "[utils]") {
 
   //SECTION("excessive tab-separated fields abort the execution") {}
 }
+
+TEST_CASE("utils::workerCores", "[utils]") {
+  std::vector<size_t> cores = {0, 2, 4, 6, 8, 10};
+
+  SECTION("each worker takes the next cores") {
+    CHECK( utils::workerCores(cores, 0, 1) == std::vector<size_t>({0}) );
+    CHECK( utils::workerCores(cores, 3, 1) == std::vector<size_t>({6}) );
+    CHECK( utils::workerCores(cores, 0, 3) == std::vector<size_t>({0, 2, 4}) );
+    CHECK( utils::workerCores(cores, 1, 3) == std::vector<size_t>({6, 8, 10}) );
+  }
+
+  SECTION("the cores are reused when there are not enough") {
+    CHECK( utils::workerCores(cores, 7, 1) == std::vector<size_t>({2}) );
+    CHECK( utils::workerCores(cores, 1, 4) == std::vector<size_t>({8, 10, 0, 2}) );
+    CHECK( utils::workerCores({1}, 2, 2) == std::vector<size_t>({1, 1}) );
+  }
+
+  SECTION("no cores give none") {
+    CHECK( utils::workerCores({}, 1, 4).empty() );
+  }
+}
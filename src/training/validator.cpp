@@ -409,10 +409,14 @@ float TranslationValidator::validate(const std::vector<Ptr<ExpressionGraph>>& gr
     };
 
     threadPool_.reserve(graphs.size());
-    TaskBarrier taskBarrier;
-    for(auto batch : *batchGenerator_)
-      taskBarrier.push_back(threadPool_.enqueue(task, batch));
-    // ~TaskBarrier waits until all are done
+    {
+      TaskBarrier taskBarrier;
+      for(auto batch : *batchGenerator_)
+        taskBarrier.push_back(threadPool_.enqueue(task, batch));
+      // ~TaskBarrier waits until all are done
+    }
+    // the tasks on threadPool_ may still hold a reference to collector, so write the file out here
+    collector->close();
   }
 
   if(!quiet_)
@@ -548,10 +552,14 @@ float SacreBleuValidator::validate(const std::vector<Ptr<ExpressionGraph>>& grap
     };
 
     threadPool_.reserve(graphs.size());
-    TaskBarrier taskBarrier;
-    for(auto batch : *batchGenerator_)
-      taskBarrier.push_back(threadPool_.enqueue(task, batch));
-    // ~TaskBarrier waits until all are done
+    {
+      TaskBarrier taskBarrier;
+      for(auto batch : *batchGenerator_)
+        taskBarrier.push_back(threadPool_.enqueue(task, batch));
+      // ~TaskBarrier waits until all are done
+    }
+    // the tasks on threadPool_ may still hold a reference to collector, so write the file out here
+    collector->close();
   }
 
   if(!quiet_)
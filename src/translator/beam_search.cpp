@@ -7,6 +7,30 @@
 
 namespace marian {
 
+// values of t at the given flat indices, read in place on the CPU and with one Select() and one copy otherwise
+static std::vector<float> gatherValues(Ptr<ExpressionGraph> graph, Tensor t, const std::vector<IndexType>& indices) {
+  std::vector<float> values(indices.size());
+  for(auto index : indices)
+    ABORT_IF(index >= t->size(), "Index {} out of bounds for tensor of shape {}", index, t->shape());
+
+  if(t->getBackend()->getDeviceId().type == DeviceType::cpu || t->type() != Type::float32) {
+    for(size_t i = 0; i < indices.size(); ++i)
+      values[i] = t->get(indices[i]);
+    return values;
+  }
+
+  Tensor indicesTensor, valuesTensor;
+  auto allocator = graph->getTensorAllocator();
+  allocator->allocate(indicesTensor, Shape({1, (int)indices.size()}), Type::uint32);
+  allocator->allocate(valuesTensor, Shape({1, (int)indices.size()}), Type::float32);
+  indicesTensor->set(indices);
+  Select(valuesTensor, t->subtensor(0, t->size()), indicesTensor, /*axis=*/-1);
+  valuesTensor->get(values);
+  graph->free(indicesTensor);
+  graph->free(valuesTensor);
+  return values;
+}
+
 // combine new expandedPathScores and previous beams into new set of beams
 Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [currentDimBatch, beamSize] flattened -> ((batchIdx, beamHypIdx) flattened, word idx) flattened
                          const std::vector<float>& nBestPathScores,  // [currentDimBatch, beamSize] flattened
@@ -17,10 +41,14 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
                          Ptr<data::CorpusBatch /*const*/> batch, // for alignments only
                          Ptr<FactoredVocab/*const*/> factoredVocab, size_t factorGroup,
                          const std::vector<bool>& dropBatchEntries, // [origDimBatch] - empty source batch entries are marked with true, should be cleared after first use.
-                         const std::vector<IndexType>& batchIdxMap) const { // [origBatchIdx -> currentBatchIdx]
-  std::vector<float> align; // collects alignment information from the last executed time step
-  if(options_->hasAndNotEmpty("alignment") && factorGroup == 0)
-    align = scorers_[0]->getAlignment(); // [beam depth * max src length * current batch size] -> P(s|t); use alignments from the first scorer, even if ensemble,
+                         const std::vector<IndexType>& batchIdxMap, // [origBatchIdx -> currentBatchIdx]
+                         Ptr<ExpressionGraph> graph) const { // for gathering n-best score breakdowns
+  Ptr<AttentionStep> attention; // attention of the last executed time step, alignments of hypotheses are extracted from it on demand
+  if(options_->hasAndNotEmpty("alignment") && factorGroup == 0) {
+    attention = New<AttentionStep>();
+    attention->attention = scorers_[0]->getAlignment(); // [beam depth * max src length * current batch size] -> P(s|t); use alignments from the first scorer, even if ensemble,
+    attention->batch = batch;
+  }
 
   const auto origDimBatch = beams.size(); // see function search for definition of origDimBatch and currentDimBatch etc.
   Beams newBeams(origDimBatch);           // return value of this function goes here. There are always origDimBatch beams.
@@ -40,6 +68,15 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
     }
   }
 
+  if(attention)
+    attention->currentDimBatch = currentDimBatch;
+
+  // n-best score breakdowns of the new hypotheses, [hypothesis, scorer] flattened, and the positions of their words in the logits
+  Ptr<std::vector<float>> scoreBreakdowns;
+  std::vector<IndexType> logitIndices;
+  if(options_->get<bool>("n-best"))
+    scoreBreakdowns = New<std::vector<float>>();
+
   for(size_t i = 0; i < nBestKeys.size(); ++i) { // [currentDimBatch, beamSize] flattened
     // Keys encode batchIdx, beamHypIdx, and word index in the entire beam.
     // They can be between 0 and (vocabSize * nBestBeamSize * batchSize)-1.
@@ -115,42 +152,47 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
       }
     }
     else if (shortlist)
-      word = Word::fromWordIndex(shortlist->reverseMap(wordIdx));
+      word = Word::fromWordIndex(shortlist->reverseMap(origBatchIdx, wordIdx));
     else
       word = Word::fromWordIndex(wordIdx);
 
     auto hyp = Hypothesis::New(prevHyp, word, prevBeamHypIdx, pathScore);
 
-    // Set score breakdown for n-best lists
-    if(options_->get<bool>("n-best")) {
-      auto breakDown = beam[beamHypIdx]->getScoreBreakdown();
+    // Set score breakdown for n-best lists, the logits of this step are added for all hypotheses after the loop
+    if(scoreBreakdowns) {
       ABORT_IF(factoredVocab && factorGroup > 0 && !factoredVocab->canExpandFactoredWord(word, factorGroup),
                "A word without this factor snuck through to here??");
-      breakDown.resize(states.size(), 0); // at start, this is empty, so this will set the initial score to 0
-      for(size_t j = 0; j < states.size(); ++j) {
-        auto lval = states[j]->getLogProbs().getFactoredLogitsTensor(factorGroup); // [maxBeamSize, 1, currentDimBatch, dimFactorVocab]
-        // The flatting happens based on actual (current) batch size and batch index computed with batch-pruning as we are looking into the pruned tensor
-        size_t flattenedLogitIndex = (beamHypIdx * currentDimBatch + currentBatchIdx) * vocabSize + wordIdx;  // (beam idx, batch idx, word idx); note: beam and batch are transposed, compared to 'key'
-
-        // @TODO: use a function on shape() to index, or new method val->at({i1, i2, i3, i4}) with broadcasting
-        ABORT_IF(lval->shape() != Shape({(int)nBestBeamSize, 1, (int)currentDimBatch, (int)vocabSize}) &&
-                 (beamHypIdx == 0 && lval->shape() != Shape({1, 1, (int)currentDimBatch, (int)vocabSize})),
-                 "Unexpected shape of logits?? {} != {}", lval->shape(), Shape({(int)nBestBeamSize, 1, (int)currentDimBatch, (int)vocabSize}));
-
-        breakDown[j] += lval->get(flattenedLogitIndex);
-      }
-      hyp->setScoreBreakdown(breakDown);
+      size_t offset = scoreBreakdowns->size();
+      const float* prevBreakdown = beam[beamHypIdx]->getScoreBreakdownData(); // nullptr at start, which sets the initial scores to 0
+      for(size_t j = 0; j < states.size(); ++j)
+        scoreBreakdowns->push_back(prevBreakdown ? prevBreakdown[j] : 0.f);
+      // The flatting happens based on actual (current) batch size and batch index computed with batch-pruning as we are looking into the pruned tensor
+      logitIndices.push_back((IndexType)((beamHypIdx * currentDimBatch + currentBatchIdx) * vocabSize + wordIdx)); // (beam idx, batch idx, word idx); note: beam and batch are transposed, compared to 'key'
+      hyp->setScoreBreakdown(scoreBreakdowns, offset, states.size());
     }
 
     // Set alignments
-    if(!align.empty())
-      hyp->setAlignment(getAlignmentsForHypothesis(align, batch, (int)beamHypIdx, (int)currentBatchIdx, (int)origBatchIdx, (int)currentDimBatch));
+    if(attention)
+      hyp->setAlignment(attention, beamHypIdx, currentBatchIdx, origBatchIdx);
     else // not first factor: just copy
-      hyp->setAlignment(beam[beamHypIdx]->getAlignment());
+      hyp->copyAlignment(*beam[beamHypIdx]);
 
     newBeam.push_back(hyp);
   }
 
+  // add the logits of all new hypotheses, one gather per scorer
+  if(scoreBreakdowns && !logitIndices.empty()) {
+    for(size_t j = 0; j < states.size(); ++j) {
+      auto lval = states[j]->getLogProbs().getFactoredLogitsTensor(factorGroup); // [maxBeamSize, 1, currentDimBatch, dimFactorVocab]
+      ABORT_IF(lval->shape() != Shape({(int)nBestBeamSize, 1, (int)currentDimBatch, (int)vocabSize}) &&
+               lval->shape() != Shape({1, 1, (int)currentDimBatch, (int)vocabSize}),
+               "Unexpected shape of logits?? {} != {}", lval->shape(), Shape({(int)nBestBeamSize, 1, (int)currentDimBatch, (int)vocabSize}));
+      auto logits = gatherValues(graph, lval, logitIndices);
+      for(size_t i = 0; i < logits.size(); ++i)
+        (*scoreBreakdowns)[i * states.size() + j] += logits[i];
+    }
+  }
+
   // if factored vocab and this is not the first factor, we need to
   // also propagate factored hypotheses that do not get expanded in this step because they don't have this factor
   if (factorGroup > 0) {
@@ -178,51 +220,6 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
   return newBeams;
 }
 
-std::vector<float> BeamSearch::getAlignmentsForHypothesis( // -> P(s|t) for current t and given beam and batch dim
-    const std::vector<float> alignAll, // [beam depth, max src length, batch size, 1], flattened vector of all attention probablities
-    Ptr<data::CorpusBatch> batch,
-    int beamHypIdx,
-    int currentBatchIdx,
-    int origBatchIdx,
-    int currentDimBatch) const {
-  // Let's B be the beam size, N be the number of batched sentences,
-  // and L the number of words in the longest sentence in the batch.
-  // The alignment vector:
-  //
-  // if(first)
-  //   * has length of N x L if it's the first beam
-  //   * stores elements in the following order:
-  //     beam1 = [word1-batch1, word1-batch2, ..., word2-batch1, ...]
-  // else
-  //   * has length of N x L x B
-  //   * stores elements in the following order:
-  //     beams = [beam1, beam2, ..., beam_n]
-  //
-  // The mask vector is always of length N x L and has 1/0s stored like
-  // in a single beam, i.e.:
-  //   * [word1-batch1, word1-batch2, ..., word2-batch1, ...]
-  //
-
-  size_t origDimBatch = batch->size();  // number of sentences in batch
-  size_t batchWidth   = batch->width(); // max src length
-
-  // loop over words of batch entry 'currentBatchIdx' and beam entry 'beamHypIdx'
-  std::vector<float> align;
-  for(size_t srcPos = 0; srcPos < batchWidth; ++srcPos) { // loop over source positions
-    // We are looking into the probabilites from an actual tensor, hence we need to use currentDimBatch and currentBatchIdx.
-    size_t currentAttIdx = (batchWidth * beamHypIdx + srcPos) * currentDimBatch + currentBatchIdx; // = flatten [beam index, s, batch index, 0]
-
-    // We are looking into the mask from the orginal batch, hence we need to use origDmBatch and origBatchIdx.
-    size_t origAttIdx  = (batchWidth * beamHypIdx + srcPos) * origDimBatch + origBatchIdx;; // = flatten [beam index, s, batch index, 0]
-    size_t origMaskIdx = origAttIdx % (batchWidth * origDimBatch); // == batchIdx + (batchSize * srcPos) = flatten [0, s, batch index, 0]
-
-    // If the original position is not masked out used the corresponding current attention score.
-    if(batch->front()->mask()[origMaskIdx] != 0)
-      align.emplace_back(alignAll[currentAttIdx]);
-  }
-  return align;
-}
-
 // remove all beam entries that have reached EOS
 Beams BeamSearch::purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexType>& batchIdxMap) {
   const auto trgEosId = trgVocab_->getEosId();
@@ -318,6 +315,17 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
   //    with Hypothesis: (last word, aggregate score, prev Hypothesis)
 
   IndexType currentDimBatch = origDimBatch;
+
+  // On the CPU, a step is built and recorded once for each shape, i.e. beam size and number of sentences
+  // still decoded, and the following steps of the same shape replay it with rewritten words and path scores
+  // instead of building the graph again, see ExpressionGraph::startRecording(). This needs scorers that
+  // can replay their step, e.g. transformers with KV cache, and steps that do not depend on more inputs.
+  bool replaySteps = graph->getDeviceId().type == DeviceType::cpu
+                     && !trgVocab_->tryAs<FactoredVocab>()
+                     && !options_->hasAndNotEmpty("alignment")
+                     && !options_->get<bool>("output-sampling", false);
+  std::pair<size_t, IndexType> recordedShape;   // (maxBeamSize, currentDimBatch) of the recorded step
+  Expr recordedPrevPathScores, recordedPathScores; // its input path scores and expanded path scores
   auto prevBatchIdxMap = batchIdxMap; // [origBatchIdx -> currentBatchIdx] but shifted by one time step
   // main loop over output time steps
   for (size_t t = 0; ; t++) {
@@ -344,6 +352,8 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       std::vector<IndexType> hypIndices;      // [maxBeamSize, 1, currentDimBatch, 1] (flattened) tensor index ((beamHypIdx, batchIdx), flattened) of prev hyp that a hyp originated from
       std::vector<Word> prevWords;            // [maxBeamSize, 1, currentDimBatch, 1] (flattened) word that a hyp ended in, for advancing the decoder-model's history
       Expr prevPathScores;                    // [maxBeamSize, 1, currentDimBatch, 1], path score that a hyp ended in (last axis will broadcast into vocab size when adding expandedPathScores)
+      bool replay = false;                    // whether this step replays the recorded one, same shape
+      bool record = false;                    // whether this step is recorded
 
       bool anyCanExpand = false; // stays false if all hyps are invalid factor expansions
       if(t == 0 && factorGroup == 0) { // no scores yet
@@ -394,13 +404,29 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
             }
           }
         }
+        IndexType prevDimBatch = currentDimBatch;
         if(factorGroup == 0)
           currentDimBatch = (IndexType) batchIndices.size(); // keep batch size constant for all factor groups in a time step
-        prevPathScores = graph->constant({(int)maxBeamSize, 1, (int)currentDimBatch, 1}, inits::fromVector(prevScores));
+        replay = replaySteps && recordedPathScores && recordedShape == std::make_pair(maxBeamSize, currentDimBatch);
+        // the first step after sentences were purged selects their encoder states, which must not be replayed
+        record = replaySteps && !replay && currentDimBatch == prevDimBatch;
+        if(replay) {
+          graph->rewrite(recordedPrevPathScores, inits::fromVector(prevScores));
+        } else {
+          if(record)
+            graph->startRecording();
+          prevPathScores = graph->constant({(int)maxBeamSize, 1, (int)currentDimBatch, 1}, inits::fromVector(prevScores));
+        }
       }
       if (!anyCanExpand) // all words cannot expand this factor: skip
         continue;
 
+      // original batch indices of the sentences decoded in this step, in the order of the current batch
+      std::vector<size_t> activeBatchIndices;
+      for(size_t origBatchIdx = 0; origBatchIdx < origDimBatch; ++origBatchIdx)
+        if(!beams[origBatchIdx].empty() || !PURGE_BATCH)
+          activeBatchIndices.push_back(origBatchIdx);
+
       //**********************************************************************
       // compute expanded path scores with word prediction probs from all scorers
       auto expandedPathScores = prevPathScores; // will become [maxBeamSize, 1, currDimBatch, dimVocab]
@@ -418,14 +444,18 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
           //  LOG(info, "prevWords[{},{}]={} -> {}", t/numFactorGroups, factorGroup,
           //      factoredVocab ? factoredVocab->word2string(prevWords[kk]) : (*batch->back()->vocab())[prevWords[kk]],
           //      prevScores[kk]);
+          auto shortlist = scorers_[i]->getShortlist();
+          if(shortlist && shortlist->isGrouped()) // rows of the output belong to the sentences still decoded
+            shortlist->setActiveBatchIndices(activeBatchIndices);
+          if(replay) { // the recorded expanded path scores below already add up all scorers
+            states[i] = scorers_[i]->replayStep(graph, states[i], hypIndices, prevWords, batchIndices, (int)maxBeamSize);
+            continue;
+          }
           states[i] = scorers_[i]->step(graph, states[i], hypIndices, prevWords, batchIndices, (int)maxBeamSize);
           if (numFactorGroups == 1) // @TODO: this branch can go away
             logProbs = states[i]->getLogProbs().getLogits(); // [maxBeamSize, 1, currentDimBatch, dimVocab]
           else
-          {
-            auto shortlist = scorers_[i]->getShortlist();
             logProbs = states[i]->getLogProbs().getFactoredLogits(factorGroup, shortlist); // [maxBeamSize, 1, currentDimBatch, dimVocab]
-          }
         }
         else {
           // add secondary factors
@@ -444,14 +474,31 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       }
 
       // make beams continuous
-      expandedPathScores = swapAxes(expandedPathScores, 0, 2); // -> [currentDimBatch, 1, maxBeamSize, dimVocab]
+      if(replay)
+        expandedPathScores = recordedPathScores;
+      else
+        expandedPathScores = swapAxes(expandedPathScores, 0, 2); // -> [currentDimBatch, 1, maxBeamSize, dimVocab]
 
       // perform NN computation
-      if(t == 0 && factorGroup == 0)
+      if(replay)
+        graph->replay();
+      else if(t == 0 && factorGroup == 0)
         graph->forward();
       else
         graph->forwardNext();
 
+      if(record) {
+        graph->stopRecording();
+        replaySteps = std::all_of(scorers_.begin(), scorers_.end(), [](Ptr<Scorer> scorer) { return scorer->canReplayStep(); });
+        if(replaySteps) {
+          recordedShape = std::make_pair(maxBeamSize, currentDimBatch);
+          recordedPrevPathScores = prevPathScores;
+          recordedPathScores = expandedPathScores;
+        } else {
+          graph->clearRecording();
+        }
+      }
+
       //**********************************************************************
       // suppress specific symbols if not at right positions
       if(unkColId != -1 && factorGroup == 0)
@@ -482,7 +529,8 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
                      batch,             // only used for propagating alignment info
                      factoredVocab, factorGroup,
                      emptyBatchEntries, // [origDimBatch] - empty source batch entries are marked with true
-                     batchIdxMap);      // used to create a reverse batch index map to recover original batch indices for this step
+                     batchIdxMap,       // used to create a reverse batch index map to recover original batch indices for this step
+                     graph);            // used for gathering logits for n-best score breakdowns
     } // END FOR factorGroup = 0 .. numFactorGroups-1
 
     prevBatchIdxMap = batchIdxMap; // save current batchIdx map to be used in next step; we are then going to look one step back
@@ -512,4 +560,268 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
   return histories; // [origDimBatch][t][N best hyps]
 }
 
+//**********************************************************************
+// continuous batching: same as above for the special case without factors, alignments and shortlists,
+// where the batch is a list of slots in the order of the current step and no original batch indices
+// have to be tracked
+void BeamSearch::search(Ptr<ExpressionGraph> graph, size_t maxDimBatch, const Refill& refill, const Done& done) {
+  ABORT_IF(maxDimBatch == 0, "Continuous batching needs room for at least one sentence");
+  auto batch = refill(maxDimBatch);
+  if(!batch)
+    return;
+
+  for(auto scorer : scorers_)
+    scorer->clear(graph);
+
+  std::vector<Ptr<ScorerState>> states;
+  for(auto scorer : scorers_)
+    states.push_back(scorer->startState(graph, batch));
+
+  auto factoredVocab = trgVocab_->tryAs<FactoredVocab>();
+  bool continuous = PURGE_BATCH
+                    && !(factoredVocab && factoredVocab->getNumGroups() > 1)
+                    && !options_->hasAndNotEmpty("alignment")
+                    && !options_->hasAndNotEmpty("shortlist") // shortlists are generated for a whole batch
+                    && std::all_of(states.begin(), states.end(), [](Ptr<ScorerState> state) { return state->canAppend(); });
+  if(!continuous) {
+    for(; batch; batch = refill(maxDimBatch)) {
+      auto histories = search(graph, batch);
+      for(size_t i = 0; i < histories.size(); ++i)
+        done(batch, i, histories[i]);
+    }
+    return;
+  }
+
+  const auto trgEosId = trgVocab_->getEosId();
+  const auto trgUnkId = trgVocab_->getUnkId();
+  const float maxLengthFactor = options_->get<float>("max-length-factor");
+
+  auto getNBestList = createGetNBestListFn(beamSize_, maxDimBatch, graph->getDeviceId());
+
+  // determine index of UNK in the log prob vectors if we want to suppress it in the decoding process
+  int unkColId = -1;
+  if(trgUnkId != Word::NONE && !options_->get<bool>("allow-unk", false))
+    unkColId = trgUnkId.toWordIndex();
+
+  // a sentence decoded in one of the slots of the batch
+  struct Sentence {
+    Ptr<data::CorpusBatch> batch; // returned by refill()
+    size_t index;                 // in that batch
+    Ptr<History> history;
+    float maxLength;              // of the translation, max-length-factor * width of the batch like in search()
+    bool empty;                   // source of only <EOS>, forced to EOS in its first step
+  };
+  std::vector<Sentence> sentences; // [currentBatchIdx] sentences of the current step
+  Beams beams;                     // [currentBatchIdx] empty once the sentence is done
+  size_t joined = 0;               // number of sentences at the end of sentences that start in the current step
+
+  auto join = [&](Ptr<data::CorpusBatch> newBatch) {
+    auto sources = newBatch->front();
+    const auto& srcEosId = sources->vocab()->getEosId();
+    float maxLength = maxLengthFactor * sources->batchWidth();
+    for(size_t i = 0; i < newBatch->size(); ++i) {
+      auto history = New<History>(newBatch->getSentenceIds()[i],
+                                  options_->get<float>("normalize"),
+                                  options_->get<float>("word-penalty"));
+      beams.push_back(Beam(beamSize_, Hypothesis::New()));
+      history->add(beams.back(), trgEosId); // add beam with start-hypotheses to traceback grid
+      sentences.push_back({newBatch, i, history, maxLength, sources->data()[i] == srcEosId});
+    }
+    joined = newBatch->size();
+  };
+  join(batch);
+
+  IndexType prevDimBatch = 0;
+  bool inputDone = false;
+  size_t steps = 0, activeSentenceSteps = 0; // for the mean occupancy of the slots
+
+  // record and replay steps as above; sentences that leave or join the batch change the encoder states
+  // even if the shapes stay the same, so they also end the recorded step
+  bool replaySteps = !options_->get<bool>("output-sampling", false);
+  std::pair<size_t, IndexType> recordedShape;
+  Expr recordedPrevPathScores, recordedPathScores;
+
+  for(size_t t = 0; ; t++) {
+    std::vector<IndexType> batchIndices; // [currentBatchIdx] index of the sentence in the previous step, or of its appended start state
+    bool changed = false;                // whether sentences left or joined the batch
+    if(t == 0) {
+      batchIndices.resize(sentences.size());
+      std::iota(batchIndices.begin(), batchIndices.end(), 0);
+    } else {
+      // free the slots of the sentences done in the previous step
+      std::vector<Sentence> activeSentences;
+      Beams activeBeams;
+      for(size_t i = 0; i < sentences.size(); ++i) {
+        if(!beams[i].empty()) {
+          batchIndices.push_back((IndexType)i);
+          activeSentences.push_back(sentences[i]);
+          activeBeams.push_back(beams[i]);
+        }
+      }
+      changed = activeSentences.size() < sentences.size();
+      sentences.swap(activeSentences);
+      beams.swap(activeBeams);
+
+      // and refill them with new sentences, appending their start states to the decoder states
+      joined = 0;
+      if(!inputDone && sentences.size() < maxDimBatch) {
+        auto newBatch = refill(maxDimBatch - sentences.size());
+        if(newBatch) {
+          for(size_t i = 0; i < newBatch->size(); ++i)
+            batchIndices.push_back((IndexType)(prevDimBatch + i));
+          join(newBatch);
+          for(size_t i = 0; i < scorers_.size(); ++i)
+            states[i] = states[i]->append(scorers_[i]->startState(graph, newBatch));
+          changed = true;
+        } else {
+          inputDone = true;
+        }
+      }
+    }
+
+    // done if all sentences have reached EOS and there is no more input
+    if(sentences.empty())
+      break;
+
+    size_t maxBeamSize = 0;
+    for(auto& beam : beams)
+      maxBeamSize = std::max(maxBeamSize, beam.size());
+    const IndexType currentDimBatch = (IndexType)sentences.size();
+    const size_t firstJoined = sentences.size() - joined;
+
+    //**********************************************************************
+    // create constant containing previous path scores for current beam
+    std::vector<IndexType> hypIndices; // [maxBeamSize, 1, currentDimBatch, 1] (flattened) row of the previous step that a hyp extends
+    std::vector<Word> prevWords;       // [maxBeamSize, 1, currentDimBatch, 1] (flattened) word that a hyp ended in
+    Expr prevPathScores;               // [maxBeamSize, 1, currentDimBatch, 1] path score that a hyp ended in
+    bool replay = false, record = false;
+    if(t == 0) { // no scores yet
+      prevPathScores = graph->constant({1, 1, 1, 1}, inits::fromValue(0));
+    } else {
+      std::vector<float> prevScores;
+      for(size_t beamHypIdx = 0; beamHypIdx < maxBeamSize; ++beamHypIdx) {
+        for(size_t i = 0; i < sentences.size(); ++i) {
+          const auto& beam = beams[i];
+          if(i >= firstJoined) { // new sentences expand only one start hypothesis, like all sentences in the first step
+            hypIndices.push_back(DecoderState::NEW_ROW);
+            prevWords.push_back(trgEosId); // (unused, the decoder starts them with the zero embedding)
+            prevScores.push_back(beamHypIdx == 0 ? 0.f : INVALID_PATH_SCORE);
+          } else if(beamHypIdx < beam.size()) {
+            auto hyp = beam[beamHypIdx];
+            hypIndices.push_back((IndexType)(hyp->getPrevStateIndex() * prevDimBatch + batchIndices[i]));
+            prevWords.push_back(hyp->getWord());
+            prevScores.push_back(hyp->getPathScore());
+          } else { // pad to maxBeamSize (dummy hypothesis)
+            hypIndices.push_back(0);
+            prevWords.push_back(trgEosId);
+            prevScores.push_back(INVALID_PATH_SCORE);
+          }
+        }
+      }
+
+      if(changed && recordedPathScores) {
+        graph->clearRecording();
+        recordedPathScores = nullptr;
+      }
+      replay = replaySteps && recordedPathScores && recordedShape == std::make_pair(maxBeamSize, currentDimBatch);
+      record = replaySteps && !replay && !changed;
+      if(replay) {
+        graph->rewrite(recordedPrevPathScores, inits::fromVector(prevScores));
+      } else {
+        if(record)
+          graph->startRecording();
+        prevPathScores = graph->constant({(int)maxBeamSize, 1, (int)currentDimBatch, 1}, inits::fromVector(prevScores));
+      }
+    }
+
+    //**********************************************************************
+    // compute expanded path scores with word prediction probs from all scorers
+    auto expandedPathScores = prevPathScores; // will become [maxBeamSize, 1, currDimBatch, dimVocab]
+    for(size_t i = 0; i < scorers_.size(); ++i) {
+      if(replay) {
+        states[i] = scorers_[i]->replayStep(graph, states[i], hypIndices, prevWords, batchIndices, (int)maxBeamSize);
+        continue;
+      }
+      states[i] = scorers_[i]->step(graph, states[i], hypIndices, prevWords, batchIndices, (int)maxBeamSize);
+      expandedPathScores = expandedPathScores + scorers_[i]->getWeight() * states[i]->getLogProbs().getLogits();
+    }
+
+    // make beams continuous
+    if(replay)
+      expandedPathScores = recordedPathScores;
+    else
+      expandedPathScores = swapAxes(expandedPathScores, 0, 2); // -> [currentDimBatch, 1, maxBeamSize, dimVocab]
+
+    // perform NN computation, including the encoders of the sentences that joined
+    if(replay)
+      graph->replay();
+    else if(t == 0)
+      graph->forward();
+    else
+      graph->forwardNext();
+
+    if(record) {
+      graph->stopRecording();
+      replaySteps = std::all_of(scorers_.begin(), scorers_.end(), [](Ptr<Scorer> scorer) { return scorer->canReplayStep(); });
+      if(replaySteps) {
+        recordedShape = std::make_pair(maxBeamSize, currentDimBatch);
+        recordedPrevPathScores = prevPathScores;
+        recordedPathScores = expandedPathScores;
+      } else {
+        graph->clearRecording();
+      }
+    }
+
+    if(unkColId != -1)
+      suppressWord(expandedPathScores, unkColId);
+
+    //**********************************************************************
+    // perform beam search
+    std::vector<unsigned int> nBestKeys; // [currentDimBatch, maxBeamSize] flattened -> (batchIdx, beamHypIdx, word idx) flattened
+    std::vector<float> nBestPathScores;  // [currentDimBatch, maxBeamSize] flattened
+    getNBestList(expandedPathScores->val(), maxBeamSize, nBestPathScores, nBestKeys, /*first=*/t == 0);
+
+    std::vector<bool> emptySentences;
+    for(const auto& sentence : sentences)
+      emptySentences.push_back(sentence.empty);
+    std::vector<IndexType> batchIdxMap(currentDimBatch); // the beams are in the order of the current step
+    std::iota(batchIdxMap.begin(), batchIdxMap.end(), 0);
+
+    beams = toHyps(nBestKeys, nBestPathScores,
+                   /*nBestBeamSize*/expandedPathScores->shape()[-2],
+                   /*vocabSize=*/expandedPathScores->shape()[-1],
+                   beams,
+                   states,
+                   /*batch=*/nullptr, // only used for alignments
+                   /*factoredVocab=*/nullptr, /*factorGroup=*/0,
+                   emptySentences,
+                   batchIdxMap,
+                   graph);
+
+    prevDimBatch = currentDimBatch;
+    activeSentenceSteps += currentDimBatch;
+    steps++;
+
+    // add the beams to the traceback grids; sentences whose hyps all end in EOS, or that reached their
+    // maximum length, are done and leave the batch in the next step
+    for(size_t i = 0; i < sentences.size(); ++i) {
+      auto& sentence = sentences[i];
+      Beam survivors;
+      for(auto hyp : beams[i])
+        if(hyp->getWord() != trgEosId)
+          survivors.push_back(hyp);
+      bool maxLengthReached = sentence.history->size() >= sentence.maxLength;
+      sentence.history->add(beams[i], trgEosId, survivors.empty() || maxLengthReached);
+      if(survivors.empty() || maxLengthReached) {
+        done(sentence.batch, sentence.index, sentence.history);
+        survivors.clear();
+      }
+      beams[i] = survivors;
+    }
+  }
+
+  LOG(debug, "[search] {} steps with {:.1f} of {} sentences active on average",
+      steps, steps ? (float)activeSentenceSteps / steps : 0.f, maxDimBatch);
+}
+
 }  // namespace marian
@@ -14,9 +14,15 @@ private:
   Ptr<const Vocab> trgVocab_;
 
   const float INVALID_PATH_SCORE = std::numeric_limits<float>::lowest(); // @TODO: observe this closely
+  // Finished sentences are removed from the batch. The continuous search() below refills their slots.
   const bool PURGE_BATCH = true; // @TODO: diagnostic, to-be-removed once confirmed there are no issues.
 
 public:
+  // Returns a batch of at most the given number of sentences to start decoding, nullptr once the input is exhausted.
+  typedef std::function<Ptr<data::CorpusBatch>(size_t)> Refill;
+  // Receives the history of the sentence at the given index of a batch returned by Refill once it is done.
+  typedef std::function<void(Ptr<data::CorpusBatch>, size_t, Ptr<History>)> Done;
+
   BeamSearch(Ptr<Options> options, const std::vector<Ptr<Scorer>>& scorers, const Ptr<const Vocab> trgVocab)
       : options_(options), scorers_(scorers), beamSize_(options_->get<size_t>("beam-size")), trgVocab_(trgVocab)
   {}
@@ -31,21 +37,21 @@ public:
                Ptr<data::CorpusBatch /*const*/> batch, // for alignments only
                Ptr<class FactoredVocab/*const*/> factoredVocab, size_t factorGroup,
                const std::vector<bool>& dropBatchEntries, // [origDimBatch] - empty source batch entries are marked with true, should be cleared after first use.
-               const std::vector<IndexType>& batchIdxMap) const;
-
-  std::vector<float> getAlignmentsForHypothesis( // -> P(s|t) for current t and given beam and batch dim
-      const std::vector<float> alignAll, // [beam depth, max src length, batch size, 1], flattened vector of all attention probablities
-      Ptr<data::CorpusBatch> batch,
-      int beamHypIdx,
-      int currentBatchIdx,
-      int origBatchIdx,
-      int currentDimBatch) const;
+               const std::vector<IndexType>& batchIdxMap,
+               Ptr<ExpressionGraph> graph) const;
 
   // remove all beam entries that have reached EOS
   Beams purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexType>& batchIdxMap);
 
   // main decoding function
   Histories search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch);
+
+  // Continuous batching: decodes up to maxDimBatch sentences at a time and after each step refills the
+  // slots of the finished ones with new sentences, whose encoder states are computed and appended to the
+  // running decoder states. Needs scorer states that accept sentences, e.g. transformers with KV caches on
+  // the CPU, and no factors, alignments or shortlists; otherwise the refilled batches are decoded one
+  // after another.
+  void search(Ptr<ExpressionGraph> graph, size_t maxDimBatch, const Refill& refill, const Done& done);
 };
 
 }  // namespace marian
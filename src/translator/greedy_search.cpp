@@ -0,0 +1,183 @@
+#include "translator/greedy_search.h"
+
+#include "data/factored_vocab.h"
+#include "data/shortlist.h"
+#include "translator/beam_search.h"
+#include "translator/helpers.h"
+
+namespace marian {
+
+bool GreedySearch::canSkipNormalization(Ptr<Options> options) {
+  return options->get<size_t>("beam-size") == 1
+         && options->get<std::vector<std::string>>("models").size() == 1
+         && !options->get<bool>("n-best", false)
+         && !options->get<bool>("word-scores", false)
+         && !options->get<bool>("output-sampling", false);
+}
+
+Histories GreedySearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch) {
+  auto factoredVocab = trgVocab_->tryAs<FactoredVocab>();
+  if((factoredVocab && factoredVocab->getNumGroups() > 1)
+     || options_->get<bool>("n-best")
+     || options_->hasAndNotEmpty("alignment"))
+    return BeamSearch(options_, scorers_, trgVocab_).search(graph, batch);
+
+  const size_t origDimBatch = batch->size();
+  const auto trgEosId = trgVocab_->getEosId();
+  const auto trgUnkId = trgVocab_->getUnkId();
+  const auto srcEosId = batch->front()->vocab()->getEosId();
+
+  for(auto scorer : scorers_)
+    scorer->clear(graph);
+
+  std::vector<Ptr<ScorerState>> states;
+  for(auto scorer : scorers_)
+    states.push_back(scorer->startState(graph, batch));
+
+  // suppress unk unless allowed, see BeamSearch::search()
+  int unkColId = -1;
+  if(trgUnkId != Word::NONE && !options_->get<bool>("allow-unk", false)) {
+    unkColId = trgUnkId.toWordIndex();
+    auto shortlist = scorers_[0]->getShortlist();
+    if(shortlist)
+      unkColId = shortlist->tryForwardMap(unkColId);
+  }
+
+  // sentences that are not done after maxLength words are cut off there, like in BeamSearch
+  const float maxLengthFactor = options_->get<float>("max-length-factor");
+  size_t maxLength = 1;
+  while(maxLength < maxLengthFactor * batch->front()->batchWidth())
+    maxLength++;
+
+  // words and path scores of all sentences, [origDimBatch, maxLength] flattened
+  std::vector<Word> words(origDimBatch * maxLength, trgEosId);
+  std::vector<float> pathScores(origDimBatch * maxLength, 0.f);
+  std::vector<size_t> lengths(origDimBatch, 0);
+
+  std::vector<size_t> active(origDimBatch);        // original batch indices of the sentences still decoded
+  std::iota(active.begin(), active.end(), 0);
+  std::vector<IndexType> batchIndices(origDimBatch); // [active] row of each of them in the previous step
+  std::iota(batchIndices.begin(), batchIndices.end(), 0);
+  std::vector<IndexType> hypIndices;                 // same as batchIndices with one hypothesis per sentence, empty at first
+  Words prevWords;                                   // [active] last word of each of them
+
+  // steps are recorded and replayed once for each number of sentences still decoded, see BeamSearch::search()
+  bool replaySteps = graph->getDeviceId().type == DeviceType::cpu
+                     && !factoredVocab
+                     && !options_->get<bool>("output-sampling", false);
+  size_t recordedDimBatch = 0, prevDimBatch = origDimBatch;
+  Expr recordedScores;
+
+  Tensor bestScores, bestWords;
+  for(size_t t = 0; t < maxLength && !active.empty(); ++t) {
+    bool replay = replaySteps && recordedScores && recordedDimBatch == active.size();
+    bool record = replaySteps && !replay && t > 0 && active.size() == prevDimBatch;
+    if(record)
+      graph->startRecording();
+
+    Expr scores; // [1, 1, active, dimVocab]
+    for(size_t i = 0; i < scorers_.size(); ++i) {
+      auto shortlist = scorers_[i]->getShortlist();
+      if(shortlist && shortlist->isGrouped())
+        shortlist->setActiveBatchIndices(active);
+      if(replay) {
+        states[i] = scorers_[i]->replayStep(graph, states[i], hypIndices, prevWords, batchIndices, /*beamSize=*/1);
+        scores = recordedScores;
+        continue;
+      }
+      states[i] = scorers_[i]->step(graph, states[i], hypIndices, prevWords, batchIndices, /*beamSize=*/1);
+      auto logProbs = states[i]->getLogProbs().getLogits();
+      float weight = scorers_[i]->getWeight();
+      if(weight != 1.f)
+        logProbs = weight * logProbs;
+      scores = scores ? scores + logProbs : logProbs;
+    }
+
+    if(replay)
+      graph->replay();
+    else if(t == 0)
+      graph->forward();
+    else
+      graph->forwardNext();
+
+    if(record) {
+      graph->stopRecording();
+      replaySteps = std::all_of(scorers_.begin(), scorers_.end(), [](Ptr<Scorer> scorer) { return scorer->canReplayStep(); });
+      if(replaySteps) {
+        recordedDimBatch = active.size();
+        recordedScores = scores;
+      } else {
+        graph->clearRecording();
+      }
+    }
+
+    if(unkColId != -1)
+      suppressWord(scores, unkColId);
+    for(auto state : states)
+      state->blacklist(scores, batch);
+
+    // best word of each sentence, without sorting or softmax
+    Shape bestShape({1, 1, (int)active.size(), 1});
+    graph->getTensorAllocator()->allocate(bestScores, bestShape, Type::float32);
+    graph->getTensorAllocator()->allocate(bestWords, bestShape, Type::uint32);
+    TopK(bestScores, bestWords, graph->allocator(), scores->val(), /*k=*/1, /*axis=*/-1, /*descending=*/true);
+    std::vector<float> bestScoresHost;
+    std::vector<IndexType> bestWordsHost;
+    bestScores->get(bestScoresHost);
+    bestWords->get(bestWordsHost);
+    graph->free(bestScores);
+    graph->free(bestWords);
+
+    auto shortlist = scorers_[0]->getShortlist();
+    std::vector<size_t> nextActive;
+    std::vector<IndexType> nextBatchIndices;
+    Words nextWords;
+    for(size_t i = 0; i < active.size(); ++i) {
+      size_t b = active[i];
+      Word word;
+      float score;
+      if(t == 0 && batch->front()->data()[b] == srcEosId) { // empty input, translated to nothing like in BeamSearch
+        word = trgEosId;
+        score = 0.f;
+      } else {
+        WordIndex wordIdx = bestWordsHost[i];
+        word = Word::fromWordIndex(shortlist ? shortlist->reverseMap(b, wordIdx) : wordIdx);
+        score = bestScoresHost[i];
+      }
+
+      size_t pos = b * maxLength + t;
+      words[pos] = word;
+      pathScores[pos] = (t > 0 ? pathScores[pos - 1] : 0.f) + score;
+      lengths[b] = t + 1;
+
+      if(word != trgEosId) {
+        nextActive.push_back(b);
+        nextBatchIndices.push_back((IndexType)i);
+        nextWords.push_back(word);
+      }
+    }
+
+    prevDimBatch = active.size();
+    active = nextActive;
+    batchIndices = nextBatchIndices;
+    hypIndices = batchIndices;
+    prevWords = nextWords;
+  }
+
+  // histories with one hypothesis per step, the last one being the translation
+  Histories histories(origDimBatch);
+  for(size_t b = 0; b < origDimBatch; ++b) {
+    histories[b] = New<History>(batch->getSentenceIds()[b],
+                                options_->get<float>("normalize"),
+                                options_->get<float>("word-penalty"));
+    auto hyp = Hypothesis::New();
+    histories[b]->add(Beam(1, hyp), trgEosId);
+    for(size_t t = 0; t < lengths[b]; ++t) {
+      hyp = Hypothesis::New(hyp, words[b * maxLength + t], (size_t)0, pathScores[b * maxLength + t]);
+      histories[b]->add(Beam(1, hyp), trgEosId, /*last=*/t + 1 == lengths[b]);
+    }
+  }
+  return histories;
+}
+
+}  // namespace marian
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "marian.h"
+#include "translator/beam_search.h"
+#include "translator/history.h"
+#include "translator/scorers.h"
+
+namespace marian {
+
+// Search with beam size 1: picks the best word of each sentence in each step with one argmax over the
+// scores. Unlike BeamSearch with --beam-size 1 it computes no n-best lists and creates no hypotheses
+// during search; words and path scores go into flat per-batch buffers that are turned into histories
+// once all sentences are done. Factored vocabularies, n-best lists and alignments are left to BeamSearch.
+class GreedySearch {
+private:
+  Ptr<Options> options_;
+  std::vector<Ptr<Scorer>> scorers_;
+  Ptr<const Vocab> trgVocab_;
+
+public:
+  GreedySearch(Ptr<Options> options, const std::vector<Ptr<Scorer>>& scorers, const Ptr<const Vocab> trgVocab)
+      : options_(options), scorers_(scorers), trgVocab_(trgVocab) {}
+
+  Histories search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch);
+
+  // Continuous batching is left to BeamSearch, which with beam size 1 picks the same words
+  void search(Ptr<ExpressionGraph> graph, size_t maxDimBatch, const BeamSearch::Refill& refill, const BeamSearch::Done& done) {
+    BeamSearch(options_, scorers_, trgVocab_).search(graph, maxDimBatch, refill, done);
+  }
+
+  // Whether greedy decoding with these options may use unnormalized logits (as with --skip-cost): the argmax
+  // of a single model does not change with the softmax and no scores are printed or sampled from.
+  static bool canSkipNormalization(Ptr<Options> options);
+};
+
+}  // namespace marian
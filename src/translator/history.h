@@ -10,12 +10,11 @@ namespace marian {
 // search grid of one batch entry
 class History {
 private:
-  // one hypothesis of a full sentence (reference into search grid)
+  // one hypothesis of a full sentence, its earlier words are reached through the back pointers
   struct SentenceHypothesisCoord {
     bool operator<(const SentenceHypothesisCoord& hc) const { return normalizedPathScore < hc.normalizedPathScore; }
 
-    size_t timeStepIdx;        // last time step of this sentence hypothesis
-    size_t beamIdx;            // which beam entry
+    Hypothesis::PtrType hyp;   // last hypothesis of this sentence hypothesis
     float normalizedPathScore; // length-normalized sentence score
   };
 
@@ -28,14 +27,14 @@ public:
     if(beam.back()->getPrevHyp() != nullptr) { // if not start hyp do
       for(size_t beamIdx = 0; beamIdx < beam.size(); ++beamIdx)
         if(beam[beamIdx]->getWord() == trgEosId || last) { // if this is a final hyp do
-          float pathScore = (beam[beamIdx]->getPathScore() - wordPenalty(history_.size())) / lengthPenalty(history_.size()); // get and normalize path score
-          topHyps_.push({history_.size(), beamIdx, pathScore}); // push final hyp on queue of scored hyps
+          float pathScore = (beam[beamIdx]->getPathScore() - wordPenalty(timeSteps_)) / lengthPenalty(timeSteps_); // get and normalize path score
+          topHyps_.push({beam[beamIdx], pathScore}); // push final hyp on queue of scored hyps
         }
     }
-    history_.push_back(beam);
+    timeSteps_++;
   }
 
-  size_t size() const { return history_.size(); } // number of time steps
+  size_t size() const { return timeSteps_; } // number of time steps
 
   /* return n best hypotheses
    * @param n size of n-best list
@@ -50,9 +49,7 @@ public:
     for (auto topHypsCopy = topHyps_; nbest.size() < n && !topHypsCopy.empty(); topHypsCopy.pop()) {
       auto bestHypCoord = topHypsCopy.top();
 
-      const size_t timeStepIdx = bestHypCoord.timeStepIdx; // last time step of this hypothesis
-      const size_t beamIdx     = bestHypCoord.beamIdx;     // which beam entry
-      Hypothesis::PtrType bestHyp = history_[timeStepIdx][beamIdx];
+      Hypothesis::PtrType bestHyp = bestHypCoord.hyp;
 
       // trace back best path
       Words targetWords = bestHyp->tracebackWords();
@@ -73,7 +70,7 @@ public:
   size_t getLineNum() const { return lineNo_; }
 
 private:
-  std::vector<Beam> history_; // [time step][index into beam] search grid @TODO: simplify as this is currently an expensive length count
+  size_t timeSteps_{0}; // added beams; hypotheses that did not end a sentence are only kept by the back pointers of those that did
   std::priority_queue<SentenceHypothesisCoord> topHyps_; // all sentence hypotheses (those that reached eos), sorted by score
   size_t lineNo_;
   float alpha_;
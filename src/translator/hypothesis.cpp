@@ -0,0 +1,132 @@
+#include "translator/hypothesis.h"
+#include "data/corpus_base.h"
+
+#include <mutex>
+
+namespace marian {
+
+namespace {
+
+union Block {
+  Block* next;
+  alignas(Hypothesis) char data[sizeof(Hypothesis)];
+};
+
+const size_t SLAB_BLOCKS = 1024; // blocks per slab and per refill of a free list
+
+// slabs and blocks returned by threads, never destroyed so that threads may outlive static objects
+struct SharedBlocks {
+  std::mutex mutex;
+  std::vector<UPtr<Block[]>> slabs;
+  Block* free{nullptr};
+};
+
+SharedBlocks& shared() {
+  static SharedBlocks* blocks = new SharedBlocks();
+  return *blocks;
+}
+
+// moves up to n blocks from the front of list 'from' to the front of list 'to'
+size_t moveBlocks(Block*& from, Block*& to, size_t n) {
+  size_t moved = 0;
+  for(; from && moved < n; ++moved) {
+    Block* block = from;
+    from = block->next;
+    block->next = to;
+    to = block;
+  }
+  return moved;
+}
+
+struct FreeList {
+  Block* head{nullptr};
+  size_t size{0};
+
+  void refill() {
+    auto& blocks = shared();
+    std::lock_guard<std::mutex> lock(blocks.mutex);
+    size += moveBlocks(blocks.free, head, SLAB_BLOCKS);
+    if(head)
+      return;
+    blocks.slabs.emplace_back(new Block[SLAB_BLOCKS]);
+    Block* slab = blocks.slabs.back().get();
+    for(size_t i = 0; i < SLAB_BLOCKS; ++i)
+      slab[i].next = i + 1 < SLAB_BLOCKS ? &slab[i + 1] : nullptr;
+    head = slab;
+    size = SLAB_BLOCKS;
+  }
+
+  void giveBack(size_t n) {
+    auto& blocks = shared();
+    std::lock_guard<std::mutex> lock(blocks.mutex);
+    size -= moveBlocks(head, blocks.free, n);
+  }
+
+  ~FreeList() { giveBack(size); } // thread exit
+};
+
+thread_local FreeList freeList;
+
+}  // namespace
+
+std::vector<float> AttentionStep::extract(size_t beamHypIdx, size_t currentBatchIdx, size_t origBatchIdx) const {
+  // Let's B be the beam size, N be the number of batched sentences,
+  // and L the number of words in the longest sentence in the batch.
+  // The alignment vector:
+  //
+  // if(first)
+  //   * has length of N x L if it's the first beam
+  //   * stores elements in the following order:
+  //     beam1 = [word1-batch1, word1-batch2, ..., word2-batch1, ...]
+  // else
+  //   * has length of N x L x B
+  //   * stores elements in the following order:
+  //     beams = [beam1, beam2, ..., beam_n]
+  //
+  // The mask vector is always of length N x L and has 1/0s stored like
+  // in a single beam, i.e.:
+  //   * [word1-batch1, word1-batch2, ..., word2-batch1, ...]
+  //
+
+  size_t origDimBatch = batch->size();  // number of sentences in batch
+  size_t batchWidth   = batch->width(); // max src length
+
+  // loop over words of batch entry 'currentBatchIdx' and beam entry 'beamHypIdx'
+  std::vector<float> align;
+  for(size_t srcPos = 0; srcPos < batchWidth; ++srcPos) { // loop over source positions
+    // We are looking into the probabilites from an actual tensor, hence we need to use currentDimBatch and currentBatchIdx.
+    size_t currentAttIdx = (batchWidth * beamHypIdx + srcPos) * currentDimBatch + currentBatchIdx; // = flatten [beam index, s, batch index, 0]
+
+    // We are looking into the mask from the orginal batch, hence we need to use origDmBatch and origBatchIdx.
+    size_t origAttIdx  = (batchWidth * beamHypIdx + srcPos) * origDimBatch + origBatchIdx;; // = flatten [beam index, s, batch index, 0]
+    size_t origMaskIdx = origAttIdx % (batchWidth * origDimBatch); // == batchIdx + (batchSize * srcPos) = flatten [0, s, batch index, 0]
+
+    // If the original position is not masked out used the corresponding current attention score.
+    if(batch->front()->mask()[origMaskIdx] != 0)
+      align.emplace_back(attention[currentAttIdx]);
+  }
+  return align;
+}
+
+void* HypothesisAllocator::allocate(size_t bytes) {
+  ABORT_IF(bytes > sizeof(Block), "Hypothesis allocator cannot serve {} bytes", bytes);
+  if(!freeList.head)
+    freeList.refill();
+  Block* block = freeList.head;
+  freeList.head = block->next;
+  freeList.size--;
+  return block;
+}
+
+void HypothesisAllocator::deallocate(void* ptr) {
+  if(!ptr)
+    return;
+  Block* block = static_cast<Block*>(ptr);
+  block->next = freeList.head;
+  freeList.head = block;
+  // hypotheses released by a thread that did not create them, e.g. one printing the output, pile up here
+  if(++freeList.size > 4 * SLAB_BLOCKS)
+    freeList.giveBack(2 * SLAB_BLOCKS);
+}
+
+}  // namespace marian
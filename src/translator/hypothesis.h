@@ -3,9 +3,35 @@
 
 #include "common/definitions.h"
 #include "data/alignment.h"
+#include "data/types.h"
 
 namespace marian {
 
+namespace data {
+class CorpusBatch;
+}
+
+// Attention probabilities of the first scorer in one decoding step, shared by the hypotheses created in that
+// step. The alignment of a hypothesis is only extracted from it when asked for, which is usually only done
+// for the translations that are printed.
+struct AttentionStep {
+  std::vector<float> attention;  // [beam depth, max src length, current batch size, 1] flattened
+  Ptr<data::CorpusBatch> batch;  // for the source mask
+  size_t currentDimBatch;        // batch size of the attention tensor, after purging finished sentences
+
+  // P(s|t) of the unmasked source positions s for the given hypothesis
+  std::vector<float> extract(size_t beamHypIdx, size_t currentBatchIdx, size_t origBatchIdx) const;
+};
+
+// Memory for Hypothesis objects. Beam search creates and drops hypotheses of the same size in every step,
+// these come from per-thread free lists of blocks carved from larger slabs instead of from the heap.
+// Blocks released on another thread join the free list of that thread, slabs are kept for the process.
+class HypothesisAllocator {
+public:
+  static void* allocate(size_t bytes);
+  static void deallocate(void* ptr);
+};
+
 // one single (partial or full) hypothesis in beam search
 // key elements:
 //  - the word that this hyp ends with
@@ -33,6 +59,9 @@ public:
    return PtrType(new Hypothesis(std::forward<Args>(args)...));
  }
 
+  static void* operator new(size_t bytes) { return HypothesisAllocator::allocate(bytes); }
+  static void operator delete(void* ptr) { HypothesisAllocator::deallocate(ptr); }
+
   const PtrType getPrevHyp() const { return prevHyp_; }
 
   Word getWord() const { return word_; }
@@ -41,11 +70,72 @@ public:
 
   float getPathScore() const { return pathScore_; }
 
-  const std::vector<float>& getScoreBreakdown() { return scoreBreakdown_; }
-  void setScoreBreakdown(const std::vector<float>& scoreBreakdown) { scoreBreakdown_ = scoreBreakdown; }
+  const std::vector<float>& getScoreBreakdown() {
+    if(!outputs_)
+      return none();
+    if(outputs_->scores) { // first use
+      const float* begin = outputs_->scores->data() + outputs_->scoresOffset;
+      outputs_->scoreBreakdown.assign(begin, begin + outputs_->scoresSize);
+      outputs_->scores.reset();
+    }
+    return outputs_->scoreBreakdown;
+  }
+  // score breakdown without copying it out of a shared array, nullptr if there is none
+  const float* getScoreBreakdownData() const {
+    if(!outputs_)
+      return nullptr;
+    if(outputs_->scores)
+      return outputs_->scores->data() + outputs_->scoresOffset;
+    return outputs_->scoreBreakdown.empty() ? nullptr : outputs_->scoreBreakdown.data();
+  }
+  void setScoreBreakdown(const std::vector<float>& scoreBreakdown) {
+    if(outputs_ || !scoreBreakdown.empty()) {
+      outputs().scoreBreakdown = scoreBreakdown;
+      outputs_->scores.reset();
+    }
+  }
+  // score breakdown at [offset, offset + size) of an array shared by the hypotheses of a step
+  void setScoreBreakdown(Ptr<const std::vector<float>> scores, size_t offset, size_t size) {
+    auto& out = outputs();
+    out.scores = scores;
+    out.scoresOffset = offset;
+    out.scoresSize = size;
+  }
 
-  const std::vector<float>& getAlignment() { return alignment_; }
-  void setAlignment(const std::vector<float>& align) { alignment_ = align; };
+  const std::vector<float>& getAlignment() {
+    if(!outputs_)
+      return none();
+    if(outputs_->attention) { // first use
+      outputs_->alignment = outputs_->attention->extract(outputs_->beamHypIdx, outputs_->currentBatchIdx, outputs_->origBatchIdx);
+      outputs_->attention.reset();
+    }
+    return outputs_->alignment;
+  }
+  void setAlignment(const std::vector<float>& align) {
+    if(outputs_ || !align.empty()) {
+      outputs().alignment = align;
+      outputs_->attention.reset();
+    }
+  };
+  // alignment to be extracted from the attention of a step on first use
+  void setAlignment(Ptr<const AttentionStep> attention, size_t beamHypIdx, size_t currentBatchIdx, size_t origBatchIdx) {
+    auto& out = outputs();
+    out.attention = attention;
+    out.beamHypIdx = beamHypIdx;
+    out.currentBatchIdx = currentBatchIdx;
+    out.origBatchIdx = origBatchIdx;
+  }
+  // same alignment as hyp, without extracting it
+  void copyAlignment(const Hypothesis& hyp) {
+    if(!hyp.outputs_)
+      return;
+    auto& out = outputs();
+    out.alignment = hyp.outputs_->alignment;
+    out.attention = hyp.outputs_->attention;
+    out.beamHypIdx = hyp.outputs_->beamHypIdx;
+    out.currentBatchIdx = hyp.outputs_->currentBatchIdx;
+    out.origBatchIdx = hyp.outputs_->origBatchIdx;
+  }
 
   // trace back paths referenced from this hypothesis
   Words tracebackWords() {
@@ -88,8 +178,30 @@ private:
   const Word word_;
   const float pathScore_;
 
-  std::vector<float> scoreBreakdown_; // [num scorers]
-  std::vector<float> alignment_;
+  // only allocated for hypotheses that have a score breakdown (--n-best) or an alignment (--alignment)
+  struct Outputs {
+    std::vector<float> scoreBreakdown; // [num scorers]
+    Ptr<const std::vector<float>> scores; // if set, scoreBreakdown is still to be copied from it
+    size_t scoresOffset{0};
+    size_t scoresSize{0};
+    std::vector<float> alignment;
+    Ptr<const AttentionStep> attention; // if set, alignment is still to be extracted from it
+    size_t beamHypIdx{0};
+    size_t currentBatchIdx{0};
+    size_t origBatchIdx{0};
+  };
+  UPtr<Outputs> outputs_;
+
+  Outputs& outputs() {
+    if(!outputs_)
+      outputs_.reset(new Outputs());
+    return *outputs_;
+  }
+
+  static const std::vector<float>& none() {
+    static const std::vector<float> empty;
+    return empty;
+  }
 
   ENABLE_INTRUSIVE_PTR(Hypothesis)
 };
@@ -4,6 +4,7 @@
  */
 
 #include "translator/nth_element.h"
+#include "tensors/cpu/topk.h"
 #include <algorithm>
 #include <iterator>
 #include <limits>
@@ -12,8 +13,9 @@
 namespace marian {
 
 class NthElementCPU {
-  std::vector<int> h_res_idx;
+  std::vector<IndexType> h_res_idx;
   std::vector<float> h_res;
+  cpu::TopKSelector topk_; // streaming top-k per batch entry, shared with cpu::TopK
   //size_t lastN_;
 
 public:
@@ -39,27 +41,16 @@ public:
     size_t pos = 0; // iterates through h_res and h_res_idx
 
     size_t batchOffset = inputN * vocabSize;
-    std::vector<int> idxs(batchOffset); // re-used for each batch
-    std::iota(idxs.begin(), idxs.end(), 0);
+    ABORT_IF(N > batchOffset, "Cannot select {} best out of {} scores", N, batchOffset);
 
     for(size_t batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
+      // top N (beam size) scores and their idxs relative to this batch entry, best first
+      topk_.select(scoresData, batchOffset, N, /*descending=*/true, h_res_idx.data() + pos, h_res.data() + pos);
 
-      std::partial_sort( 
-        // sorts the top N (beam size) idxs by score to the front
-        idxs.begin(),
-        idxs.begin() + N,
-        idxs.end(),
-        [&](int a, int b) { return scoresData[a] > scoresData[b]; }
-      );
-
-      // copy top N idxs and scores to return vectors
-      for(size_t i = 0; i < N; ++i) {
-        int idx = idxs[i];
-        // since idxs is re-used for each batch, add batch offset to each idx to get absolute position
-        h_res_idx[pos] = (int) (idx + batchIdx * batchOffset);
-        h_res[pos] = scoresData[idx];
-        ++pos;
-      }
+      // add batch offset to each idx to get absolute position
+      for(size_t i = 0; i < N; ++i)
+        h_res_idx[pos + i] += (IndexType)(batchIdx * batchOffset);
+      pos += N;
 
       // advance pointer to next batch's beginning
       scoresData += batchOffset;
@@ -6,76 +6,135 @@
 
 namespace marian {
 
+namespace {
+const size_t INITIAL_WINDOW = 1024;
+}
+
 OutputCollector::OutputCollector()
-  : nextId_(0),
-    printing_(new DefaultPrinting()) {}
+  : window_(INITIAL_WINDOW),
+    nextId_(0),
+    printing_(new DefaultPrinting()) {
+#if USE_PTHREADS
+  writer_ = std::thread([this]() { writerLoop(); });
+#endif
+}
 
 OutputCollector::OutputCollector(std::string outFile)
-  : nextId_(0),
-    outStrm_(new std::ostream(std::cout.rdbuf())),
-    printing_(new DefaultPrinting()) {
+  : OutputCollector() {
   if (outFile != "stdout")
     outStrm_.reset(new io::OutputFileStream(outFile));
+  else
+    outStrm_.reset(new std::ostream(std::cout.rdbuf()));
+}
+
+OutputCollector::~OutputCollector() {
+  close();
+}
+
+void OutputCollector::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(stop_)
+      return;
+    stop_ = true;
+  }
+#if USE_PTHREADS
+  ready_.notify_one();
+  writer_.join();
+#endif
+  if(outStrm_)
+    *outStrm_ << std::flush;
 }
 
 void OutputCollector::Write(long sourceId,
-                            const std::string& best1,
-                            const std::string& bestn,
+                            std::string best1,
+                            std::string bestn,
                             bool nbest) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if(sourceId == nextId_) {
-    if(printing_->shouldBePrinted(sourceId))
-      LOG(info, "Best translation {} : {}", sourceId, best1);
-
-    if(outStrm_) {
-      if(nbest)
-        *outStrm_ << bestn << std::endl;
-      else
-        *outStrm_ << best1 << std::endl;
-    }
+  std::unique_lock<std::mutex> lock(mutex_);
+  ABORT_IF(stop_, "Output for sentence {} written after the collector was closed", sourceId);
+  ABORT_IF(sourceId < nextId_, "Output for sentence {} has already been written", sourceId);
+  if(sourceId - nextId_ >= (long)window_.size())
+    grow(sourceId);
+
+  auto& output = window_[sourceId % window_.size()];
+  output.ready = true;
+  output.nbest = nbest;
+  output.best1 = std::move(best1);
+  output.bestn = std::move(bestn);
+
+  if(sourceId != nextId_)
+    return; // has to wait for earlier outputs
+
+#if USE_PTHREADS
+  lock.unlock();
+  ready_.notify_one();
+#else
+  std::vector<Output> outputs;
+  long firstId = takeReady(outputs);
+  lock.unlock();
+  writeOut(outputs, firstId);
+#endif
+}
+
+void OutputCollector::grow(long sourceId) {
+  size_t size = window_.size();
+  while(sourceId - nextId_ >= (long)size)
+    size *= 2;
+
+  std::vector<Output> window(size);
+  for(long id = nextId_; id < nextId_ + (long)window_.size(); ++id)
+    window[id % size] = std::move(window_[id % window_.size()]);
+  window_.swap(window);
+}
 
+long OutputCollector::takeReady(std::vector<Output>& outputs) {
+  long firstId = nextId_;
+  outputs.clear();
+  for(;;) {
+    auto& output = window_[nextId_ % window_.size()];
+    if(!output.ready)
+      break;
+    outputs.push_back(std::move(output));
+    output = Output();
     ++nextId_;
+  }
+  return firstId;
+}
 
-    Outputs::const_iterator iter, iterNext;
-    iter = outputs_.begin();
-    while(iter != outputs_.end()) {
-      long currId = iter->first;
-
-      if(currId == nextId_) {
-        // 1st element in the map is the next
-        const auto& currOutput = iter->second;
-        if(printing_->shouldBePrinted(currId))
-          LOG(info, "Best translation {} : {}", currId, currOutput.first);
-
-        if(outStrm_) {
-          if(nbest)
-            *outStrm_ << currOutput.second << std::endl;
-          else
-            *outStrm_ << currOutput.first << std::endl;
-        }
-
-        ++nextId_;
-
-        // delete current record, move iter on 1
-        iterNext = iter;
-        ++iterNext;
-        outputs_.erase(iter);
-        iter = iterNext;
-      } else {
-        // not the next. stop iterating
-        assert(nextId_ < currId);
-        break;
-      }
-    }
+void OutputCollector::writeOut(const std::vector<Output>& outputs, long firstId) {
+  long id = firstId;
+  bool nbest = false;
+  std::string buffer;
+  for(const auto& output : outputs) {
+    if(printing_->shouldBePrinted(id))
+      LOG(info, "Best translation {} : {}", id, output.best1);
+    buffer += output.nbest ? output.bestn : output.best1;
+    buffer += '\n';
+    nbest = nbest || output.nbest;
+    ++id;
+  }
 
+  if(outStrm_) {
+    outStrm_->write(buffer.data(), buffer.size());
     // for 1-best, flush stdout so that we can consume this immediately from an
     // external process
-    if(outStrm_ && !nbest)
+    if(!nbest)
       *outStrm_ << std::flush;
+  }
+}
 
-  } else {
-    // save for later
-    outputs_[sourceId] = std::make_pair(best1, bestn);
+void OutputCollector::writerLoop() {
+  std::vector<Output> outputs;
+  for(;;) {
+    long firstId;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [&]() { return stop_ || window_[nextId_ % window_.size()].ready; });
+      firstId = takeReady(outputs);
+      if(outputs.empty()) // stopped and nothing left to write
+        return;
+    }
+    writeOut(outputs, firstId);
   }
 }
 
@@ -3,9 +3,13 @@
 #include "common/definitions.h"
 #include "common/file_stream.h"
 
+#include <condition_variable>
 #include <mutex>
 #include <iostream>
 #include <map>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace marian {
 
@@ -44,19 +48,34 @@ private:
   long next_{10};
 };
 
+// Writes translations in the order of their source ids while they arrive out of order from several
+// threads. Outputs that arrive early wait in a ring buffer indexed by source id, which grows if an id
+// lies beyond the current window. Logging and writing happen on a dedicated writer thread outside
+// of the lock, each contiguous range of outputs with a single write call.
 class OutputCollector {
 public:
   OutputCollector();
   OutputCollector(std::string outFile);
 
   template <class T>
-  OutputCollector(T&& arg) : nextId_(0), outStrm_(new io::OutputFileStream(arg)) {}
+  OutputCollector(T&& arg) : OutputCollector() {
+    outStrm_.reset(new io::OutputFileStream(arg));
+  }
 
   OutputCollector(const OutputCollector&) = delete;
 
+  // calls close()
+  ~OutputCollector();
+
+  // Writes all outputs that are complete up to the first missing id, stops the writer thread and
+  // flushes the stream. Call it once all Write() calls have returned when the file is read right
+  // after, since the last reference to the collector may still be held by a finishing task.
+  // Write() must not be called afterwards.
+  void close();
+
   void Write(long sourceId,
-             const std::string& best1,
-             const std::string& bestn,
+             std::string best1,
+             std::string bestn,
              bool nbest);
 
   void setPrintingStrategy(Ptr<PrintingStrategy> strategy) {
@@ -64,12 +83,29 @@ public:
   }
 
 protected:
-  typedef std::map<long, std::pair<std::string, std::string>> Outputs;
-  Outputs outputs_;
-  long nextId_;
+  struct Output {
+    bool ready{false};
+    bool nbest{false};
+    std::string best1;
+    std::string bestn;
+  };
+
+  std::vector<Output> window_; // ring buffer, output for id is at id % window_.size()
+  long nextId_;                // next id to be written
   UPtr<std::ostream> outStrm_;
   Ptr<PrintingStrategy> printing_;
+
   std::mutex mutex_;
+  std::condition_variable ready_; // signals the writer that output nextId_ is ready
+  bool stop_{false};
+#if USE_PTHREADS
+  std::thread writer_;
+#endif
+
+  void grow(long sourceId); // enlarges the window so that it covers sourceId, under lock
+  long takeReady(std::vector<Output>& outputs); // moves out the contiguous ready outputs, returns the id of the first, under lock
+  void writeOut(const std::vector<Output>& outputs, long firstId); // logs and writes, without lock
+  void writerLoop();
 };
 
 class StringCollector {
@@ -0,0 +1,101 @@
+#include "translator/request_batcher.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace marian {
+
+ServiceRequest::ServiceRequest(std::vector<data::SentenceTuple>&& sentences)
+    : sentences_(std::move(sentences)),
+      translations_(sentences_.size()),
+      done_(sentences_.size(), false),
+      pending_(sentences_.size()) {}
+
+void ServiceRequest::setTranslation(size_t i, const std::string& best1, const std::string& bestn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(done_[i])
+    return;
+  done_[i] = true;
+  translations_[i] = std::make_pair(best1, bestn);
+  if(--pending_ == 0)
+    finished_.notify_all();
+}
+
+void ServiceRequest::setError(size_t i, std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(done_[i])
+    return;
+  done_[i] = true;
+  if(!error_)
+    error_ = error;
+  if(--pending_ == 0)
+    finished_.notify_all();
+}
+
+std::vector<std::string> ServiceRequest::wait(bool nbest) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  finished_.wait(lock, [this] { return pending_ == 0; });
+  if(error_)
+    std::rethrow_exception(error_);
+
+  std::vector<std::string> outputs;
+  for(const auto& translation : translations_)
+    outputs.emplace_back(nbest ? translation.second : translation.first);
+  return outputs;
+}
+
+RequestBatcher::RequestBatcher(size_t maxBatchSize, size_t maxLatencyMs)
+    : maxBatchSize_(std::max(maxBatchSize, (size_t)1)),
+      maxLatency_(std::chrono::milliseconds(maxLatencyMs)) {}
+
+void RequestBatcher::push(Ptr<ServiceRequest> request) {
+  auto now = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(size_t i = 0; i < request->size(); ++i)
+      queue_.push_back({request, i, now});
+  }
+  ready_.notify_all();
+}
+
+bool RequestBatcher::pop(std::vector<Item>& items) {
+  items.clear();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for(;;) {
+    ready_.wait(lock, [this] { return shutdown_ || !queue_.empty(); });
+    if(queue_.empty()) // only after shutdown
+      return false;
+
+    // wait for more sentences until the batch is full or the oldest one is due; the oldest sentence
+    // can only change if another worker takes it, in which case the deadline is recomputed
+    while(!shutdown_ && !queue_.empty() && queue_.size() < maxBatchSize_) {
+      auto deadline = queue_.front().arrival + maxLatency_;
+      if(ready_.wait_until(lock, deadline) == std::cv_status::timeout)
+        break;
+    }
+    if(!queue_.empty()) // otherwise another worker took everything while we were waiting
+      break;
+  }
+
+  size_t batchSize = std::min(queue_.size(), maxBatchSize_);
+  items.assign(std::make_move_iterator(queue_.begin()),
+               std::make_move_iterator(queue_.begin() + batchSize));
+  queue_.erase(queue_.begin(), queue_.begin() + batchSize);
+  lock.unlock();
+
+  // there may be a full batch left for the other workers
+  if(batchSize == maxBatchSize_)
+    ready_.notify_all();
+  return true;
+}
+
+void RequestBatcher::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  ready_.notify_all();
+}
+
+}  // namespace marian
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "data/corpus_base.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace marian {
+
+// A single call of TranslateService::run(): the encoded source sentences of the request and their
+// translations, which are filled in by the workers that picked up the sentences.
+class ServiceRequest {
+public:
+  ServiceRequest(std::vector<data::SentenceTuple>&& sentences);
+  ServiceRequest(const ServiceRequest&) = delete;
+
+  size_t size() const { return sentences_.size(); }
+  const data::SentenceTuple& sentence(size_t i) const { return sentences_[i]; }
+
+  // thread-safe, only the first translation or error of a sentence counts
+  void setTranslation(size_t i, const std::string& best1, const std::string& bestn);
+
+  // marks sentence i as failed, wait() rethrows the first error of the request
+  void setError(size_t i, std::exception_ptr error);
+
+  // blocks until all sentences of the request have been translated or have failed
+  std::vector<std::string> wait(bool nbest);
+
+private:
+  std::vector<data::SentenceTuple> sentences_;
+  std::vector<std::pair<std::string, std::string>> translations_; // [sentence] (1-best, n-best)
+  std::vector<bool> done_;
+  size_t pending_;
+  std::exception_ptr error_;
+
+  std::mutex mutex_;
+  std::condition_variable finished_;
+};
+
+// Queue of sentences from concurrent service requests. Sentences of different requests are merged
+// into shared mini-batches; a batch is released as soon as it is full or once its oldest sentence
+// has waited for the maximum latency, so that a lone request is not held back indefinitely.
+class RequestBatcher {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Item {
+    Ptr<ServiceRequest> request;
+    size_t index;                // sentence index within the request
+    Clock::time_point arrival;
+  };
+
+  RequestBatcher(size_t maxBatchSize, size_t maxLatencyMs);
+
+  // enqueues all sentences of the request
+  void push(Ptr<ServiceRequest> request);
+
+  // blocks until the next batch is due and moves it into items, returns false after shutdown()
+  bool pop(std::vector<Item>& items);
+
+  // wakes up all waiting workers, remaining sentences are still handed out
+  void shutdown();
+
+private:
+  size_t maxBatchSize_;
+  Clock::duration maxLatency_;
+
+  std::deque<Item> queue_;
+  bool shutdown_{false};
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+};
+
+}  // namespace marian
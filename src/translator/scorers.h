@@ -15,6 +15,14 @@ public:
   virtual Logits getLogProbs() const = 0;
 
   virtual void blacklist(Expr /*totalCosts*/, Ptr<data::CorpusBatch> /*batch*/){};
+
+  // Whether sentences can join the batch of this state, see DecoderState::append()
+  virtual bool canAppend() const { return false; }
+
+  // Appends the sentences of the start state other, see DecoderState::append()
+  virtual Ptr<ScorerState> append(Ptr<ScorerState> /*other*/) {
+    ABORT("Sentences cannot be appended to this scorer state");
+  }
 };
 
 class Scorer {
@@ -43,6 +51,19 @@ public:
                                 int beamSize)
       = 0;
 
+  // Whether the last step() can be replayed for steps of the same shapes, see BeamSearch::search()
+  virtual bool canReplayStep() { return false; }
+
+  // Same as step() for a state of the shapes of the recorded step, computed by ExpressionGraph::replay()
+  virtual Ptr<ScorerState> replayStep(Ptr<ExpressionGraph>,
+                                      Ptr<ScorerState>,
+                                      const std::vector<IndexType>&,
+                                      const Words&,
+                                      const std::vector<IndexType>& /*batchIndices*/,
+                                      int /*beamSize*/) {
+    ABORT("Scorer {} cannot replay a recorded step", name_);
+  }
+
   virtual void init(Ptr<ExpressionGraph>) {}
 
   virtual void setShortlistGenerator(Ptr<const data::ShortlistGenerator> /*shortlistGenerator*/){};
@@ -66,6 +87,13 @@ public:
   virtual void blacklist(Expr totalCosts, Ptr<data::CorpusBatch> batch) override {
     state_->blacklist(totalCosts, batch);
   }
+
+  virtual bool canAppend() const override { return state_->canAppend(); }
+
+  virtual Ptr<ScorerState> append(Ptr<ScorerState> other) override {
+    auto otherState = std::dynamic_pointer_cast<ScorerWrapperState>(other);
+    return New<ScorerWrapperState>(state_->append(otherState->getState()));
+  }
 };
 
 // class to wrap IEncoderDecoder in a Scorer interface
@@ -138,6 +166,20 @@ public:
     return New<ScorerWrapperState>(newState);
   }
 
+  virtual bool canReplayStep() override { return encdec_->canReplayStep(); }
+
+  virtual Ptr<ScorerState> replayStep(Ptr<ExpressionGraph> graph,
+                                      Ptr<ScorerState> state,
+                                      const std::vector<IndexType>& hypIndices,
+                                      const Words& words,
+                                      const std::vector<IndexType>& batchIndices,
+                                      int beamSize) override {
+    graph->switchParams(getName());
+    auto wrapperState = std::dynamic_pointer_cast<ScorerWrapperState>(state);
+    auto newState = encdec_->replayStep(graph, wrapperState->getState(), hypIndices, words, batchIndices, beamSize);
+    return New<ScorerWrapperState>(newState);
+  }
+
   virtual void setShortlistGenerator(
       Ptr<const data::ShortlistGenerator> shortlistGenerator) override {
     encdec_->setShortlistGenerator(shortlistGenerator);
@@ -0,0 +1,191 @@
+#include "translator/translation_cache.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace marian {
+
+namespace {
+
+// approximate book-keeping cost of an entry in the list and the hash map
+const size_t ENTRY_OVERHEAD = 128;
+
+size_t entryBytes(const std::string& key, const std::string& best1, const std::string& bestn) {
+  return 2 * key.size() + best1.size() + bestn.size() + ENTRY_OVERHEAD; // the key is stored twice
+}
+
+// n-best lines start with "<lineNum> ||| "
+std::string stripLineNums(const std::string& bestn, size_t lineNum) {
+  std::string prefix = std::to_string(lineNum) + " ||| ";
+  std::string stripped;
+  std::istringstream lines(bestn);
+  std::string line;
+  bool first = true;
+  while(std::getline(lines, line)) {
+    if(!first)
+      stripped += "\n";
+    first = false;
+    stripped += line.compare(0, prefix.size(), prefix) == 0 ? line.substr(prefix.size()) : line;
+  }
+  return stripped;
+}
+
+std::string addLineNums(const std::string& bestn, size_t lineNum) {
+  std::string prefix = std::to_string(lineNum) + " ||| ";
+  std::string output;
+  std::istringstream lines(bestn);
+  std::string line;
+  bool first = true;
+  while(std::getline(lines, line)) {
+    if(!first)
+      output += "\n";
+    first = false;
+    output += prefix + line;
+  }
+  return output;
+}
+
+}  // namespace
+
+TranslationCache::TranslationCache(size_t maxBytes, size_t optionsHash)
+    : maxBytes_(maxBytes), optionsHash_(optionsHash) {}
+
+TranslationCache::~TranslationCache() {
+  if(hits_ + misses_ > 0)
+    LOG(info,
+        "Translation cache: {} hits, {} misses ({:.1f}% hit rate), {} entries using {} bytes",
+        hits_, misses_, 100.f * hits_ / (hits_ + misses_), entries_.size(), bytes_);
+}
+
+std::string TranslationCache::key(Ptr<data::CorpusBatch> batch, size_t batchIdx) const {
+  std::string key((const char*)&optionsHash_, sizeof(optionsHash_));
+  for(size_t j = 0; j < batch->sets(); ++j) {
+    auto sb = (*batch)[j];
+    uint32_t length = 0;
+    std::string words;
+    for(size_t s = 0; s < sb->batchWidth(); ++s) {
+      size_t pos = sb->locate(batchIdx, s);
+      if(sb->mask()[pos] == 0)
+        break;
+      WordIndex word = sb->data()[pos].toWordIndex();
+      words.append((const char*)&word, sizeof(word));
+      length++;
+    }
+    key.append((const char*)&length, sizeof(length)); // separates the streams
+    key.append(words);
+  }
+  return key;
+}
+
+std::vector<size_t> TranslationCache::lookup(Ptr<data::CorpusBatch> batch, const Found& found) {
+  std::vector<size_t> misses;
+  for(size_t i = 0; i < batch->size(); ++i) {
+    auto k = key(batch, i);
+    std::string best1, bestn;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(k);
+      if(it == index_.end()) {
+        misses_++;
+        misses.push_back(i);
+        continue;
+      }
+      hits_++;
+      entries_.splice(entries_.begin(), entries_, it->second); // mark as most recently used
+      best1 = it->second->best1;
+      bestn = it->second->bestn;
+    }
+    found(i, best1, addLineNums(bestn, batch->getSentenceIds()[i]));
+  }
+  return misses;
+}
+
+Ptr<data::CorpusBatch> TranslationCache::filter(Ptr<data::CorpusBatch> batch, const Found& found) {
+  auto misses = lookup(batch, found);
+  if(misses.empty())
+    return nullptr;
+  if(misses.size() == batch->size())
+    return batch;
+  return select(batch, misses);
+}
+
+void TranslationCache::put(Ptr<data::CorpusBatch> batch,
+                           size_t batchIdx,
+                           const std::string& best1,
+                           const std::string& bestn) {
+  Entry entry{key(batch, batchIdx), best1, stripLineNums(bestn, batch->getSentenceIds()[batchIdx])};
+  size_t bytes = entryBytes(entry.key, entry.best1, entry.bestn);
+  if(bytes > maxBytes_)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(index_.count(entry.key) > 0) // translated concurrently by another batch
+    return;
+
+  while(bytes_ + bytes > maxBytes_) { // evict least recently used
+    const auto& last = entries_.back();
+    bytes_ -= entryBytes(last.key, last.best1, last.bestn);
+    index_.erase(last.key);
+    entries_.pop_back();
+  }
+
+  entries_.push_front(std::move(entry));
+  index_[entries_.front().key] = entries_.begin();
+  bytes_ += bytes;
+}
+
+Ptr<data::CorpusBatch> TranslationCache::select(Ptr<data::CorpusBatch> batch,
+                                                const std::vector<size_t>& batchIndices) {
+  size_t batchSize = batchIndices.size();
+
+  std::vector<Ptr<data::SubBatch>> subBatches;
+  for(size_t j = 0; j < batch->sets(); ++j) {
+    auto sb = (*batch)[j];
+
+    std::vector<size_t> lengths;
+    size_t width = 0;
+    for(auto i : batchIndices) {
+      size_t length = 0;
+      while(length < sb->batchWidth() && sb->mask()[sb->locate(i, length)] != 0)
+        length++;
+      lengths.push_back(length);
+      width = std::max(width, length);
+    }
+
+    auto selected = New<data::SubBatch>(batchSize, width, sb->vocab());
+    size_t words = 0;
+    for(size_t b = 0; b < batchSize; ++b) {
+      for(size_t s = 0; s < lengths[b]; ++s) {
+        selected->data()[selected->locate(b, s)] = sb->data()[sb->locate(batchIndices[b], s)];
+        selected->mask()[selected->locate(b, s)] = 1.f;
+        words++;
+      }
+    }
+    selected->setWords(words);
+    subBatches.push_back(selected);
+  }
+
+  std::vector<size_t> sentenceIds;
+  for(auto i : batchIndices)
+    sentenceIds.push_back(batch->getSentenceIds()[i]);
+
+  auto selected = New<data::CorpusBatch>(subBatches);
+  selected->setSentenceIds(sentenceIds);
+  return selected;
+}
+
+Ptr<TranslationCache> createTranslationCache(Ptr<Options> options) {
+  auto cacheSizeMB = options->get<size_t>("translation-cache", 0);
+  if(cacheSizeMB == 0)
+    return nullptr;
+  if(options->get<bool>("output-sampling", false)) {
+    LOG(warn, "Output sampling is not deterministic, disabling the translation cache");
+    return nullptr;
+  }
+  // options are fixed for the lifetime of the cache, hashing all of them covers every decoding option
+  auto optionsHash = std::hash<std::string>()(options->asYamlString());
+  return New<TranslationCache>(cacheSizeMB * 1024 * 1024, optionsHash);
+}
+
+}  // namespace marian
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "common/options.h"
+#include "data/corpus_base.h"
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace marian {
+
+// LRU cache of printed translations (1-best and n-best output as produced by OutputPrinter), keyed by
+// the encoded source sentence(s) and a hash of the decoding options. Line numbers in the n-best list
+// are stored without the sentence id and re-inserted for the sentence being looked up, so that cached
+// output is identical to a fresh decode. Thread-safe.
+class TranslationCache {
+public:
+  typedef std::function<void(size_t /*batchIdx*/, const std::string& /*best1*/, const std::string& /*bestn*/)> Found;
+
+  TranslationCache(size_t maxBytes, size_t optionsHash);
+  ~TranslationCache(); // logs hit and miss counts
+
+  // Passes the cached translations of the batch's sentences to found(), returns the positions of the
+  // sentences in the batch that still need to be translated.
+  std::vector<size_t> lookup(Ptr<data::CorpusBatch> batch, const Found& found);
+
+  // Like lookup(), but returns a batch of the sentences that still need to be translated or nullptr
+  // if all of them were cached.
+  Ptr<data::CorpusBatch> filter(Ptr<data::CorpusBatch> batch, const Found& found);
+
+  // Stores the output of the sentence at position batchIdx of the batch.
+  void put(Ptr<data::CorpusBatch> batch, size_t batchIdx, const std::string& best1, const std::string& bestn);
+
+  // Batch consisting of the sentences of batch at the given positions, sentence ids are kept.
+  static Ptr<data::CorpusBatch> select(Ptr<data::CorpusBatch> batch, const std::vector<size_t>& batchIndices);
+
+private:
+  struct Entry {
+    std::string key;
+    std::string best1;
+    std::string bestn; // without sentence ids
+  };
+
+  std::string key(Ptr<data::CorpusBatch> batch, size_t batchIdx) const;
+
+  size_t maxBytes_;
+  size_t optionsHash_;
+
+  std::list<Entry> entries_; // most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  size_t bytes_{0};
+
+  size_t hits_{0};
+  size_t misses_{0};
+
+  std::mutex mutex_;
+};
+
+// Cache as configured by --translation-cache, nullptr if disabled
+Ptr<TranslationCache> createTranslationCache(Ptr<Options> options);
+
+}  // namespace marian
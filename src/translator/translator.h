@@ -1,5 +1,7 @@
 #pragma once
 
+#include <mutex>
+#include <numeric>
 #include <string>
 
 #include "data/batch_generator.h"
@@ -11,15 +13,22 @@
 #include "3rd_party/threadpool.h"
 #endif
 
+#include "common/timer.h"
 #include "translator/history.h"
 #include "translator/output_collector.h"
 #include "translator/output_printer.h"
+#include "translator/request_batcher.h"
+#include "translator/translation_cache.h"
+#include "translator/worker_pool.h"
 
 #include "models/model_task.h"
 #include "translator/scorers.h"
 
 // currently for diagnostics only, will try to mmap files ending in *.bin suffix when enabled.
 #include "3rd_party/mio/mio.hpp"
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 namespace marian {
 
@@ -39,6 +48,19 @@ private:
   std::vector<mio::mmap_source> model_mmaps_; // map
   std::vector<std::vector<io::Item>> model_items_; // non-mmap
 
+  Ptr<TranslationCache> cache_;
+
+  // Starts reading the mapped model in the background, so that creating the parameters does not stall on
+  // page faults for every tensor touched for the first time.
+  static void prefetch(const mio::mmap_source& mmap) {
+#if defined(__linux__)
+    if(madvise((void*)mmap.data(), mmap.mapped_length(), MADV_WILLNEED) != 0)
+      LOG(warn, "Could not prefetch memory-mapped model (error {})", errno);
+#else
+    (void)mmap;
+#endif
+  }
+
 public:
   Translate(Ptr<Options> options)
     : options_(New<Options>(options->clone())) { // @TODO: clone should return Ptr<Options> same as "with"?
@@ -48,13 +70,16 @@ public:
     options_->set("inference", true,
                   "shuffle", "none");
 
+    timer::Timer total, timer;
     corpus_ = New<data::Corpus>(options_, true);
 
     auto vocabs = options_->get<std::vector<std::string>>("vocabs");
     trgVocab_ = New<Vocab>(options_, vocabs.size() - 1);
     trgVocab_->load(vocabs.back());
     auto srcVocab = corpus_->getVocabs()[0];
+    LOG(info, "[startup] Loaded vocabularies in {:.3f}s", timer.elapsed());
 
+    timer.start();
     if(options_->hasAndNotEmpty("shortlist")) {
       auto slOptions = options_->get<std::vector<std::string>>("shortlist");
       ABORT_IF(slOptions.empty(), "No path to shortlist file given");
@@ -65,6 +90,7 @@ public:
       else
           shortlistGenerator_ = New<data::LexicalShortlistGenerator>(
               options_, srcVocab, trgVocab_, 0, 1, vocabs.front() == vocabs.back());
+      LOG(info, "[startup] Loaded shortlist in {:.3f}s", timer.elapsed());
     }
 
     auto devices = Config::getDevices(options_);
@@ -76,11 +102,13 @@ public:
     scorers_.resize(numDevices_);
     graphs_.resize(numDevices_);
 
+    timer.start();
     auto models = options->get<std::vector<std::string>>("models");
     if(options_->get<bool>("model-mmap", false)) {
       for(auto model : models) {
         ABORT_IF(!io::isBin(model), "Non-binarized models cannot be mmapped");
         model_mmaps_.push_back(mio::mmap_source(model));
+        prefetch(model_mmaps_.back());
       }
     }
     else {
@@ -89,10 +117,13 @@ public:
         model_items_.push_back(std::move(items));
       }
     }
+    LOG(info, "[startup] {} models in {:.3f}s",
+        options_->get<bool>("model-mmap", false) ? "Mapped" : "Loaded", timer.elapsed());
 
     size_t id = 0;
     for(auto device : devices) {
       auto task = [&](DeviceId device, size_t id) {
+        timer::Timer timer;
         auto graph = New<ExpressionGraph>(true);
         auto prec = options_->get<std::vector<std::string>>("precision", {"float32"});
         graph->setDefaultElementType(typeFromString(prec[0]));
@@ -114,9 +145,13 @@ public:
           if(shortlistGenerator_)
             scorer->setShortlistGenerator(shortlistGenerator_);
         }
-
         scorers_[id] = scorers;
-        graph->forward();
+        double paramsTime = timer.elapsed();
+
+        timer.start();
+        graph->forward(); // initializes the parameters
+        LOG(info, "[startup] Device {}: created parameters in {:.3f}s, first forward in {:.3f}s",
+            device, paramsTime, timer.elapsed());
       };
 
 #if USE_PTHREADS
@@ -125,6 +160,12 @@ public:
       task(device, id++);
 #endif
     }
+#if USE_PTHREADS
+    threadPool.join_all(); // the report below includes graph initialization
+#endif
+    LOG(info, "[startup] Translator ready after {:.3f}s", total.elapsed());
+
+    cache_ = createTranslationCache(options_);
 
     if(options_->get<bool>("output-sampling", false)) {
       if(options_->get<size_t>("beam-size") > 1)
@@ -146,10 +187,6 @@ public:
     data::BatchGenerator<data::Corpus> bg(corpus_, options_, nullptr, false);
   #endif
 
-#if USE_PTHREADS
-    ThreadPool threadPool(numDevices_, numDevices_);
-#endif
-
     size_t batchId = 0;
     auto collector = New<OutputCollector>(options_->get<std::string>("output"));
     auto printer = New<OutputPrinter>(options_, trgVocab_);
@@ -159,6 +196,14 @@ public:
     bg.prepare();
 
     bool doNbest = options_->get<bool>("n-best");
+    if(options_->get<bool>("continuous-batching", false)) {
+      runContinuous(bg, collector, printer, doNbest);
+      return;
+    }
+
+#if USE_PTHREADS
+    ThreadPool threadPool(numDevices_, numDevices_);
+#endif
     for(auto batch : bg) {
       auto task = [=](size_t id) {
         thread_local Ptr<ExpressionGraph> graph;
@@ -169,19 +214,29 @@ public:
           scorers = scorers_[id % numDevices_];
         }
 
-        auto search = New<Search>(options_, scorers, trgVocab_);
-        auto histories = search->search(graph, batch);
+        // sentences with cached translations are written right away and removed from the batch
+        auto input = batch;
+        if(cache_)
+          input = cache_->filter(batch, [&](size_t i, const std::string& best1, const std::string& bestn) {
+            collector->Write((long)batch->getSentenceIds()[i], best1, bestn, doNbest);
+          });
 
-        for(auto history : histories) {
-          std::stringstream best1;
-          std::stringstream bestn;
-          printer->print(history, best1, bestn);
-          collector->Write((long)history->getLineNum(),
-                           best1.str(),
-                           bestn.str(),
-                           doNbest);
-        }
+        if(input) {
+          auto search = New<Search>(options_, scorers, trgVocab_);
+          auto histories = search->search(graph, input);
 
+          for(size_t i = 0; i < histories.size(); ++i) {
+            std::stringstream best1;
+            std::stringstream bestn;
+            printer->print(histories[i], best1, bestn);
+            collector->Write((long)histories[i]->getLineNum(),
+                             best1.str(),
+                             bestn.str(),
+                             doNbest);
+            if(cache_)
+              cache_->put(input, i, best1.str(), bestn.str());
+          }
+        }
 
         // progress heartbeat for MS-internal Philly compute cluster
         // otherwise this job may be killed prematurely if no log for 4 hrs
@@ -202,6 +257,62 @@ public:
 
     }
   }
+
+private:
+  // --continuous-batching: each device decodes up to --mini-batch sentences at a time and refills the slots
+  // of finished sentences from the batches of bg, which are split to the number of free slots
+  void runContinuous(data::BatchGenerator<data::Corpus>& bg,
+                     Ptr<OutputCollector> collector,
+                     Ptr<OutputPrinter> printer,
+                     bool doNbest) {
+    std::mutex inputMutex;
+    auto nextBatch = bg.begin();
+    Ptr<data::CorpusBatch> pending; // sentences of the last batch of bg that did not fit yet
+    auto refill = [&](size_t maxDimBatch) -> Ptr<data::CorpusBatch> {
+      std::lock_guard<std::mutex> lock(inputMutex);
+      while(!pending && nextBatch != bg.end()) {
+        auto batch = *nextBatch;
+        ++nextBatch;
+        // sentences with cached translations are written right away and removed from the batch
+        pending = !cache_ ? batch : cache_->filter(batch, [&](size_t i, const std::string& best1, const std::string& bestn) {
+          collector->Write((long)batch->getSentenceIds()[i], best1, bestn, doNbest);
+        });
+      }
+      auto batch = pending;
+      pending = nullptr;
+      if(batch && batch->size() > maxDimBatch) {
+        std::vector<size_t> first(maxDimBatch), rest(batch->size() - maxDimBatch);
+        std::iota(first.begin(), first.end(), 0);
+        std::iota(rest.begin(), rest.end(), maxDimBatch);
+        pending = TranslationCache::select(batch, rest);
+        batch = TranslationCache::select(batch, first);
+      }
+      return batch;
+    };
+
+    auto done = [&](Ptr<data::CorpusBatch> batch, size_t i, Ptr<History> history) {
+      std::stringstream best1;
+      std::stringstream bestn;
+      printer->print(history, best1, bestn);
+      collector->Write((long)history->getLineNum(), best1.str(), bestn.str(), doNbest);
+      if(cache_)
+        cache_->put(batch, i, best1.str(), bestn.str());
+    };
+
+    auto maxDimBatch = (size_t)options_->get<int>("mini-batch");
+    auto task = [&](size_t id) {
+      auto search = New<Search>(options_, scorers_[id], trgVocab_);
+      search->search(graphs_[id], maxDimBatch, refill, done);
+    };
+
+#if USE_PTHREADS
+    ThreadPool threadPool(numDevices_, numDevices_); // joins before the input and output it refers to go
+    for(size_t id = 0; id < numDevices_; ++id)
+      threadPool.enqueue(task, id);
+#else
+    task(0);
+#endif
+  }
 };
 
 template <class Search>
@@ -217,8 +328,20 @@ private:
 
   size_t numDevices_;
 
+  // long-lived workers, worker i exclusively owns graphs_[i] and scorers_[i]
+  UPtr<WorkerPool> workers_;
+
+  // merges sentences of concurrent requests into shared batches, see --max-batch-delay
+  UPtr<RequestBatcher> batcher_;
+
+  Ptr<TranslationCache> cache_;
+
 public:
-  virtual ~TranslateService() {}
+  virtual ~TranslateService() {
+    if(batcher_)
+      batcher_->shutdown(); // lets the workers leave translateQueued()
+    workers_.reset();
+  }
 
   TranslateService(Ptr<Options> options)
     : options_(New<Options>(options->clone())) {
@@ -226,6 +349,7 @@ public:
     options_->set("inference", true);
     options_->set("shuffle", "none");
 
+    timer::Timer total, timer;
     auto vocabPaths = options_->get<std::vector<std::string>>("vocabs");
     std::vector<int> maxVocabs = options_->get<std::vector<int>>("dim-vocabs");
 
@@ -237,8 +361,10 @@ public:
 
     trgVocab_ = New<Vocab>(options_, vocabPaths.size() - 1);
     trgVocab_->load(vocabPaths.back());
+    LOG(info, "[startup] Loaded vocabularies in {:.3f}s", timer.elapsed());
 
     // load lexical shortlist
+    timer.start();
     if(options_->hasAndNotEmpty("shortlist")) {
       auto slOptions = options_->get<std::vector<std::string>>("shortlist");
       ABORT_IF(slOptions.empty(), "No path to shortlist file given");
@@ -249,6 +375,7 @@ public:
       else
         shortlistGenerator_ = New<data::LexicalShortlistGenerator>(
             options_, srcVocabs_.front(), trgVocab_, 0, 1, vocabPaths.front() == vocabPaths.back());
+      LOG(info, "[startup] Loaded shortlist in {:.3f}s", timer.elapsed());
     }
 
     // get device IDs
@@ -256,23 +383,31 @@ public:
     numDevices_ = devices.size();
 
     // preload models
+    timer.start();
     std::vector<std::vector<io::Item>> model_items_;
     auto models = options->get<std::vector<std::string>>("models");
     for(auto model : models) {
       auto items = io::loadItems(model);
       model_items_.push_back(std::move(items));
     }
+    LOG(info, "[startup] Loaded models in {:.3f}s", timer.elapsed());
 
-    // initialize scorers
-    for(auto device : devices) {
+    cache_ = createTranslationCache(options_);
+
+    // initialize graphs and scorers on the workers owning them, so that workspace and parameters are
+    // first touched by the (possibly pinned) thread that will use them
+    graphs_.resize(numDevices_);
+    scorers_.resize(numDevices_);
+    auto init = [&](size_t workerIdx) {
+      timer::Timer timer;
       auto graph = New<ExpressionGraph>(true);
 
       auto precison = options_->get<std::vector<std::string>>("precision", {"float32"});
       graph->setDefaultElementType(typeFromString(precison[0])); // only use first type, used for parameter type in graph
-      graph->setDevice(device);
+      graph->setDevice(devices[workerIdx]);
       graph->getBackend()->configureDevice(options_);
       graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
-      graphs_.push_back(graph);
+      graphs_[workerIdx] = graph;
 
       auto scorers = createScorers(options_, model_items_);
       for(auto scorer : scorers) {
@@ -280,7 +415,29 @@ public:
         if(shortlistGenerator_)
           scorer->setShortlistGenerator(shortlistGenerator_);
       }
-      scorers_.push_back(scorers);
+      scorers_[workerIdx] = scorers;
+      double paramsTime = timer.elapsed();
+
+      timer.start();
+      graph->forward(); // initializes the parameters
+      LOG(info, "[startup] Worker {}: created parameters in {:.3f}s, first forward in {:.3f}s",
+          workerIdx, paramsTime, timer.elapsed());
+    };
+    // each CPU worker gets a core for itself and one for each of its intra-op threads
+    size_t coresPerWorker = devices[0].type == DeviceType::cpu ? options_->get<size_t>("cpu-intra-op-threads", 1) : 1;
+    workers_.reset(new WorkerPool(numDevices_, init, options_->get<std::vector<size_t>>("worker-cores", {}), coresPerWorker));
+    LOG(info, "[startup] Service ready after {:.3f}s", total.elapsed());
+
+    auto maxBatchDelay = options_->get<size_t>("max-batch-delay", 0);
+    if(maxBatchDelay > 0) {
+#if USE_PTHREADS
+      batcher_.reset(new RequestBatcher(options_->get<size_t>("mini-batch"), maxBatchDelay));
+      // occupies every worker for the lifetime of the service
+      for(size_t i = 0; i < numDevices_; ++i)
+        workers_->submit([this](size_t workerIdx) { translateQueued(workerIdx); });
+#else
+      LOG(warn, "Request batching requires thread support, ignoring --max-batch-delay");
+#endif
     }
   }
 
@@ -290,6 +447,17 @@ public:
                       ? convertTsvToLists(input, options_->get<size_t>("tsv-fields", 1))
                       : std::vector<std::string>({input});
     auto corpus_ = New<data::TextInput>(inputs, srcVocabs_, options_);
+
+    if(batcher_) {
+      std::vector<data::SentenceTuple> sentences;
+      for(auto tuple = corpus_->next(); !tuple.empty(); tuple = corpus_->next())
+        sentences.push_back(tuple);
+
+      auto request = New<ServiceRequest>(std::move(sentences));
+      batcher_->push(request);
+      return utils::join(request->wait(options_->get<bool>("n-best")), "\n");
+    }
+
   #if USE_PTHREADS
     data::BatchGenerator<data::TextInput> batchGenerator(corpus_, options_);
   #else
@@ -299,50 +467,105 @@ public:
 
     auto collector = New<StringCollector>(options_->get<bool>("quiet-translation", false));
     auto printer = New<OutputPrinter>(options_, trgVocab_);
-    size_t batchId = 0;
 
     batchGenerator.prepare();
 
-    {
-#if USE_PTHREADS
-      ThreadPool threadPool_(numDevices_, numDevices_);
-#endif
-
-      for(auto batch : batchGenerator) {
-        auto task = [=](size_t id) {
-          thread_local Ptr<ExpressionGraph> graph;
-          thread_local std::vector<Ptr<Scorer>> scorers;
+    std::vector<std::future<void>> results;
+    for(auto batch : batchGenerator) {
+      auto task = [=](size_t workerIdx) {
+        auto input = batch;
+        if(cache_)
+          input = cache_->filter(batch, [&](size_t i, const std::string& best1, const std::string& bestn) {
+            collector->add((long)batch->getSentenceIds()[i], best1, bestn);
+          });
+        if(!input)
+          return;
+
+        auto search = New<Search>(options_, scorers_[workerIdx], trgVocab_);
+        auto histories = search->search(graphs_[workerIdx], input);
+
+        for(size_t i = 0; i < histories.size(); ++i) {
+          std::stringstream best1;
+          std::stringstream bestn;
+          printer->print(histories[i], best1, bestn);
+          collector->add((long)histories[i]->getLineNum(), best1.str(), bestn.str());
+          if(cache_)
+            cache_->put(input, i, best1.str(), bestn.str());
+        }
+      };
+      results.push_back(workers_->submit(task));
+    }
+    for(auto& result : results)
+      result.get();
 
-          if(!graph) {
-            graph = graphs_[id % numDevices_];
-            scorers = scorers_[id % numDevices_];
-          }
+    auto translations = collector->collect(options_->get<bool>("n-best"));
+    return utils::join(translations, "\n");
+  }
 
-          auto search = New<Search>(options_, scorers, trgVocab_);
-          auto histories = search->search(graph, batch);
+private:
+  // Worker loop, translates batches of queued sentences and hands the translations back to the
+  // requests they came from.
+  void translateQueued(size_t workerIdx) {
+    auto quiet = options_->get<bool>("quiet-translation", false);
+    auto printer = New<OutputPrinter>(options_, trgVocab_);
 
-          for(auto history : histories) {
-            std::stringstream best1;
-            std::stringstream bestn;
-            printer->print(history, best1, bestn);
-            collector->add((long)history->getLineNum(), best1.str(), bestn.str());
-          }
-        };
+    std::vector<RequestBatcher::Item> items;
+    while(batcher_->pop(items)) {
+      // an error only fails the requests of this batch, the worker keeps serving the queue
+      try {
+        translateItems(workerIdx, items, printer, quiet);
+      } catch(...) {
+        auto error = std::current_exception();
+        LOG(error, "Translating {} queued sentences failed", items.size());
+        for(const auto& item : items)
+          item.request->setError(item.index, error); // sentences with a translation are not affected
+      }
+    }
+  }
 
-#if USE_PTHREADS
-        threadPool_.enqueue(task, batchId);
-#else
-        task(batchId);
-#endif
-        batchId++;
+  // Translates one batch of queued sentences, those found in the cache are answered from there
+  void translateItems(size_t workerIdx,
+                      std::vector<RequestBatcher::Item>& items,
+                      Ptr<OutputPrinter> printer,
+                      bool quiet) {
+    std::vector<data::SentenceTuple> sentences;
+    for(const auto& item : items)
+      sentences.push_back(item.request->sentence(item.index));
+    auto batch = data::TextInput::toBatch(sentences, srcVocabs_);
+
+    if(cache_) {
+      auto misses = cache_->lookup(batch, [&](size_t i, const std::string& best1, const std::string& bestn) {
+        if(!quiet)
+          LOG(info, "Best translation {} : {}", batch->getSentenceIds()[i], best1);
+        items[i].request->setTranslation(items[i].index, best1, bestn);
+      });
+      if(misses.empty())
+        return;
+      if(misses.size() < items.size()) {
+        batch = TranslationCache::select(batch, misses);
+        std::vector<RequestBatcher::Item> remaining;
+        for(auto i : misses)
+          remaining.push_back(items[i]);
+        items.swap(remaining);
       }
     }
 
-    auto translations = collector->collect(options_->get<bool>("n-best"));
-    return utils::join(translations, "\n");
+    auto search = New<Search>(options_, scorers_[workerIdx], trgVocab_);
+    auto histories = search->search(graphs_[workerIdx], batch);
+
+    // histories are in batch order
+    for(size_t i = 0; i < histories.size(); ++i) {
+      std::stringstream best1;
+      std::stringstream bestn;
+      printer->print(histories[i], best1, bestn);
+      if(!quiet)
+        LOG(info, "Best translation {} : {}", histories[i]->getLineNum(), best1.str());
+      items[i].request->setTranslation(items[i].index, best1.str(), bestn.str());
+      if(cache_)
+        cache_->put(batch, i, best1.str(), bestn.str());
+    }
   }
 
-private:
   // Converts a multi-line input with tab-separated source(s) and target sentences into separate lists
   // of sentences from source(s) and target sides, e.g.
   // "src1 \t trg1 \n src2 \t trg2" -> ["src1 \n src2", "trg1 \n trg2"]
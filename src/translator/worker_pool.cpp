@@ -0,0 +1,101 @@
+#include "translator/worker_pool.h"
+#include "common/logging.h"
+#include "common/utils.h"
+
+namespace marian {
+
+WorkerPool::WorkerPool(size_t numWorkers,
+                       const Job& init,
+                       const std::vector<size_t>& cores,
+                       size_t coresPerWorker)
+    : numWorkers_(numWorkers) {
+  ABORT_IF(numWorkers_ == 0, "Worker pool needs at least one worker");
+#if USE_PTHREADS
+  std::vector<std::promise<void>> ready(numWorkers_);
+  std::vector<std::future<void>> initialized;
+  for(auto& r : ready)
+    initialized.push_back(r.get_future());
+  for(size_t i = 0; i < numWorkers_; ++i)
+    workers_.emplace_back([this, i, &init, &cores, coresPerWorker, &ready] {
+      work(i, init, utils::workerCores(cores, i, coresPerWorker), ready[i]);
+    });
+  for(auto& i : initialized) // init and cores are only referenced until here
+    i.wait();
+  try {
+    for(auto& i : initialized)
+      i.get(); // re-throws what init() threw on the worker
+  } catch(...) {
+    stop(); // the destructor does not run for a constructor that throws
+    throw;
+  }
+#else
+  if(!cores.empty())
+    LOG(warn, "Pinning threads to CPU cores requires thread support, ignoring");
+  for(size_t i = 0; i < numWorkers_; ++i)
+    init(i);
+#endif
+}
+
+WorkerPool::~WorkerPool() {
+#if USE_PTHREADS
+  stop();
+#endif
+}
+
+std::future<void> WorkerPool::submit(Job job) {
+  std::packaged_task<void(size_t)> task(std::move(job));
+  auto result = task.get_future();
+#if USE_PTHREADS
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ABORT_IF(stop_, "Submitting a job to a stopped worker pool");
+    jobs_.emplace_back(std::move(task));
+  }
+  condition_.notify_one();
+#else
+  task(0);
+#endif
+  return result;
+}
+
+#if USE_PTHREADS
+void WorkerPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  for(auto& worker : workers_)
+    worker.join();
+}
+
+void WorkerPool::work(size_t workerIdx,
+                      const Job& init,
+                      const std::vector<size_t>& cores,
+                      std::promise<void>& ready) {
+  try {
+    if(!cores.empty()) // the others are left to the worker's intra-op threads
+      utils::pinCurrentThread(cores[0]);
+    init(workerIdx);
+  } catch(...) { // e.g. a model that fails to load, reported to the constructor
+    ready.set_exception(std::current_exception());
+    return;
+  }
+  ready.set_value();
+
+  for(;;) {
+    std::packaged_task<void(size_t)> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if(jobs_.empty()) // stopped and drained
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    job(workerIdx);
+  }
+}
+#endif
+
+}  // namespace marian
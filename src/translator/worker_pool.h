@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common/definitions.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace marian {
+
+// Long-lived worker threads, one per device. Each worker first runs init(workerIdx) on its own thread
+// to build the state it owns exclusively (e.g. graph and scorers), then executes submitted jobs as
+// job(workerIdx) on that state. Jobs are picked up by whichever worker is idle.
+//
+// If CPU cores are given, worker i owns the next coresPerWorker of them, see utils::workerCores(), and
+// is pinned to the first one before init() runs, so that memory first touched during init()
+// (workspace, parameters) is allocated on the worker's NUMA node. The other cores are meant for the
+// intra-op threads of the worker's CPU backend, see --cpu-intra-op-threads.
+//
+// Without thread support init() and all jobs run synchronously in the calling thread as worker 0.
+class WorkerPool {
+public:
+  typedef std::function<void(size_t /*workerIdx*/)> Job;
+
+  // returns after init() has completed on all workers; if it threw on any of them, the workers are joined
+  // and the exception is re-thrown
+  WorkerPool(size_t numWorkers,
+             const Job& init,
+             const std::vector<size_t>& cores = {},
+             size_t coresPerWorker = 1);
+  WorkerPool(const WorkerPool&) = delete;
+
+  // finishes all queued jobs before joining the workers
+  ~WorkerPool();
+
+  size_t size() const { return numWorkers_; }
+
+  // the future is ready once the job has run, exceptions thrown by the job are re-thrown by get()
+  std::future<void> submit(Job job);
+
+private:
+  size_t numWorkers_;
+
+#if USE_PTHREADS
+  void stop(); // finishes the queued jobs and joins the workers
+  void work(size_t workerIdx, const Job& init, const std::vector<size_t>& cores, std::promise<void>& ready);
+
+  std::vector<std::thread> workers_;
+  std::deque<std::packaged_task<void(size_t)>> jobs_;
+  bool stop_{false};
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+#endif
+};
+
+}  // namespace marian